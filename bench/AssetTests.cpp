@@ -0,0 +1,299 @@
+﻿// AssetTests.cpp: 资源加载路径的回归测试
+// 在固定的obj样例与临时生成的网格模型上校验：
+// ObjParser的属性、面索引、shape划分与材质和tinyobj::LoadObj一致；VertexDeduplicator与逐顶点哈希去重的结果逐字节一致；
+// 越界或相对索引解析为负数的面被ObjParser拒绝，并在错误信息中给出行号；
+// 另外在奇数、非2的幂与1xN等尺寸的随机图片上校验MipGenerator::generate与标量参考实现的差不超过1
+//
+// 用法: AssetTests [obj文件]...
+//   默认使用bench/fixtures中的样例与临时生成的网格模型，任何一项不一致时返回1
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#include "MipGenerator.h"
+#include "ObjParser.h"
+#include "ThreadPool.h"
+#include "VertexDedup.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifndef ASSET_TESTS_FIXTURE_DIR // 由CMake指定为源码中的bench/fixtures
+#define ASSET_TESTS_FIXTURE_DIR "bench/fixtures/"
+#endif
+
+const static uint32_t GRID_SIDE = 256;       // 生成的网格模型每边的四边形数量，文件足够大以切分为多个解析块
+const static uint32_t GRID_ROWS_PER_GROUP = 16; // 每个g组的行数，组之间的边界行各自重复写入一次顶点
+
+// 覆盖奇数、非2的幂、1xN与Nx1、以及宽高相差悬殊的尺寸
+const static uint32_t MIP_TEST_SIZES[][2] = {{1, 1}, {1, 7}, {7, 1}, {1, 256}, {300, 1}, {2, 2}, {3, 5},
+                                             {17, 9}, {64, 64}, {255, 129}, {640, 480}, {1000, 3}, {1023, 1025}};
+
+static uint32_t s_failureCount = 0;
+
+static void expect(bool condition, const std::string& message) {
+    if (!condition) {
+        std::cerr << "FAILED: " << message << std::endl;
+        s_failureCount++;
+    }
+}
+
+// 改用VertexDeduplicator之前loadModel中的实现：逐个面顶点构造Vertex，按数值哈希去重
+static void legacyDeduplicate(const tinyobj::attrib_t& attr, const std::vector<IndexRange>& ranges,
+                              std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
+    std::unordered_map<Vertex, uint32_t> uniqueVertexIndexMap{};
+    for (const auto& range : ranges) {
+        for (size_t i = 0; i < range.count; i++) {
+            const tinyobj::index_t& index = range.indices[i];
+            Vertex vertex;
+            vertex.position = {
+                attr.vertices[3 * index.vertex_index + 0],
+                attr.vertices[3 * index.vertex_index + 1],
+                attr.vertices[3 * index.vertex_index + 2],
+            };
+            if (index.texcoord_index >= 0) {
+                vertex.texCoord = {attr.texcoords[2 * index.texcoord_index + 0],
+                                   1.0f - attr.texcoords[2 * index.texcoord_index + 1]};
+            } else {
+                vertex.texCoord = {0.0f, 0.0f};
+            }
+            if (uniqueVertexIndexMap.count(vertex) == 0) {
+                uniqueVertexIndexMap[vertex] = static_cast<uint32_t>(vertices.size());
+                vertices.push_back(vertex);
+            }
+            indices.push_back(uniqueVertexIndexMap[vertex]);
+        }
+    }
+}
+
+// 与tinyobj逐项比对；tinyobj不做三角化，由这里按ObjParser的约定以第一个顶点为中心扇形展开，
+// 避免tinyobj版本之间三角化方式的差异
+static void testObjParser(const std::string& path, ThreadPool& threadPool) {
+    ObjParser parser(threadPool);
+    parser.parse(path);
+    tinyobj::attrib_t expectedAttr;
+    std::vector<tinyobj::shape_t> expectedShapes;
+    std::vector<tinyobj::material_t> expectedMaterials;
+    std::string warn, err;
+    std::string baseDir = std::filesystem::path(path).parent_path().string() + "/";
+    if (!tinyobj::LoadObj(&expectedAttr, &expectedShapes, &expectedMaterials, &warn, &err, path.c_str(),
+                          baseDir.c_str(), false)) {
+        throw std::runtime_error("tinyobj failed to load " + path + ": " + err);
+    }
+    const tinyobj::attrib_t& attr = parser.attrib();
+    expect(expectedAttr.vertices == attr.vertices, path + ": positions differ from tinyobj");
+    expect(expectedAttr.texcoords == attr.texcoords, path + ": texcoords differ from tinyobj");
+    expect(expectedAttr.normals == attr.normals, path + ": normals differ from tinyobj");
+    expect(expectedMaterials.size() == parser.materials().size(), path + ": material count differs from tinyobj");
+    for (size_t m = 0; m < std::min(expectedMaterials.size(), parser.materials().size()); m++) {
+        expect(expectedMaterials[m].name == parser.materials()[m].name
+                   && expectedMaterials[m].diffuse_texname == parser.materials()[m].diffuse_texname,
+               path + ": material " + std::to_string(m) + " differs from tinyobj");
+    }
+
+    std::vector<IndexRange> ranges = parser.indexRanges();
+    expect(expectedShapes.size() == ranges.size(), path + ": shape count differs from tinyobj");
+    size_t triangleBase = 0;
+    for (size_t s = 0; s < std::min(expectedShapes.size(), ranges.size()); s++) {
+        const tinyobj::mesh_t& mesh = expectedShapes[s].mesh;
+        std::vector<tinyobj::index_t> expectedIndices;
+        std::vector<int> expectedMaterialIds;
+        size_t faceOffset = 0;
+        for (size_t f = 0; f < mesh.num_face_vertices.size(); f++) {
+            size_t faceVertexCount = mesh.num_face_vertices[f];
+            for (size_t v = 2; v < faceVertexCount; v++) {
+                expectedIndices.push_back(mesh.indices[faceOffset]);
+                expectedIndices.push_back(mesh.indices[faceOffset + v - 1]);
+                expectedIndices.push_back(mesh.indices[faceOffset + v]);
+                expectedMaterialIds.push_back(mesh.material_ids[f]);
+            }
+            faceOffset += faceVertexCount;
+        }
+        std::string shape = path + ": shape " + std::to_string(s);
+        if (expectedIndices.size() != ranges[s].count) {
+            expect(false, shape + " index count differs from tinyobj");
+            continue;
+        }
+        bool indicesMatch = true;
+        for (size_t i = 0; i < expectedIndices.size(); i++) {
+            const tinyobj::index_t& index = ranges[s].indices[i];
+            indicesMatch = indicesMatch && expectedIndices[i].vertex_index == index.vertex_index
+                           && expectedIndices[i].texcoord_index == index.texcoord_index
+                           && expectedIndices[i].normal_index == index.normal_index;
+        }
+        expect(indicesMatch, shape + " face indices differ from tinyobj");
+        // ObjParser的shape按文件顺序连续存放，三角形的材质序号按全局位置排列
+        expect(std::equal(expectedMaterialIds.begin(), expectedMaterialIds.end(),
+                          parser.materialIds().begin() + triangleBase),
+               shape + " material ids differ from tinyobj");
+        triangleBase += expectedMaterialIds.size();
+    }
+    std::cout << "obj parser: " << path << ", " << attr.vertices.size() / 3 << " positions, "
+              << parser.indices().size() / 3 << " triangles match tinyobj" << std::endl;
+}
+
+// 每个样例的最后一行是出错的面，错误信息应包含该行的行号
+const static char* const INVALID_FACE_OBJS[] = {
+    "v 0 0 0\nv 1 0 0\nv 0 1 0\nvt 0 0\nvn 0 0 1\nf 1/-99/-99 2/1/1 3/1/1\n", // 相对纹理坐标与法线越界
+    "v 0 0 0\nv 1 0 0\nv 0 1 0\nvt 0 0\nf 1/-2 2/1 3/1\n",                    // 相对纹理坐标恰好解析为-1
+    "v 0 0 0\nv 1 0 0\nv 0 1 0\nvn 0 0 1\nf 1//1 2//-2 3//1\n",               // 相对法线恰好解析为-1
+    "v 0 0 0\nv 1 0 0\nv 0 1 0\nf -4 2 3\n",                                   // 相对顶点越界
+    "v 0 0 0\nv 1 0 0\nv 0 1 0\nvt 0 0\nf 1/1 2/2 3/1\n",                      // 纹理坐标越界
+};
+
+static void testInvalidFaces(ThreadPool& threadPool) {
+    std::string path = (std::filesystem::temp_directory_path() / "AssetTests_invalid.obj").string();
+    for (const char* contents : INVALID_FACE_OBJS) {
+        {
+            std::ofstream file(path, std::ios::binary);
+            file << contents;
+        }
+        std::string text = contents;
+        std::string line = "line " + std::to_string(std::count(text.begin(), text.end(), '\n'));
+        ObjParser parser(threadPool);
+        std::string error;
+        try {
+            parser.parse(path);
+        } catch (const std::runtime_error& e) {
+            error = e.what();
+        }
+        expect(error.find("face index out of range") != std::string::npos && error.find(line) != std::string::npos,
+               "invalid face was not rejected at " + line + ": " + (error.empty() ? "no error" : error));
+    }
+    std::cout << "obj parser: " << std::size(INVALID_FACE_OBJS) << " invalid faces rejected" << std::endl;
+}
+
+static void testVertexDedup(const std::string& path, ThreadPool& threadPool) {
+    ObjParser parser(threadPool);
+    parser.parse(path);
+    std::vector<IndexRange> ranges = parser.indexRanges();
+    std::vector<Vertex> vertices, expectedVertices;
+    std::vector<uint32_t> indices, expectedIndices;
+    VertexDeduplicator deduplicator(threadPool);
+    deduplicator.build(parser.attrib(), ranges, vertices, indices);
+    legacyDeduplicate(parser.attrib(), ranges, expectedVertices, expectedIndices);
+    expect(vertices.size() == expectedVertices.size()
+               && memcmp(vertices.data(), expectedVertices.data(), sizeof(Vertex) * vertices.size()) == 0,
+           path + ": deduplicated vertices differ from the per-vertex hash map");
+    expect(indices == expectedIndices, path + ": deduplicated indices differ from the per-vertex hash map");
+    std::cout << "dedup: " << path << ", " << ranges.size() << " shapes, " << vertices.size() << " vertices, "
+              << indices.size() << " indices" << std::endl;
+}
+
+// 逐级比较每个层级的有效像素，层级之间16字节对齐的填充不参与比较；返回最大差值
+static int compareMipChain(const uint8_t* actual, const uint8_t* expected, uint32_t width, uint32_t height) {
+    std::vector<uint64_t> offsets;
+    MipGenerator::levelOffsets(width, height, offsets);
+    int maxDiff = 0;
+    for (size_t level = 0; level < offsets.size(); level++) {
+        uint32_t levelWidth = std::max(1u, width >> level);
+        uint32_t levelHeight = std::max(1u, height >> level);
+        for (uint64_t i = 0; i < uint64_t(levelWidth) * levelHeight * 4; i++) {
+            maxDiff = std::max(maxDiff, std::abs(actual[offsets[level] + i] - expected[offsets[level] + i]));
+        }
+    }
+    return maxDiff;
+}
+
+static void testMipGenerator(ThreadPool& threadPool) {
+#ifdef ASSET_TESTS_MIP_SIMD_PATH
+    expect(std::string(MipGenerator::simdPath()) == ASSET_TESTS_MIP_SIMD_PATH,
+           std::string("mip generator was built with the ") + MipGenerator::simdPath() + " path instead of " +
+               ASSET_TESTS_MIP_SIMD_PATH);
+#endif
+    MipGenerator mipGenerator(threadPool);
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<int> byte(0, 255);
+    int worstDiff = 0;
+    for (const auto& size : MIP_TEST_SIZES) {
+        uint32_t width = size[0], height = size[1];
+        std::vector<uint64_t> offsets;
+        uint64_t chainSize = MipGenerator::levelOffsets(width, height, offsets);
+        std::vector<uint8_t> source(size_t(width) * height * 4);
+        for (auto& value : source) {
+            value = static_cast<uint8_t>(byte(rng));
+        }
+        for (bool srgb : {true, false}) {
+            std::string name = std::to_string(width) + "x" + std::to_string(height) + (srgb ? " srgb" : " linear");
+            std::vector<uint8_t> expected(chainSize), actual(chainSize), inPlace(chainSize);
+            MipGenerator::generateReference(source.data(), width, height, srgb, expected.data());
+            mipGenerator.generate(source.data(), width, height, srgb, actual.data());
+            // TextureLoader在暂存内存中原地生成：第0级已经拷贝到output的起始位置
+            std::copy(source.begin(), source.end(), inPlace.begin());
+            mipGenerator.generate(inPlace.data(), width, height, srgb, inPlace.data());
+            expect(offsets.size() == MipGenerator::mipLevelCount(width, height), name + ": level count mismatch");
+            expect(std::equal(source.begin(), source.end(), actual.begin()), name + ": level 0 is not a copy of the source");
+            int diff = compareMipChain(actual.data(), expected.data(), width, height);
+            expect(diff <= 1, name + ": max diff " + std::to_string(diff) + " from the scalar reference");
+            expect(compareMipChain(inPlace.data(), actual.data(), width, height) == 0,
+                   name + ": in-place generation differs from generation into a separate buffer");
+            worstDiff = std::max(worstDiff, diff);
+        }
+    }
+    std::cout << "mip generator (" << MipGenerator::simdPath() << "): " << std::size(MIP_TEST_SIZES)
+              << " sizes, srgb and linear, max diff " << worstDiff << " from the scalar reference" << std::endl;
+}
+
+// 生成GRID_SIDE x GRID_SIDE个四边形的网格，按行分为多个g组，每组写入自己的顶点与纹理坐标
+static std::string writeGridObj() {
+    std::string path = (std::filesystem::temp_directory_path() / "AssetTests_grid.obj").string();
+    std::ofstream file(path);
+    if (!file.is_open()) {
+        throw std::runtime_error("failed to write " + path);
+    }
+    uint32_t written = 0; // 已写入的顶点数，面索引从1开始
+    for (uint32_t firstRow = 0; firstRow < GRID_SIDE; firstRow += GRID_ROWS_PER_GROUP) {
+        uint32_t rowCount = std::min(GRID_ROWS_PER_GROUP, GRID_SIDE - firstRow);
+        file << "g rows_" << firstRow << "\n";
+        for (uint32_t y = firstRow; y <= firstRow + rowCount; y++) {
+            for (uint32_t x = 0; x <= GRID_SIDE; x++) {
+                file << "v " << x * 0.25f << " " << y * 0.25f << " " << ((x ^ y) & 7) * 0.125f << "\n";
+                file << "vt " << static_cast<float>(x) / GRID_SIDE << " " << static_cast<float>(y) / GRID_SIDE << "\n";
+            }
+        }
+        for (uint32_t y = 0; y < rowCount; y++) {
+            for (uint32_t x = 0; x < GRID_SIDE; x++) {
+                uint32_t i0 = written + y * (GRID_SIDE + 1) + x + 1;
+                uint32_t i1 = i0 + GRID_SIDE + 1;
+                file << "f " << i0 << "/" << i0 << " " << i0 + 1 << "/" << i0 + 1 << " " << i1 + 1 << "/" << i1 + 1
+                     << " " << i1 << "/" << i1 << "\n";
+            }
+        }
+        written += (rowCount + 1) * (GRID_SIDE + 1);
+    }
+    return path;
+}
+
+int main(int argc, char** argv) {
+    try {
+        std::vector<std::string> objPaths;
+        for (int i = 1; i < argc; i++) {
+            objPaths.push_back(argv[i]);
+        }
+        if (objPaths.empty()) {
+            objPaths = {std::string(ASSET_TESTS_FIXTURE_DIR) + "dedup.obj", writeGridObj()};
+        }
+        ThreadPool threadPool(4); // 固定的线程数，使解析、去重与mip生成总是经过并行与合并的路径
+        testMipGenerator(threadPool);
+        testInvalidFaces(threadPool);
+        for (const auto& path : objPaths) {
+            testObjParser(path, threadPool);
+            testVertexDedup(path, threadPool);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (s_failureCount > 0) {
+        std::cerr << s_failureCount << " checks failed" << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "all checks passed" << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,146 @@
+﻿// CullingBench.cpp: 视锥剔除的基准测试
+// 在随机分布的物体上比较BVH + SIMD剔除与逐个测试的标量实现的吞吐，并校验两者的可见集合一致；
+// SIMD与标量实现的舍入不同，恰好贴着平面的包围盒允许不一致
+//
+// 用法: CullingBench [物体数量]...
+//   默认依次测试10000、100000与1000000个物体，物体密度保持不变，相机绕原点旋转取16个朝向
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include "FrustumCuller.h"
+#include <algorithm>
+#include <array>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <glm/gtc/matrix_transform.hpp>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+const static uint32_t VIEW_COUNT = 16;              // 相机朝向的数量，每次迭代轮换
+const static uint64_t OBJECT_TESTS_PER_RUN = 50000000; // 每种规模的迭代次数按总测试量估算，保证计时足够长
+const static float BOUNDARY_EPSILON = 1e-3f;           // 包围盒到平面的距离在此范围内时两种实现的结果都可接受
+
+static double elapsedMs(std::chrono::high_resolution_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+// 物体均匀分布在边长随数量增长的立方体中，单位体积内的物体数量不变
+static std::vector<MeshBounds> generateScene(uint32_t objectCount, float& halfSize) {
+    halfSize = 50.0f * std::cbrt(objectCount / 10000.0f);
+    std::mt19937 rng(objectCount);
+    std::uniform_real_distribution<float> position(-halfSize, halfSize);
+    std::uniform_real_distribution<float> extent(0.25f, 2.0f);
+    std::vector<MeshBounds> bounds(objectCount);
+    for (auto& box : bounds) {
+        glm::vec3 center(position(rng), position(rng), position(rng));
+        glm::vec3 halfExtent(extent(rng), extent(rng), extent(rng));
+        box.min = center - halfExtent;
+        box.max = center + halfExtent;
+    }
+    return bounds;
+}
+
+// 包围盒相对视锥的最小余量：各平面上中心的有符号距离加上半长在法线上的投影，小于0即完全在某个平面之外
+static float frustumMargin(const MeshBounds& box, const glm::vec4 planes[6]) {
+    glm::vec3 center = (box.min + box.max) * 0.5f;
+    glm::vec3 extent = (box.max - box.min) * 0.5f;
+    float margin = FLT_MAX;
+    for (int i = 0; i < 6; i++) {
+        glm::vec3 normal(planes[i]);
+        margin = std::min(margin, glm::dot(normal, center) + planes[i].w + glm::dot(glm::abs(normal), extent));
+    }
+    return margin;
+}
+
+// 比较两个有序的可见集合，只出现在其中一个里的物体必须贴着视锥的边界，返回这样的物体数量
+static uint32_t compareVisible(const std::vector<uint32_t>& visible, const std::vector<uint32_t>& expected,
+                               const std::vector<MeshBounds>& bounds, const glm::vec4 planes[6]) {
+    std::vector<uint32_t> difference;
+    std::set_symmetric_difference(visible.begin(), visible.end(), expected.begin(), expected.end(),
+                                  std::back_inserter(difference));
+    for (uint32_t object : difference) {
+        if (std::abs(frustumMargin(bounds[object], planes)) > BOUNDARY_EPSILON) {
+            throw std::runtime_error("culling mismatch on object " + std::to_string(object) + " of "
+                                     + std::to_string(bounds.size()) + "!");
+        }
+    }
+    return static_cast<uint32_t>(difference.size());
+}
+
+static void bench(uint32_t objectCount) {
+    float halfSize = 0.0f;
+    std::vector<MeshBounds> bounds = generateScene(objectCount, halfSize);
+    auto startTime = std::chrono::high_resolution_clock::now();
+    FrustumCuller culler;
+    culler.build(bounds);
+    double buildMs = elapsedMs(startTime);
+
+    // 相机位于原点，在水平面内旋转一周，远平面覆盖到场景边界
+    glm::mat4 proj = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, halfSize * 2.0f);
+    std::vector<std::array<glm::vec4, 6>> views(VIEW_COUNT);
+    for (uint32_t v = 0; v < VIEW_COUNT; v++) {
+        float angle = glm::radians(360.0f) * v / VIEW_COUNT;
+        glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(std::cos(angle), std::sin(angle), 0.2f),
+                                     glm::vec3(0.0f, 0.0f, 1.0f));
+        FrustumCuller::extractPlanes(proj * view, views[v].data());
+    }
+
+    std::vector<uint32_t> visible;
+    std::vector<uint32_t> expected;
+    uint64_t visibleTotal = 0;
+    uint32_t boundaryCount = 0;
+    for (const auto& planes : views) {
+        culler.cull(planes.data(), visible);
+        FrustumCuller::cullReference(bounds, planes.data(), expected);
+        std::sort(visible.begin(), visible.end());
+        boundaryCount += compareVisible(visible, expected, bounds, planes.data());
+        visibleTotal += visible.size();
+    }
+
+    uint32_t iterations = static_cast<uint32_t>(std::max<uint64_t>(VIEW_COUNT, OBJECT_TESTS_PER_RUN / std::max(objectCount, 1u)));
+    startTime = std::chrono::high_resolution_clock::now();
+    for (uint32_t i = 0; i < iterations; i++) {
+        culler.cull(views[i % VIEW_COUNT].data(), visible);
+    }
+    double bvhMs = elapsedMs(startTime) / iterations;
+    startTime = std::chrono::high_resolution_clock::now();
+    for (uint32_t i = 0; i < iterations; i++) {
+        FrustumCuller::cullReference(bounds, views[i % VIEW_COUNT].data(), expected);
+    }
+    double referenceMs = elapsedMs(startTime) / iterations;
+
+    std::cout << objectCount << " objects: build " << buildMs << " ms (" << culler.nodeCount() << " nodes), "
+              << 100.0 * visibleTotal / (static_cast<double>(objectCount) * VIEW_COUNT) << "% visible, bvh "
+              << bvhMs << " ms (" << objectCount / bvhMs / 1000.0 << " Mobjects/s), brute force " << referenceMs
+              << " ms (" << objectCount / referenceMs / 1000.0 << " Mobjects/s), " << referenceMs / bvhMs << "x";
+    if (boundaryCount > 0) {
+        std::cout << ", " << boundaryCount << " boundary objects differ";
+    }
+    std::cout << std::endl;
+}
+
+int main(int argc, char** argv) {
+    try {
+        std::vector<uint32_t> objectCounts;
+        for (int i = 1; i < argc; i++) {
+            objectCounts.push_back(static_cast<uint32_t>(std::stoul(argv[i])));
+        }
+        if (objectCounts.empty()) {
+            objectCounts = {10000, 100000, 1000000};
+        }
+        std::cout << "cull bench: " << FrustumCuller::simdPath() << ", leaf size " << FrustumCuller::LEAF_SIZE
+                  << ", " << VIEW_COUNT << " views" << std::endl;
+        for (uint32_t objectCount : objectCounts) {
+            bench(objectCount);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,228 @@
+﻿// LearnVKBench.cpp: 离屏帧时间基准测试
+// 以离屏模式运行渲染器，先渲染预热帧，再逐帧记录测量帧的CPU耗时与GPU时间戳耗时，
+// 输出包含p50/p95/p99的JSON；指定基线文件时逐项比较，超过阈值的分位数视为性能回退
+//
+// 用法: LearnVKBench [--output <json>] [--compare <基线json>] [--threshold <百分比>] [LearnVK的参数]...
+//   LearnVK的参数原样传给渲染器，如--model、--width、--height、--msaa、--frames、--warmup、--gpu-driven；
+//   总是使用--headless与--gpu-profile，默认预热60帧、测量300帧
+//   没有GPU的机器上可以通过VK_ICD_FILENAMES指定lavapipe
+//   返回值：0为成功，1为运行失败，2为与基线相比出现回退
+
+#include "LearnVKApp.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+const static int EXIT_REGRESSION = 2;
+const static double DEFAULT_THRESHOLD_PERCENT = 5.0;
+
+// 一组帧时间的统计，单位为毫秒
+struct FrameTimeStats {
+    double minMs;
+    double avgMs;
+    double p50Ms;
+    double p95Ms;
+    double p99Ms;
+    double maxMs;
+};
+
+// 最近秩法取分位数，样本数较少时p99即最大值
+static double percentile(const std::vector<double>& sorted, double p) {
+    size_t rank = static_cast<size_t>(std::ceil(p * sorted.size()));
+    return sorted[std::max<size_t>(rank, 1) - 1];
+}
+
+static FrameTimeStats computeStats(std::vector<double> samples) {
+    std::sort(samples.begin(), samples.end());
+    double sum = 0.0;
+    for (double ms : samples) {
+        sum += ms;
+    }
+    return {samples.front(), sum / samples.size(), percentile(samples, 0.50), percentile(samples, 0.95),
+            percentile(samples, 0.99), samples.back()};
+}
+
+static std::string escapeJson(const std::string& text) {
+    std::string result;
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            result += '\\';
+        }
+        result += c;
+    }
+    return result;
+}
+
+static void writeStats(std::ostream& out, const char* name, const std::vector<double>& samples, bool last) {
+    out << "  \"" << name << "\": ";
+    if (samples.empty()) {
+        out << "null";
+    } else {
+        FrameTimeStats stats = computeStats(samples);
+        out << "{\"min\": " << stats.minMs << ", \"avg\": " << stats.avgMs << ", \"p50\": " << stats.p50Ms
+            << ", \"p95\": " << stats.p95Ms << ", \"p99\": " << stats.p99Ms << ", \"max\": " << stats.maxMs << "}";
+    }
+    out << (last ? "\n" : ",\n");
+}
+
+static std::string toJson(const AppConfig& config, const FrameTimings& timings) {
+    std::ostringstream out;
+    out.precision(6);
+    out << "{\n";
+    out << "  \"device\": \"" << escapeJson(timings.deviceName) << "\",\n";
+    out << "  \"model\": \"" << escapeJson(config.model) << "\",\n";
+    out << "  \"width\": " << config.width << ",\n";
+    out << "  \"height\": " << config.height << ",\n";
+    out << "  \"msaa\": " << timings.msaaSamples << ",\n";
+    out << "  \"warmupFrames\": " << config.warmupFrames << ",\n";
+    out << "  \"frames\": " << timings.cpuMs.size() << ",\n";
+    writeStats(out, "cpuFrameMs", timings.cpuMs, false);
+    writeStats(out, "gpuFrameMs", timings.gpuMs, true);
+    out << "}\n";
+    return out.str();
+}
+
+// 在JSON中查找section对象(为空时在顶层)里key的值，字符串值去掉引号，null视为不存在；
+// 只需读取本工具写出的扁平格式，不是通用的JSON解析
+static bool findValue(const std::string& json, const std::string& section, const std::string& key,
+                      std::string& value) {
+    size_t begin = 0;
+    size_t end = json.size();
+    if (!section.empty()) {
+        begin = json.find("\"" + section + "\"");
+        if (begin == std::string::npos) {
+            return false;
+        }
+        end = json.find('}', begin);
+    }
+    size_t keyPos = json.find("\"" + key + "\"", begin);
+    if (keyPos == std::string::npos || keyPos >= end) {
+        return false;
+    }
+    size_t pos = json.find(':', keyPos);
+    if (pos == std::string::npos) {
+        return false;
+    }
+    pos = json.find_first_not_of(" \t\r\n", pos + 1);
+    if (pos == std::string::npos) {
+        return false;
+    }
+    if (json[pos] == '"') {
+        value.clear();
+        for (pos++; pos < json.size() && json[pos] != '"'; pos++) {
+            if (json[pos] == '\\' && pos + 1 < json.size()) {
+                pos++;
+            }
+            value += json[pos];
+        }
+        return true;
+    }
+    size_t valueEnd = json.find_first_of(",}\r\n", pos);
+    value = json.substr(pos, valueEnd == std::string::npos ? std::string::npos : valueEnd - pos);
+    return value != "null";
+}
+
+// 比较当前结果与基线的各项分位数，返回是否出现回退；基线与本次的设备或参数不同时只给出提示
+static bool compareWithBaseline(const std::string& current, const std::string& baseline, double thresholdPercent) {
+    const char* settings[] = {"device", "model", "width", "height", "msaa"};
+    for (const char* key : settings) {
+        std::string baseValue, currentValue;
+        if (findValue(baseline, "", key, baseValue) && findValue(current, "", key, currentValue)
+            && baseValue != currentValue) {
+            std::cout << "compare: warning, " << key << " differs from the baseline (" << baseValue << " vs "
+                      << currentValue << ")" << std::endl;
+        }
+    }
+    bool regressed = false;
+    const char* sections[] = {"cpuFrameMs", "gpuFrameMs"};
+    const char* keys[] = {"p50", "p95", "p99"};
+    for (const char* section : sections) {
+        for (const char* key : keys) {
+            std::string baseValue, currentValue;
+            if (!findValue(baseline, section, key, baseValue) || !findValue(current, section, key, currentValue)) {
+                continue;
+            }
+            double baseMs = std::strtod(baseValue.c_str(), nullptr);
+            double currentMs = std::strtod(currentValue.c_str(), nullptr);
+            double changePercent = baseMs > 0.0 ? (currentMs / baseMs - 1.0) * 100.0 : 0.0;
+            bool slower = changePercent > thresholdPercent;
+            regressed = regressed || slower;
+            std::cout << "compare: " << section << "." << key << " " << baseMs << " -> " << currentMs << " ms ("
+                      << (changePercent >= 0.0 ? "+" : "") << changePercent << "%)"
+                      << (slower ? " REGRESSION" : "") << std::endl;
+        }
+    }
+    std::cout << "compare: " << (regressed ? "regression beyond " : "no regression beyond ") << thresholdPercent
+              << "%" << std::endl;
+    return regressed;
+}
+
+int main(int argc, char** argv) {
+    try {
+        std::string outputPath;
+        std::string baselinePath;
+        double thresholdPercent = DEFAULT_THRESHOLD_PERCENT;
+        // 固定的参数放在前面，命令行中同名的参数在后面解析，可以覆盖默认的预热帧数
+        std::vector<char*> appArgs = {argv[0], const_cast<char*>("--headless"), const_cast<char*>("--gpu-profile"),
+                                      const_cast<char*>("--warmup"), const_cast<char*>("60")};
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            if ((arg == "--output" || arg == "--compare" || arg == "--threshold") && i + 1 >= argc) {
+                throw std::invalid_argument("missing value for " + arg);
+            }
+            if (arg == "--output") {
+                outputPath = argv[++i];
+            } else if (arg == "--compare") {
+                baselinePath = argv[++i];
+            } else if (arg == "--threshold") {
+                thresholdPercent = std::strtod(argv[++i], nullptr);
+            } else {
+                appArgs.push_back(argv[i]);
+            }
+        }
+        AppConfig config = AppConfig::parseCommandLine(static_cast<int>(appArgs.size()), appArgs.data());
+
+        // 先读取基线，文件不存在时不必等到渲染结束才报错
+        std::string baseline;
+        if (!baselinePath.empty()) {
+            std::ifstream file(baselinePath);
+            if (!file.is_open()) {
+                throw std::runtime_error("failed to open baseline: " + baselinePath);
+            }
+            std::stringstream buffer;
+            buffer << file.rdbuf();
+            baseline = buffer.str();
+        }
+
+        LearnVKApp app(config);
+        app.run();
+        const FrameTimings& timings = app.frameTimings();
+        if (timings.cpuMs.empty()) {
+            throw std::runtime_error("no frames were measured!");
+        }
+        std::string json = toJson(config, timings);
+        if (outputPath.empty()) {
+            std::cout << json;
+        } else {
+            std::ofstream file(outputPath);
+            file << json;
+            if (!file.good()) {
+                throw std::runtime_error("failed to write benchmark result: " + outputPath);
+            }
+            std::cout << "bench: result written to " << outputPath << std::endl;
+        }
+        if (!baseline.empty() && compareWithBaseline(json, baseline, thresholdPercent)) {
+            return EXIT_REGRESSION;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
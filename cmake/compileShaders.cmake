@@ -1,6 +1,8 @@
 function(compile_shader TARGET_NAME SHADERS SHADER_INCLUDE_DIR)
 
     set(working_dir "${CMAKE_CURRENT_SOURCE_DIR}")
+    # ɵspvͷļύֿ⣬ÿιʱɫԴļɣȷĿ¼
+    file(MAKE_DIRECTORY "${CMAKE_CURRENT_SOURCE_DIR}/generated/spv" "${CMAKE_CURRENT_SOURCE_DIR}/generated/cpp")
     set(GLSLANG_BIN $ENV{VK_SDK_PATH}/Bin/glslangValidator.exe) # glslangValidatorλ
 
     foreach(SHADER ${SHADERS})  # ÿһshaderԴļ
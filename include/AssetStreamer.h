@@ -0,0 +1,92 @@
+﻿// AssetStreamer.h: 后台资源流式加载
+// 渲染线程把请求放入无锁队列，专用的工作线程取出后在主机内存中完成模型解析与纹理解码(需要时生成mip链)，
+// 命中网格缓存或烘焙纹理时把映射的数据预读进内存，渲染线程拷贝时不会因缺页而读盘；
+// 结果放入另一个无锁队列，由渲染线程在每帧开始时取走并按预算上传；队列为空时工作线程在条件变量上休眠
+
+#ifndef LEARN_VK_ASSET_STREAMER
+#define LEARN_VK_ASSET_STREAMER
+#include "LockFreeQueue.h"
+#include "MeshData.h"
+#include "TextureFile.h"
+#include "TextureLoader.h"
+#include "ThreadPool.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class AssetType : uint32_t {
+    Mesh,
+    Texture,
+};
+
+struct AssetRequest {
+    AssetType type = AssetType::Texture;
+    std::string path;
+    uint32_t slot = 0;         // 纹理在材质纹理表中的序号，网格不使用
+    bool ignoreCooked = false; // 纹理：不使用烘焙文件，设备不支持其格式时以此重新请求
+};
+
+// 加载到主机内存的资源，按类型使用对应的成员
+struct StreamedAsset {
+    AssetRequest request;
+    std::unique_ptr<MeshData> mesh;
+    std::unique_ptr<TextureFile> cooked; // 纹理：打开的烘焙文件，层级数据已预读，为空时使用image
+    DecodedImage image;                  // 纹理：解码的RGBA8像素，generateMips时按MipGenerator::levelOffsets包含完整mip链
+    uint32_t mipLevels = 1;              // image中的层级数
+    double loadMs = 0.0;                 // 在工作线程上加载的耗时
+    std::exception_ptr error;            // 加载失败时的异常，由渲染线程决定如何处理
+};
+
+class AssetStreamer {
+public:
+    const static size_t QUEUE_CAPACITY = 1024; // 同时未取走的请求数上限，两个队列都不会溢出
+    // 在工作线程上把path指定的模型加载进mesh
+    using MeshLoader = std::function<void(const std::string& path, MeshData& mesh)>;
+
+    AssetStreamer();
+    ~AssetStreamer();
+    AssetStreamer(const AssetStreamer&) = delete;
+    AssetStreamer& operator=(const AssetStreamer&) = delete;
+
+    // 启动threadCount个工作线程；obj解析与mip生成等嵌套的并行工作使用threadPool，
+    // generateMips为true时解码的纹理在工作线程上生成完整的mip链，用于不支持线性blit的设备
+    void start(uint32_t threadCount, ThreadPool& threadPool, MeshLoader meshLoader, bool generateMips);
+    // 丢弃还没有开始的请求，等待正在加载的完成后退出
+    void stop();
+    bool running() const {
+        return !m_workers.empty();
+    }
+
+    // request与poll只由渲染线程调用；未取走的请求达到QUEUE_CAPACITY时返回false，由调用者稍后重试
+    bool request(AssetRequest request);
+    // 取走一个加载完成的资源，没有时返回false，不会阻塞
+    bool poll(StreamedAsset& asset);
+    // 已请求、尚未取走的资源数量
+    uint32_t outstanding() const {
+        return m_outstanding.load(std::memory_order_relaxed);
+    }
+
+private:
+    void workerLoop();
+    StreamedAsset load(const AssetRequest& request);
+
+    LockFreeQueue<AssetRequest> m_requests;
+    LockFreeQueue<StreamedAsset> m_completed;
+    std::atomic<uint32_t> m_outstanding{0};
+    std::atomic<uint32_t> m_queued{0}; // 请求队列中的数量，工作线程据此决定是否休眠
+    std::mutex m_sleepMutex;
+    std::condition_variable m_wake;
+    bool m_stop = false;
+    std::vector<std::thread> m_workers;
+    ThreadPool* m_threadPool = nullptr;
+    MeshLoader m_meshLoader;
+    bool m_generateMips = false;
+};
+#endif
@@ -0,0 +1,34 @@
+﻿// BlockCompressor.h: BC1/BC3/BC7纹理块压缩
+// 以4x4像素块为单位编码RGBA8数据，端点取块内颜色主轴上的投影范围，再用最小二乘修正一次；
+// BC7只使用单子集的模式6(RGBA各7位端点加p位、4位索引)，质量与速度适合离线烘焙
+
+#ifndef LEARN_VK_BLOCK_COMPRESSOR
+#define LEARN_VK_BLOCK_COMPRESSOR
+#include <cstdint>
+#include <vector>
+
+enum class BlockFormat {
+    BC1, // 不透明RGB，每块8字节
+    BC3, // RGB加独立的alpha块，每块16字节
+    BC7, // 高质量RGBA，每块16字节
+};
+
+class BlockCompressor {
+public:
+    static uint32_t blockBytes(BlockFormat format) {
+        return format == BlockFormat::BC1 ? 8 : 16;
+    }
+    static uint64_t compressedSize(BlockFormat format, uint32_t width, uint32_t height) {
+        return static_cast<uint64_t>((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+    }
+
+    // pixels为16个按行排列的RGBA8像素
+    static void compressBC1(const uint8_t* pixels, uint8_t* block);
+    static void compressBC3(const uint8_t* pixels, uint8_t* block);
+    static void compressBC7(const uint8_t* pixels, uint8_t* block);
+
+    // 压缩一行块(4行像素)，右侧与下方不满一块时重复边缘像素；output指向这一行块的起始
+    static void compressBlockRow(BlockFormat format, const uint8_t* rgba, uint32_t width, uint32_t height,
+                                 uint32_t blockY, uint8_t* output);
+};
+#endif
@@ -0,0 +1,98 @@
+﻿// DeviceMemoryAllocator.h: 设备内存分配器
+// 按内存类型从大块的VkDeviceMemory中用伙伴算法子分配，线性资源(缓冲、线性图像)与最优平铺图像分池，
+// 同一块内不会混放两类资源，因此无需考虑bufferImageGranularity；超过半块大小的资源、
+// 以及驱动通过VkMemoryDedicatedRequirements要求或倾向独立分配的资源使用独立分配；
+// 变空的块每种内存类型最多保留一块备用，其余立即归还驱动
+
+#ifndef LEARN_VK_DEVICE_MEMORY_ALLOCATOR
+#define LEARN_VK_DEVICE_MEMORY_ALLOCATOR
+#include "vulkan/vulkan_core.h"
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+
+struct MemoryAllocation {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    void* mapped = nullptr; // 主机可见内存的持久映射地址(已加上offset)，否则为nullptr
+    uint32_t memoryType = 0;
+    uint32_t poolIndex = UINT32_MAX; // 独立分配时为UINT32_MAX
+    uint32_t blockIndex = 0;
+    uint32_t order = 0;
+};
+
+struct MemoryStats {
+    uint32_t blockCount;         // 子分配使用的VkDeviceMemory块
+    uint32_t dedicatedCount;     // 独立分配的VkDeviceMemory
+    uint32_t allocationCount;    // 块内的子分配数量
+    VkDeviceSize blockBytes;     // 所有块的大小
+    VkDeviceSize usedBytes;      // 块内已分配的大小(按伙伴算法取整后)
+    VkDeviceSize requestedBytes; // 子分配实际请求的大小
+    VkDeviceSize dedicatedBytes;
+};
+
+class DeviceMemoryAllocator {
+public:
+    const static VkDeviceSize DEFAULT_BLOCK_SIZE = 64ull << 20;
+    const static VkDeviceSize MIN_ALLOCATION_SIZE = 256;
+
+    DeviceMemoryAllocator() = default;
+    DeviceMemoryAllocator(const DeviceMemoryAllocator&) = delete;
+    DeviceMemoryAllocator& operator=(const DeviceMemoryAllocator&) = delete;
+
+    void init(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize blockSize = DEFAULT_BLOCK_SIZE);
+    // 释放所有块，调用前所有资源应已归还
+    void destroy();
+
+    // 查找合适的内存类型，使用init时缓存的内存属性
+    uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const;
+
+    // linear为true表示缓冲或线性平铺的图像；dedicatedInfo非空时强制独立分配并链到VkMemoryAllocateInfo上
+    MemoryAllocation allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, bool linear,
+                              const VkMemoryDedicatedAllocateInfo* dedicatedInfo = nullptr);
+    MemoryAllocation allocateForBuffer(VkBuffer buffer, VkMemoryPropertyFlags properties);
+    MemoryAllocation allocateForImage(VkImage image, VkMemoryPropertyFlags properties, VkImageTiling tiling);
+    void free(MemoryAllocation& allocation);
+
+    MemoryStats stats() const;
+    void printStats() const;
+
+private:
+    // 一块VkDeviceMemory上的伙伴分配器，freeLists[order]为大小为2^order的空闲块偏移
+    struct Block {
+        VkDeviceMemory memory;
+        uint8_t* mapped;
+        std::vector<std::set<VkDeviceSize>> freeLists;
+        uint32_t allocationCount;
+    };
+    // 同一内存类型、同一资源类别的块，已释放的块留下空位以保持其它块的blockIndex不变
+    struct Pool {
+        uint32_t memoryType;
+        bool linear;
+        std::vector<std::unique_ptr<Block>> blocks;
+    };
+
+    VkDeviceMemory allocateDeviceMemory(VkDeviceSize size, uint32_t memoryType, void** mapped,
+                                        const VkMemoryDedicatedAllocateInfo* dedicatedInfo = nullptr);
+    bool hasSpareBlock(uint32_t memoryType, const Block* except) const;
+    bool allocateFromBlock(Block& block, uint32_t order, VkDeviceSize& offset);
+    void freeToBlock(Block& block, uint32_t order, VkDeviceSize offset);
+
+    VkPhysicalDevice m_physicalDevice = VK_NULL_HANDLE;
+    VkDevice m_device = VK_NULL_HANDLE;
+    VkPhysicalDeviceMemoryProperties m_memoryProperties = {};
+    VkDeviceSize m_blockSize = DEFAULT_BLOCK_SIZE;
+    uint32_t m_blockOrder = 0;
+    uint32_t m_minOrder = 0;
+    std::vector<Pool> m_pools;
+    uint32_t m_dedicatedCount = 0;
+    VkDeviceSize m_dedicatedBytes = 0;
+    VkDeviceSize m_requestedBytes = 0;
+    uint32_t m_deviceMemoryCount = 0; // 当前存在的VkDeviceMemory数量，受maxMemoryAllocationCount限制
+    uint32_t m_maxMemoryAllocationCount = 0;
+    mutable std::mutex m_mutex;
+};
+#endif
@@ -0,0 +1,69 @@
+﻿// FrustumCuller.h: CPU上的视锥剔除
+// 物体的世界空间包围盒按中位数划分构建BVH，遍历时逐层记录仍与包围盒相交的平面，完全在视锥内的子树整体输出；
+// 叶节点中的物体以SoA存放，按编译目标用AVX2一次测试8个、SSE2一次测试4个包围盒
+
+#ifndef LEARN_VK_FRUSTUM_CULLER
+#define LEARN_VK_FRUSTUM_CULLER
+#include "MeshCache.h"
+#include <cstdint>
+#include <glm/mat4x4.hpp>
+#include <glm/vec4.hpp>
+#include <vector>
+
+class FrustumCuller {
+public:
+    const static uint32_t LEAF_SIZE = 32; // 叶节点的物体数量上限
+
+    // 编译进来的包围盒测试实现
+    static const char* simdPath();
+
+    // 从投影与观察矩阵的乘积中提取视锥的六个平面(左、右、下、上、近、远)，法线指向视锥内侧并归一化；
+    // 深度范围为[0,1]，与GLM_FORCE_DEPTH_ZERO_TO_ONE一致
+    static void extractPlanes(const glm::mat4& viewProj, glm::vec4 planes[6]);
+    // 变换后包围盒的轴对齐包围盒，用于由物体空间的包围盒得到世界空间的包围盒
+    static MeshBounds transformBounds(const glm::mat4& transform, const MeshBounds& bounds);
+
+    // 由物体在世界空间的包围盒构建BVH，物体序号即bounds中的下标；物体移动后需要重新构建
+    void build(const std::vector<MeshBounds>& bounds);
+
+    // 输出与视锥相交的物体序号，planes为extractPlanes得到的六个平面(法线指向内侧)，
+    // 结果按BVH的叶节点顺序排列，不保证有序
+    void cull(const glm::vec4 planes[6], std::vector<uint32_t>& visible) const;
+
+    // 逐个物体的标量参考实现，用于校验cull的结果与衡量BVH的收益
+    static void cullReference(const std::vector<MeshBounds>& bounds, const glm::vec4 planes[6],
+                              std::vector<uint32_t>& visible);
+
+    uint32_t objectCount() const {
+        return static_cast<uint32_t>(m_order.size());
+    }
+    uint32_t nodeCount() const {
+        return static_cast<uint32_t>(m_nodes.size());
+    }
+
+private:
+    // 深度优先排列，左子节点紧跟在父节点之后
+    struct Node {
+        float center[3];
+        float extent[3];
+        uint32_t first; // 子树中的物体在重排后数组中连续存放
+        uint32_t count;
+        uint32_t right; // 右子节点的下标，叶节点为0
+    };
+
+    struct BuildEntry; // 构建时按中心点划分的物体，连续存放以减少随机访问
+
+    // 递归划分[first, first + count)，返回节点下标，nodeBounds为子树的包围盒
+    uint32_t buildNode(uint32_t first, uint32_t count, const std::vector<MeshBounds>& bounds,
+                       std::vector<BuildEntry>& entries, MeshBounds& nodeBounds);
+    // 测试[first, first + count)中的物体对planeMask中的平面，可见的追加到visible
+    void cullLeaf(uint32_t first, uint32_t count, const glm::vec4 planes[6], uint32_t planeMask,
+                  std::vector<uint32_t>& visible) const;
+
+    std::vector<Node> m_nodes;
+    std::vector<uint32_t> m_order; // 重排后的位置 -> 物体序号
+    // 重排后物体包围盒的中心与半长(SoA)，末尾多出一个SIMD宽度的填充，叶节点的尾部可以整组读取
+    std::vector<float> m_centerX, m_centerY, m_centerZ;
+    std::vector<float> m_extentX, m_extentY, m_extentZ;
+};
+#endif
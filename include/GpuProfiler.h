@@ -0,0 +1,106 @@
+﻿// GpuProfiler.h: 基于时间戳查询的GPU耗时统计
+// 帧内的具名区间在每个预渲染帧自己的查询分段中写入时间戳，该帧的栅栏等待之后读取并在主机端重置，
+// 读取不带WAIT标志，不会让CPU等待GPU；上传与mipmap等帧外的工作从一组一次性查询对中分配，完成后在之后的帧中回收。
+// 每个区间保留最近若干个样本(默认HISTORY_SIZE)，统计最小、平均与p99耗时，退出时可导出为CSV
+
+#ifndef LEARN_VK_GPU_PROFILER
+#define LEARN_VK_GPU_PROFILER
+#include "vulkan/vulkan_core.h"
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// 一个区间的滚动统计，单位为毫秒
+struct GpuScopeStats {
+    std::string name;
+    uint64_t totalSamples; // 运行以来的样本总数
+    size_t windowSamples;  // 参与统计的最近样本数
+    double minMs;
+    double avgMs;
+    double p99Ms;
+    double maxMs;
+};
+
+class GpuProfiler {
+public:
+    const static uint32_t MAX_SCOPES = 16;         // 具名区间数量上限，每个区间在每帧分段中占一对查询
+    const static uint32_t ONE_SHOT_PAIRS = 128;    // 帧外区间可同时在途的查询对数量
+    const static size_t HISTORY_SIZE = 256;        // 每个区间默认保留的样本数
+    const static uint32_t INVALID_QUERY = ~0u;
+
+    GpuProfiler() = default;
+    GpuProfiler(const GpuProfiler&) = delete;
+    GpuProfiler& operator=(const GpuProfiler&) = delete;
+
+    // 设备需要启用Vulkan 1.2的hostQueryReset，图形队列族需要支持时间戳，否则抛出异常；
+    // historySize为每个区间保留的样本数，基准测试中不小于测量的帧数，以便取得每一帧的结果
+    void init(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t graphicsFamily, uint32_t frameCount,
+              size_t historySize = HISTORY_SIZE);
+    void destroy();
+
+    bool enabled() const {
+        return m_queryPool != VK_NULL_HANDLE;
+    }
+    // 队列族是否支持时间戳，不支持的队列上不能写入帧外区间
+    bool supportsFamily(uint32_t family) const;
+
+    // 按名字注册区间，同名返回同一序号；未启用时返回INVALID_QUERY
+    uint32_t scope(const std::string& name);
+
+    // 帧内区间：在frameIndex分段中写入起止时间戳；缓存的指令缓冲重复提交时每次都会产生新的样本。
+    // 渲染流程中使用次级指令缓冲时不能写入时间戳，区间需放在渲染流程之外
+    void beginScope(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t scope);
+    void endScope(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t scope);
+
+    // 帧外区间：在family队列上执行的指令缓冲中写入起始时间戳，返回查询对序号；
+    // 查询对用尽或队列族不支持时返回INVALID_QUERY，endOneShot会忽略它
+    uint32_t beginOneShot(VkCommandBuffer commandBuffer, uint32_t family, uint32_t scope);
+    void endOneShot(VkCommandBuffer commandBuffer, uint32_t query);
+
+    // frameIndex的栅栏等待之后、重新录制或提交之前调用：读取该分段已完成的结果并重置，同时回收已完成的帧外区间
+    void collect(uint32_t frameIndex);
+    // 设备空闲后调用，读取所有分段与帧外区间
+    void collectAll();
+    // 丢弃已有的样本，区间保持注册，用于排除预热帧
+    void resetSamples();
+
+    std::vector<GpuScopeStats> stats() const;
+    // 指定区间的统计，没有样本时返回false
+    bool stats(const std::string& name, GpuScopeStats& result) const;
+    // 指定区间保留的样本，按采集顺序排列，没有样本时返回false
+    bool samples(const std::string& name, std::vector<double>& result) const;
+    void print(std::ostream& out) const;
+    // 写入失败时返回false
+    bool exportCsv(const std::string& path) const;
+
+private:
+    struct Scope {
+        std::string name;
+        std::vector<double> history; // 环形保存最近的样本
+        size_t next = 0;
+        uint64_t total = 0;
+    };
+    struct OneShot {
+        uint32_t query; // 查询对的第一个查询
+        uint32_t scope;
+        uint64_t mask;  // 写入队列族的有效时间戳位
+    };
+
+    void addSample(uint32_t scope, uint64_t begin, uint64_t end, uint64_t mask);
+    void collectOneShots();
+    GpuScopeStats computeStats(const Scope& scope) const;
+
+    VkDevice m_device = VK_NULL_HANDLE;
+    VkQueryPool m_queryPool = VK_NULL_HANDLE;
+    double m_timestampPeriod = 1.0;        // 每个时间戳计数的纳秒数
+    std::vector<uint64_t> m_familyMasks;   // 每个队列族的有效时间戳位，0表示不支持
+    uint32_t m_graphicsFamily = 0;
+    uint32_t m_frameCount = 0;
+    size_t m_historySize = HISTORY_SIZE;
+    uint32_t m_oneShotBase = 0;            // 帧外查询对位于所有帧分段之后
+    std::vector<Scope> m_scopes;
+    std::vector<uint32_t> m_freeOneShots;  // 空闲查询对的第一个查询
+    std::vector<OneShot> m_pendingOneShots;
+};
+#endif
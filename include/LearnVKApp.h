@@ -7,17 +7,34 @@
 #define GLFW_INCLUDE_VULKAN
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
-#define STB_IMAGE_IMPLEMENTATION
-#define TINYOBJLOADER_IMPLEMENTATION
 #define GLM_ENABLE_EXPERIMENTAL
 //#define PRINT_EXTENTION_INFO
 
+#include "AssetStreamer.h"
+#include "DeviceMemoryAllocator.h"
+#include "FrustumCuller.h"
+#include "GpuProfiler.h"
+#include "MeshCache.h"
+#include "MeshData.h"
+#include "MeshOptimizer.h"
+#include "MipGenerator.h"
+#include "ObjParser.h"
+#include "PipelineCache.h"
+#include "StartupProfiler.h"
+#include "TextureFile.h"
+#include "TextureLoader.h"
+#include "ThreadPool.h"
+#include "UniformRing.h"
+#include "UploadContext.h"
+#include "Vertex.h"
+#include "VertexDedup.h"
 #include "tiny_obj_loader.h"
 #include "vulkan/vulkan_core.h"
 #include <GLFW/glfw3.h>
 #include <algorithm>
 #include <array>
 #include <chrono>
+#include <deque>
 #include <filesystem>
 #include <fstream>
 #include <glm/gtc/matrix_transform.hpp>
@@ -34,6 +51,7 @@
 #include <vendor/stb_image.h>
 #include <vulkan/vulkan.h>
 
+#include <cull_comp.h>
 #include <fragment_frag.h>
 #include <vertex_vert.h>
 
@@ -48,54 +66,16 @@ const static std::string RESOURCE_PATH = std::filesystem::current_path()
                                          + "/resource/";
 const static std::string TEXTURE_PATH = RESOURCE_PATH + "textures/";
 const static std::string MODEL_PATH = RESOURCE_PATH + "models/";
-
-struct Vertex {
-    glm::vec3 position;
-    glm::vec3 color;
-    glm::vec2 texCoord;
-
-    static VkVertexInputBindingDescription getBindDescription() {
-        VkVertexInputBindingDescription bindDescription = {};
-        bindDescription.binding = 0;
-        bindDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-        bindDescription.stride = sizeof(Vertex);
-        return bindDescription;
-    }
-    static std::array<VkVertexInputAttributeDescription, 3>
-    getAttributeDescriptions() {
-        std::array<VkVertexInputAttributeDescription, 3> attributeDescription{};
-        attributeDescription[0].binding = 0;
-        attributeDescription[0].location = 0;
-        attributeDescription[0].offset = offsetof(Vertex, position);
-        attributeDescription[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-        attributeDescription[1].binding = 0;
-        attributeDescription[1].location = 1;
-        attributeDescription[1].offset = offsetof(Vertex, color);
-        attributeDescription[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-        attributeDescription[2].binding = 0;
-        attributeDescription[2].location = 2;
-        attributeDescription[2].offset = offsetof(Vertex, texCoord);
-        attributeDescription[2].format = VK_FORMAT_R32G32B32A32_SFLOAT;
-        return attributeDescription;
-    }
-    bool operator==(const Vertex& other) const {
-        return position == other.position && color == other.color && texCoord == other.texCoord;
-    }
-};
-
-namespace std {
-template <>
-struct hash<Vertex> {
-    size_t operator()(Vertex const& vertex) const {
-        return ((hash<glm::vec3>()(vertex.position) ^ (hash<glm::vec3>()(vertex.color) << 1)) >> 1) ^ (hash<glm::vec2>()(vertex.texCoord) << 1);
-    }
-};
-} // namespace std
+const static uint32_t MAX_MATERIAL_TEXTURES = 1024; // 纹理描述符数组的容量上限，实际数量在分配描述符集时指定
+const static uint32_t CULL_GROUP_SIZE = 64;         // 剔除着色器的local_size_x，与cull.comp一致
+const static uint32_t STREAM_THREAD_COUNT = 2;      // 流式加载的工作线程数，嵌套的并行工作仍使用线程池
 
 struct QueueFamiliyIndices {
     std::set<uint32_t> familiesIndexSet;
     int graphicsFamily = -1;
     int presentFamily = -1;
+    int transferFamily = -1; // 优先选择只支持传输的队列族，没有时与图形队列族相同；不计入familiesIndexSet
+    VkExtent3D transferGranularity = {1, 1, 1}; // 传输队列族的minImageTransferGranularity
     bool isComplete() {
         return graphicsFamily >= 0 && presentFamily >= 0;
     }
@@ -117,11 +97,105 @@ struct UniformBufferObject {
     glm::mat4 model;
     glm::mat4 view;
     glm::mat4 proj;
+    glm::vec4 frustumPlanes[6]; // 世界空间的视锥平面，xyz为指向内侧的法线，供剔除着色器使用
+};
+
+// 每个子网格一项，std430布局，与vertex.vert、cull.comp中的定义一致
+struct ObjectData {
+    glm::vec4 boundsMin; // 顶点流所在空间(紧凑顶点下为量化空间)的包围盒
+    glm::vec4 boundsMax;
+    uint32_t indexOffset;
+    uint32_t indexCount;
+    uint32_t materialIndex;
+    uint32_t padding;
+};
+
+// 模型在场景中的一份拷贝，所有子网格共用同一个变换
+struct InstanceData {
+    glm::mat4 transform; // 左乘在ubo.model之前
+};
+
+// 实例化绘制中的一个实例：(实例序号, 子网格序号)，同一次绘制的实例连续存放；
+// 绘制的firstInstance指向这里，顶点着色器用gl_InstanceIndex取出变换与材质
+struct DrawInstance {
+    uint32_t instanceIndex;
+    uint32_t objectIndex;
+};
+
+// CPU剔除后的一次实例化绘制
+struct DrawBatch {
+    uint32_t objectIndex;
+    uint32_t firstInstance; // 在当前帧DrawInstance分段中的起始位置
+    uint32_t instanceCount;
+};
+
+// 剔除着色器的push constant
+struct CullConstants {
+    uint32_t objectCount;
+    uint32_t instanceCount;
+    uint32_t phase; // 0: 逐(实例, 子网格)剔除并累加每个子网格的实例数；1: 逐子网格写入间接绘制参数
+};
+
+// 每个预渲染帧一份的间接绘制缓冲，由剔除着色器写入绘制参数与数量
+struct IndirectDrawBuffers {
+    VkBuffer commands = VK_NULL_HANDLE; // VkDrawIndexedIndirectCommand数组，每个子网格最多一条
+    MemoryAllocation commandsMemory;
+    VkBuffer count = VK_NULL_HANDLE; // 绘制数量，之后是每个子网格的可见实例数，每帧剔除前清零
+    MemoryAllocation countMemory;
+    VkDescriptorSet descriptorSet = VK_NULL_HANDLE; // 剔除管线的set 1
+};
+
+// 材质纹理，在描述符数组中的下标与m_materialTextures中的序号一致
+struct MaterialTexture {
+    VkImage image = VK_NULL_HANDLE;
+    VkImageView view = VK_NULL_HANDLE;
+    MemoryAllocation memory;
+    VkFormat format = VK_FORMAT_R8G8B8A8_SRGB;
+    uint32_t mipLevels = 1;
+};
+
+// 运行时参数，由命令行解析得到
+struct AppConfig {
+    bool headless = false;   // 无窗口离屏渲染，不创建glfw窗口、surface与交换链
+    uint32_t width = 800;    // 渲染分辨率
+    uint32_t height = 600;
+    uint32_t frameCount = 0; // 渲染的帧数，0表示一直渲染直到窗口关闭(离屏模式下默认渲染300帧)
+    uint32_t warmupFrames = 0; // 离屏模式下在计时之前先渲染的帧数，不计入统计
+    uint32_t msaaSamples = 0;  // 多重采样数，0表示设备支持的最大值；渲染流程总是解析多重采样，至少为2
+    bool optimizeMesh = false; // 加载模型后优化索引与顶点顺序
+    bool compactVertex = false; // 使用量化的CompactVertex顶点格式
+    std::string model = "viking_room/viking_room.obj";   // 相对于resource/models
+    std::string texture = "viking_room/viking_room.png"; // 没有漫反射贴图的材质使用的纹理，相对于resource/textures
+    bool cacheCommands = false; // 预先录制每个(交换链图像, 预渲染帧)组合的指令缓冲，场景不变时只更新ubo并提交
+    bool parallelRecord = false; // 在线程池上把绘制录制进次级指令缓冲，与cacheCommands同时指定时不生效
+    bool gpuDriven = false; // 由计算着色器做视锥剔除并写入间接绘制参数，CPU每帧只录制一次vkCmdDrawIndexedIndirectCount
+    uint32_t instanceCount = 1; // 模型在场景中的拷贝数，按网格排列，每个子网格一次实例化绘制
+    bool gpuProfile = false;    // 用时间戳查询统计每帧各阶段与上传批次的GPU耗时，退出时输出
+    std::string gpuProfileCsv;  // 非空时退出时把GPU耗时统计写入该CSV文件，隐含gpuProfile
+    std::string startupCsv;     // 非空时在第一帧之后把启动各阶段的耗时写入该CSV文件
+    bool stream = false;        // 模型与纹理在后台流式加载，先以占位纹理与空场景开始渲染
+    uint32_t streamBudgetMB = 8; // 流式加载每帧上传的数据量上限(MB)，超过上限的网格与纹理分多帧上传
+
+    static AppConfig parseCommandLine(int argc, char** argv);
+};
+
+// 离屏模式下测量阶段的结果，供LearnVKBench读取
+struct FrameTimings {
+    std::string deviceName;
+    uint32_t msaaSamples = 0;
+    std::vector<double> cpuMs; // 每帧drawFrame的耗时，包括等待预渲染帧的栅栏
+    std::vector<double> gpuMs; // 每帧指令缓冲的GPU耗时(frame区间)，未启用gpuProfile时为空
 };
 
 class LearnVKApp {
 public:
+    explicit LearnVKApp(const AppConfig& config = AppConfig());
+
     void run();
+    // 离屏模式下测量帧的逐帧耗时，run()返回后有效
+    const FrameTimings& frameTimings() const {
+        return m_frameTimings;
+    }
 
 private:
     void initVK();
@@ -164,6 +238,8 @@ private:
 
     void createSwapChain();
 
+    void createOffscreenTargets();
+
     void createImageViews();
 
     void createRenderPass();
@@ -171,6 +247,8 @@ private:
     void createDescriptorSetLayout();
 
     void createGraphicsPipeline();
+    // 视锥剔除的计算管线，只在gpuDriven模式下创建
+    void createCullPipeline();
 
     void createFrameBuffers();
 
@@ -186,69 +264,143 @@ private:
 
     void createCommandPool();
 
-    void createTextureImage(const std::string& textureName);
+    // 材质纹理的完整路径，空名字使用AppConfig::texture
+    std::string materialTexturePath(size_t index) const;
+    // 在线程池上解码m_materialTextures中没有烘焙文件的纹理，只使用主机内存，可以在设备创建之前调用；
+    // 结果与m_materialTextures一一对应，有烘焙文件的位置为空
+    std::vector<DecodedImage> decodeMaterialTextures();
+    // 加载m_materialTextures中的所有纹理，烘焙过的直接上传，其余使用decoded中预先解码的像素，
+    // 预先解码时跳过但设备不支持其烘焙格式的纹理在这里补充解码
+    void createTextureImages(std::vector<DecodedImage>& decoded);
+    // 创建纹理图像并录制从暂存缓冲的拷贝与mipmap生成
+    void recordTextureUpload(const TextureInfo& texture, MaterialTexture& target);
+    // 上传烘焙好的纹理，所有层级一次拷贝，不再生成mipmap
+    void uploadCookedTexture(const TextureFile& texture, MaterialTexture& target);
+    // 第0级已拷贝：将整个mip链交给图形队列并录制blit生成其余层级，完成后布局为SHADER_READ_ONLY_OPTIMAL
+    void recordMipmapBlit(MaterialTexture& target, uint32_t width, uint32_t height);
+    bool isSampledFormatSupported(VkFormat format);
+    uint32_t maxMaterialTextures(); // 纹理描述符数组的长度上限，受设备的采样器数量限制
+    bool isLinearBlitSupported(VkFormat format);
 
     void createImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkSampleCountFlagBits numSamples, VkFormat format,
                      VkImageTiling tiling, VkImageUsageFlags usags,
                      VkMemoryPropertyFlags properties, VkImage& image,
-                     VkDeviceMemory& memory);
+                     MemoryAllocation& memory);
 
-    void generateMipmaps(VkImage image, VkFormat imageFormat, uint32_t texWidth, uint32_t texHeight, uint32_t mipLevels);
+    // 以下指令录制进commandBuffer，由调用者决定何时提交
+    void generateMipmaps(VkCommandBuffer commandBuffer, VkImage image, VkFormat imageFormat, uint32_t texWidth, uint32_t texHeight, uint32_t mipLevels);
 
-    void transitionImageLayout(VkImage image, VkFormat format,
+    void transitionImageLayout(VkCommandBuffer commandBuffer, VkImage image, VkFormat format,
                                VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipsLevels);
 
-    void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width,
-                           uint32_t height);
+    void copyBufferToImage(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize bufferOffset,
+                           VkImage image, uint32_t width, uint32_t height);
 
-    void createTextureImageView();
+    void createTextureImageViews();
 
     void createTextureSampler();
 
     VkImageView createImageView(VkImage image, VkFormat format,
                                 VkImageAspectFlags aspectMask, uint32_t mipLevels);
 
-    void loadModel(const std::string& modelName);
+    // 只使用CPU与线程池，不访问渲染用到的成员，可以在工作线程上执行
+    void loadModel(const std::string& modelName, MeshData& mesh);
+    // 按三角形的材质纹理排序索引，划分出子网格并生成材质纹理表
+    void buildSubmeshes(const std::string& modelName, const ObjParser& parser, MeshData& mesh);
+
+    void optimizeMesh(MeshData& mesh);
+    void compactVertices(MeshData& mesh);
+    // 取走子网格、材质纹理表与量化参数作为渲染使用的场景，顶点与索引保留在m_meshData中等待上传
+    void adoptMesh(std::unique_ptr<MeshData> mesh);
+    void createMeshBuffers();
+    // 由子网格与实例生成物体、实例与每帧的DrawInstance缓冲，gpuDriven模式下同时创建每帧的间接绘制缓冲，否则构建CPU剔除的BVH
+    void createObjectBuffers();
+    // 按网格排列的实例变换，第一个实例位于原点附近
+    std::vector<InstanceData> buildInstances();
 
     template <typename T>
     void createLocalBuffer(const std::vector<T>& data, VkBufferUsageFlags usage,
-                           VkBuffer& buffer, VkDeviceMemory& memory);
+                           VkBuffer& buffer, MemoryAllocation& memory);
+
+    void createLocalBuffer(const void* data, VkDeviceSize size, VkBufferUsageFlags usage,
+                           VkBuffer& buffer, MemoryAllocation& memory);
 
     void createUniformBuffers();
 
     void createDescriptorPool();
-
+    // 每个预渲染帧一个描述符集，场景缓冲或纹理改变时在该帧的栅栏之后重写，不会改动GPU正在使用的描述符集
     void createDescriptorSets();
+    // 按当前的缓冲与纹理重写frameIndex的描述符集，未就绪的纹理使用占位纹理
+    void writeDescriptorSet(uint32_t frameIndex);
+    // gpuDriven模式下每个预渲染帧的剔除描述符集(set 1)，间接绘制缓冲创建之后调用
+    void createCullDescriptorSets();
 
     void createCommandBuffers();
+    // 按交换链图像数量重新分配缓存的指令缓冲，全部标记为需要录制
+    void createCachedCommandBuffers();
+    // 场景、管线或帧缓冲改变后调用，缓存的指令缓冲在下次使用时重新录制
+    void invalidateCommandBuffers();
+    // 为并行录制创建每个预渲染帧、每个录制线程的指令池与次级指令缓冲
+    void createRecordPools();
+    void printCommandStats(uint32_t frameCount);
+    // 重建图形管线，用于流式加载的模型与创建管线时假定的紧凑顶点纹理坐标格式不一致的情况
+    void rebuildGraphicsPipeline();
+
+    // 流式加载：创建占位纹理，启动工作线程并请求模型
+    void createPlaceholderTexture();
+    void startStreaming();
+    // 每帧在栅栏之后调用：取走加载完成的资源，在预算内录制上传并提交，上传完成的资源替换占位
+    void updateStreaming();
+    // 模型加载完成：接管场景数据、创建顶点与索引缓冲并请求材质纹理
+    void beginStreamedMesh(std::unique_ptr<MeshData> mesh);
+    // 纹理按mip层级与行分段上传：第一段之前创建图像，每帧在预算内录制若干段，最后一段之后转移所有权并生成mipmap
+    void beginStreamedTexture(const StreamedAsset& asset);
+    // 在budget内录制下一段或几段拷贝，返回占用的暂存字节数，剩余预算放不下一行时返回0
+    VkDeviceSize uploadStreamedTexture(const StreamedAsset& asset, VkDeviceSize budget, bool forceProgress);
+    void finishStreamedTexture(const StreamedAsset& asset);
+    void printStreamStats(uint32_t frameCount);
+    // 设备空闲后读取剩余的时间戳结果，输出GPU耗时统计并按需导出CSV
+    void reportGpuProfile();
+    // 第一帧完成后调用一次，输出启动各阶段的时间线与首帧时间并按需导出CSV
+    void reportStartup();
 
     void createSyncObjects();
 
-    void recordCommandBuffers(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+    void recordCommandBuffers(VkCommandBuffer commandBuffer, uint32_t imageIndex, uint32_t uboOffset);
+    // 录制m_drawBatches中[firstDraw, lastDraw)的绘制以及它们需要的全部状态，主、次级指令缓冲共用
+    void recordDraws(VkCommandBuffer commandBuffer, uint32_t uboOffset, size_t firstDraw, size_t lastDraw);
+    // 在渲染流程开始之前录制计数清零、剔除分派以及到间接绘制的屏障
+    void recordCulling(VkCommandBuffer commandBuffer, uint32_t uboOffset);
 
     VkShaderModule createShaderModule(const std::vector<unsigned char>& code);
 
-    uint32_t findMemoryType(uint32_t typeFilter,
-                            VkMemoryPropertyFlags properties);
-
     void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
                       VkMemoryPropertyFlags properties, VkBuffer& buffer,
-                      VkDeviceMemory& memory);
-
-    void copyBuffer(VkBuffer& srcBuffer, VkBuffer& dstBuffer, VkDeviceSize size);
-
-    VkCommandBuffer beginSingleTimeCommand();
-
-    void endSingleTimeCommand(VkCommandBuffer& commandBuffer);
+                      MemoryAllocation& memory);
 
     void initWindows();
 
     void loop();
 
-    void updateUniformBuffers(uint32_t imageIndex);
+    void headlessLoop();
+    // 离屏模式下计时的帧数
+    uint32_t headlessFrameCount() const;
+
+    // 在当前帧的uniform环形缓冲分段中写入ubo，返回其动态偏移
+    uint32_t updateUniformBuffers();
+    // 场景的模型矩阵，包含紧凑顶点的还原变换
+    glm::mat4 modelMatrix() const;
+    // 用BVH剔除(实例, 子网格)并按子网格分组为实例化绘制，写入当前帧的DrawInstance分段；
+    // 可见集合改变时缓存的指令缓冲失效
+    void cullObjects(const glm::vec4 planes[6]);
+    // 当前帧DrawInstance分段的动态偏移
+    uint32_t drawInstanceOffset() const;
 
     void drawFrame();
 
+    // 销毁与交换链尺寸相关的图像视图、深度与多重采样图像以及帧缓冲
+    void cleanupSwapChainTargets();
+
     void cleanupSwapChain();
 
     void recreateSwapChain();
@@ -259,11 +411,13 @@ private:
 
     VkSampleCountFlagBits getMaxUsableSampleCount();
 
+    AppConfig m_config;
+
     GLFWwindow* m_window = nullptr;
 
     static bool s_framebufferResized;
 
-    VkSurfaceKHR m_surface;
+    VkSurfaceKHR m_surface = VK_NULL_HANDLE;
 
     VkInstance m_vkInstance;
 
@@ -276,12 +430,15 @@ private:
 
     // 一台逻辑设备
     VkDevice m_device = VK_NULL_HANDLE;
+    // 所有缓冲与图像的设备内存都从这里子分配
+    DeviceMemoryAllocator m_allocator;
 
     // 交换链
     VkSwapchainKHR m_swapChain = VK_NULL_HANDLE;
 
-    // 交换链中的图像句柄，我们操作其来渲染
+    // 交换链中的图像句柄，我们操作其来渲染；离屏模式下为应用自己创建的图像
     std::vector<VkImage> m_swapChainImages;
+    std::vector<MemoryAllocation> m_offscreenImageMemories;
     VkFormat m_swapChainImageFormat;
     VkExtent2D m_swapChainImageExtent;
 
@@ -294,17 +451,48 @@ private:
     VkRenderPass m_renderPass;
     VkPipelineLayout m_pipelineLayout;
     VkPipeline m_graphicsPipeline;
+    // 所有管线共用的缓存，启动时从磁盘加载，退出时写回
+    PipelineCache m_pipelineCache;
     // 描述符集和描述符池
     VkDescriptorSetLayout m_descriptorSetLayout;
     VkDescriptorPool m_descriptorPool;
+    // 下标为预渲染帧序号，ubo与DrawInstance在帧内通过动态偏移定位
     std::vector<VkDescriptorSet> m_descriptorSets;
+    uint32_t m_textureDescriptorCount = 0;           // 纹理数组的实际长度，流式加载时为容量上限
+    uint32_t m_descriptorVersion = 0;                // 描述符引用的缓冲或纹理改变时递增
+    std::vector<uint32_t> m_descriptorSetVersions;   // 每个描述符集最后一次写入时的版本
+    // 视锥剔除的计算管线，set 0与图形管线共用当前帧的描述符集，set 1为当前帧的间接绘制缓冲
+    VkDescriptorSetLayout m_cullDescriptorSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout m_cullPipelineLayout = VK_NULL_HANDLE;
+    VkPipeline m_cullPipeline = VK_NULL_HANDLE;
     // 队列族对应的指令队列
     std::map<std::string, VkQueue> m_queueMap;
 
     // 指令池
     VkCommandPool m_commandPool;
+    // 初始化与资源加载的上传批次
+    UploadContext m_uploadContext;
+    // GPU耗时统计，未指定gpuProfile时不创建查询池，以下区间序号为INVALID_QUERY
+    GpuProfiler m_gpuProfiler;
+    uint32_t m_frameScope = GpuProfiler::INVALID_QUERY;      // 整个帧指令缓冲
+    uint32_t m_cullScope = GpuProfiler::INVALID_QUERY;       // gpuDriven模式的剔除分派
+    uint32_t m_renderPassScope = GpuProfiler::INVALID_QUERY; // 渲染流程
+    uint32_t m_mipScope = GpuProfiler::INVALID_QUERY;        // blit生成mipmap
     // 指令缓冲
     std::vector<VkCommandBuffer> m_commandBuffers;
+    // 缓存的指令缓冲，下标为imageIndex * MAX_FRAMES_IN_FLIGHT + 预渲染帧序号；
+    // 每个预渲染帧的ubo动态偏移不同，同一组合只在上一次使用它的帧的栅栏等待之后才会再次提交
+    std::vector<VkCommandBuffer> m_cachedCommandBuffers;
+    std::vector<uint32_t> m_cachedUboOffsets;
+    std::vector<bool> m_cachedCommandValid;
+    uint64_t m_commandRecordCount = 0; // recordCommandBuffers的调用次数
+    double m_commandRecordMs = 0.0;    // recordCommandBuffers的累计耗时
+    FrameTimings m_frameTimings;
+    // 并行录制的指令池，下标为预渲染帧序号 * m_recordSlotCount + 录制槽；
+    // 每个槽在一帧内只由一个任务使用，满足指令池的外部同步要求
+    std::vector<VkCommandPool> m_recordPools;
+    std::vector<VkCommandBuffer> m_secondaryCommandBuffers;
+    uint32_t m_recordSlotCount = 0;
     // 信号量
     std::vector<VkSemaphore> m_imageAvailableSemaphore;
     std::vector<VkSemaphore> m_renderFinishSemaphore;
@@ -313,66 +501,97 @@ private:
     int m_currentFrameIndex = 0;
 
     // 顶点缓冲
-    VkBuffer m_vertexBuffer;
-    VkDeviceMemory m_vertexBufferMemory;
+    VkBuffer m_vertexBuffer = VK_NULL_HANDLE;
+    MemoryAllocation m_vertexBufferMemory;
     // 索引缓存
-    VkBuffer m_indexBuffer;
-    VkDeviceMemory m_indexBufferMemory;
-    // ubo缓存，每一个交换链一个
-    std::vector<VkBuffer> m_uboBuffers;
-    std::vector<VkDeviceMemory> m_uboBufferMemories;
-
-    // 图片纹理
-    VkImage m_textureImage;
-    VkImageView m_textureImageView;
-    VkDeviceMemory m_textureImageMemory;
+    VkBuffer m_indexBuffer = VK_NULL_HANDLE;
+    MemoryAllocation m_indexBufferMemory;
+    // ubo环形缓冲，每个预渲染帧一个分段
+    UniformRing m_uniformRing;
+    // 物体缓冲，每个子网格一个ObjectData，顶点着色器与剔除着色器共用
+    VkBuffer m_objectBuffer = VK_NULL_HANDLE;
+    MemoryAllocation m_objectBufferMemory;
+    uint32_t m_objectCount = 0;
+    // 实例缓冲，每个实例一个InstanceData
+    VkBuffer m_instanceBuffer = VK_NULL_HANDLE;
+    MemoryAllocation m_instanceBufferMemory;
+    uint32_t m_instanceCount = 0;
+    // DrawInstance缓冲，每个预渲染帧一个按minStorageBufferOffsetAlignment对齐的分段，通过动态偏移访问；
+    // gpuDriven模式下由剔除着色器写入(设备本地)，否则由CPU剔除后写入(主机可见)
+    VkBuffer m_drawInstanceBuffer = VK_NULL_HANDLE;
+    MemoryAllocation m_drawInstanceMemory;
+    VkDeviceSize m_drawInstanceStride = 0;
+    std::vector<IndirectDrawBuffers> m_indirectDraws; // 下标为预渲染帧序号
+    // CPU剔除，(实例, 子网格)的世界空间包围盒在加载时构建BVH，序号为instance * m_objectCount + object；
+    // gpuDriven模式下不使用
+    FrustumCuller m_frustumCuller;
+    std::vector<uint32_t> m_visibleObjects; // 上一次剔除的可见序号
+    std::vector<uint32_t> m_cullResult;     // 剔除的输出，与m_visibleObjects比较后交换，避免每帧分配
+    std::vector<DrawBatch> m_drawBatches;   // 本帧录制的实例化绘制
+    std::vector<DrawInstance> m_drawInstances; // 与m_drawBatches对应，每帧拷贝到当前帧的分段
+    uint64_t m_cullCount = 0;
+    double m_cullMs = 0.0;
+
+    // 图片纹理，所有材质的纹理放在同一个描述符数组中，共用一个采样器
+    std::vector<MaterialTexture> m_textures;
+    std::vector<bool> m_textureResident; // 下标为材质序号，上传完成后为true，之前描述符指向占位纹理
     VkSampler m_textureSampler;
-    uint32_t m_mipLevels;
+    bool m_textureCompressionBC = false; // 设备支持并启用了BC块压缩格式
 
     // 深度缓冲
     VkImage m_depthImage;
     VkImageView m_depthImageView;
-    VkDeviceMemory m_depthImageMemory;
+    MemoryAllocation m_depthImageMemory;
 
     // 多重采样离屏渲染的缓冲
     VkImage m_colorImage;
     VkImageView m_colorImageView;
-    VkDeviceMemory m_colorImageMemory;
-
-    std::vector<Vertex> g_vertices;
-    std::vector<uint32_t> g_indices;
+    MemoryAllocation m_colorImageMemory;
+
+    // 已加载、尚未上传的顶点与索引，上传后释放
+    std::unique_ptr<MeshData> m_meshData;
+    bool m_halfTexCoord = false;                   // CompactVertex的纹理坐标格式
+    glm::mat4 m_positionDequantize = glm::mat4(1.0f); // 将量化的位置还原到包围盒，在模型矩阵中左乘
+    // 按材质纹理排序的子网格，每个子网格一次绘制，整个场景只绑定一次管线与描述符集
+    std::vector<Submesh> m_submeshes;
+    std::vector<std::string> m_materialTextures; // 相对于resource/textures，空字符串表示使用AppConfig::texture
+
+    // 场景的网格、物体与实例缓冲都已上传，之前只清屏不绘制
+    bool m_sceneReady = false;
+
+    // 用于模型加载等可并行的cpu任务
+    ThreadPool m_threadPool;
+
+    // 流式加载
+    struct StreamUpload {
+        UploadTicket ticket;
+        AssetType type;
+        uint32_t slot; // 纹理的材质序号
+    };
+    AssetStreamer m_assetStreamer;
+    MaterialTexture m_placeholderTexture;    // 1x1的灰色纹理，材质纹理就绪之前代替它们
+    std::deque<StreamedAsset> m_streamQueue; // 已加载、等待上传的纹理，按每帧的预算依次上传
+    // 队首纹理各层级相对于像素数据起始的位置，为空时尚未开始上传
+    std::vector<TextureFileLevel> m_textureUploadLevels;
+    uint32_t m_textureUploadLevel = 0; // 队首纹理正在上传的层级
+    uint32_t m_textureUploadRow = 0;   // 该层级已录制的行数，块压缩格式按块行计
+    std::vector<StreamUpload> m_streamUploads; // 已提交、等待完成的上传
+    bool m_streamingMesh = false;             // 顶点与索引正在分段上传
+    VkDeviceSize m_meshUploadOffset = 0;      // 已录制的顶点与索引字节数，顶点在前、索引在后
+    uint64_t m_streamedBytes = 0;
+    VkDeviceSize m_streamMaxFrameBytes = 0;   // 单帧上传的最大字节数
+    uint32_t m_streamUploadFrames = 0;        // 有上传的帧数
+    // 启动阶段耗时，起点为应用构造
+    StartupProfiler m_startupProfiler;
+    bool m_startupReported = false;
 
     std::vector<const char*> m_validationLayers{"VK_LAYER_KHRONOS_validation"};
     std::vector<const char*> m_deviceExtentions{VK_KHR_SWAPCHAIN_EXTENSION_NAME};
 
-    const uint32_t WINDOW_WIDTH = 800;
-    const uint32_t WINDOW_HEIGHT = 600;
-
 #ifdef NDEBUG
     const bool enableValidationLayers = false;
 #else
     const bool enableValidationLayers = true;
 #endif
 };
-static bool hasStencilComponent(VkFormat format) {
-    return (format == VK_FORMAT_D24_UNORM_S8_UINT) || (format == VK_FORMAT_D32_SFLOAT_S8_UINT);
-}
-
-static VkSurfaceFormatKHR
-chooseBestfitSurfaceFormat(std::vector<VkSurfaceFormatKHR>& formats);
-
-static VkPresentModeKHR
-chooseBestfitPresentMode(std::vector<VkPresentModeKHR>& presentModes);
-
-static VkResult createDebugUtilsMessengerEXT(
-    VkInstance instance, const VkDebugUtilsMessengerCreateInfoEXT* pCreateInfo,
-    const VkAllocationCallbacks* pAllocator,
-    VkDebugUtilsMessengerEXT* pCallback);
-
-static void
-destroyDebugUtilsMessengerEXT(VkInstance instance,
-                              VkDebugUtilsMessengerEXT* pCallback,
-                              const VkAllocationCallbacks* pAllocator);
-
-static std::vector<char> readFile(const std::string& filename);
 #endif
\ No newline at end of file
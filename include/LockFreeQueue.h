@@ -0,0 +1,85 @@
+﻿// LockFreeQueue.h: 有界的多生产者多消费者无锁队列
+// 每个槽位带一个序号，生产者与消费者各自通过CAS领取位置，序号表明槽位是否已写入或已取走；
+// 容量必须是2的幂，满时push返回false，空时pop返回false，不会阻塞
+
+#ifndef LEARN_VK_LOCK_FREE_QUEUE
+#define LEARN_VK_LOCK_FREE_QUEUE
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+template <typename T>
+class LockFreeQueue {
+public:
+    explicit LockFreeQueue(size_t capacity) : m_cells(new Cell[capacity]), m_mask(capacity - 1) {
+        if (capacity < 2 || (capacity & (capacity - 1)) != 0) {
+            throw std::invalid_argument("lock free queue capacity must be a power of two!");
+        }
+        for (size_t i = 0; i < capacity; i++) {
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+    LockFreeQueue(const LockFreeQueue&) = delete;
+    LockFreeQueue& operator=(const LockFreeQueue&) = delete;
+
+    bool push(T&& value) {
+        size_t position = m_enqueuePosition.load(std::memory_order_relaxed);
+        Cell* cell;
+        while (true) {
+            cell = &m_cells[position & m_mask];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+            if (diff == 0) { // 槽位空闲，领取这个位置
+                if (m_enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) { // 槽位中的元素还没有被取走，队列已满
+                return false;
+            } else { // 其他生产者已经领取，重新读取位置
+                position = m_enqueuePosition.load(std::memory_order_relaxed);
+            }
+        }
+        cell->value = std::move(value);
+        cell->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& value) {
+        size_t position = m_dequeuePosition.load(std::memory_order_relaxed);
+        Cell* cell;
+        while (true) {
+            cell = &m_cells[position & m_mask];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position + 1);
+            if (diff == 0) { // 槽位已写入，领取这个位置
+                if (m_dequeuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) { // 还没有写入，队列为空
+                return false;
+            } else {
+                position = m_dequeuePosition.load(std::memory_order_relaxed);
+            }
+        }
+        value = std::move(cell->value);
+        cell->value = T(); // 尽早释放元素持有的资源
+        cell->sequence.store(position + m_mask + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Cell[]> m_cells;
+    const size_t m_mask;
+    // 生产者与消费者的位置放在不同的缓存行，避免相互争用
+    alignas(64) std::atomic<size_t> m_enqueuePosition{0};
+    alignas(64) std::atomic<size_t> m_dequeuePosition{0};
+};
+#endif
@@ -0,0 +1,43 @@
+﻿// MappedFile.h: 只读的内存映射文件，用于零拷贝地读取网格缓存与模型文件
+
+#ifndef LEARN_VK_MAPPED_FILE
+#define LEARN_VK_MAPPED_FILE
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // 映射整个文件，文件不存在或映射失败时返回false
+    bool open(const std::string& path);
+
+    void close();
+
+    // 把[offset, offset + size)提前读进内存并逐页访问，之后读取这段数据不会再因缺页而同步读盘，
+    // 用于在工作线程上承担IO，避免渲染线程拷贝时阻塞
+    void prefault(size_t offset, size_t size) const;
+
+    bool isOpen() const {
+        return m_data != nullptr;
+    }
+    const uint8_t* data() const {
+        return m_data;
+    }
+    size_t size() const {
+        return m_size;
+    }
+
+private:
+    const uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+#ifdef _WIN32
+    void* m_fileHandle = nullptr;
+    void* m_mappingHandle = nullptr;
+#endif
+};
+#endif
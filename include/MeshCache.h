@@ -0,0 +1,119 @@
+﻿// MeshCache.h: 烘焙后的二进制网格缓存
+// 保存去重后的顶点流、索引流、按材质划分的子网格以及包围盒，加载时通过内存映射直接拷贝进暂存缓冲，跳过obj解析
+
+#ifndef LEARN_VK_MESH_CACHE
+#define LEARN_VK_MESH_CACHE
+#include "MappedFile.h"
+#include <cstdint>
+#include <glm/vec3.hpp>
+#include <string>
+#include <vector>
+
+const static uint32_t MESH_CACHE_MAGIC = 0x4d4b564c; // "LVKM"
+const static uint32_t MESH_CACHE_VERSION = 4;        // 修改文件布局或顶点格式时递增，旧缓存会被重新烘焙
+
+// 缓存的处理方式，与请求的不一致时重新烘焙
+const static uint32_t MESH_CACHE_FLAG_OPTIMIZED = 1 << 0; // 经过顶点缓存、overdraw与顶点读取顺序优化
+const static uint32_t MESH_CACHE_FLAG_COMPACT = 1 << 1;   // 顶点为CompactVertex格式
+// 描述缓存内容的标记，由烘焙时的数据决定，打开缓存时不参与比较
+const static uint32_t MESH_CACHE_FLAG_HALF_TEXCOORD = 1 << 16; // CompactVertex的纹理坐标为half
+const static uint32_t MESH_CACHE_CONTENT_FLAGS = MESH_CACHE_FLAG_HALF_TEXCOORD;
+
+struct MeshBounds {
+    glm::vec3 min;
+    glm::vec3 max;
+};
+
+// 使用同一材质纹理的一段连续索引，对应一次绘制
+struct Submesh {
+    uint32_t indexOffset;
+    uint32_t indexCount;
+    uint32_t materialIndex; // 材质纹理表中的序号，也是纹理描述符数组中的下标
+    float boundsMin[3];     // 子网格顶点在模型空间的包围盒，用于视锥剔除
+    float boundsMax[3];
+};
+
+// 文件头，之后依次是顶点流、索引流、子网格表与材质纹理名(以'\0'分隔)，偏移量均相对于文件起始
+struct MeshCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vertexStride;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t flags;
+    uint64_t sourceSize;      // 源模型文件的大小与修改时间，任意一个改变都视为缓存过期
+    int64_t sourceWriteTime;
+    float boundsMin[3];
+    float boundsMax[3];
+    uint64_t vertexOffset;
+    uint64_t indexOffset;
+    uint32_t submeshCount;
+    uint32_t materialCount;
+    uint64_t submeshOffset;
+    uint64_t materialOffset;
+    uint64_t materialSize;
+};
+
+class MeshCache {
+public:
+    // 模型对应的缓存文件路径，与模型放在同一目录下
+    static std::string cachePath(const std::string& modelPath);
+
+    // 映射缓存并校验版本、顶点格式与源文件是否匹配，不匹配时返回false
+    bool open(const std::string& modelPath, uint32_t vertexStride, uint32_t flags);
+
+    // 将网格写入缓存，先写临时文件再替换，避免中断时留下损坏的缓存
+    static bool write(const std::string& modelPath, uint32_t vertexStride, uint32_t flags,
+                      const void* vertices, uint32_t vertexCount,
+                      const uint32_t* indices, uint32_t indexCount,
+                      const std::vector<Submesh>& submeshes, const std::vector<std::string>& materialTextures,
+                      const MeshBounds& bounds);
+
+    void close() {
+        m_file.close();
+        m_header = nullptr;
+    }
+    bool isOpen() const {
+        return m_header != nullptr;
+    }
+    const void* vertexData() const {
+        return m_file.data() + m_header->vertexOffset;
+    }
+    uint64_t vertexDataSize() const {
+        return static_cast<uint64_t>(m_header->vertexStride) * m_header->vertexCount;
+    }
+    const uint32_t* indexData() const {
+        return reinterpret_cast<const uint32_t*>(m_file.data() + m_header->indexOffset);
+    }
+    uint64_t indexDataSize() const {
+        return sizeof(uint32_t) * static_cast<uint64_t>(m_header->indexCount);
+    }
+    // 把顶点流与索引流读进内存
+    void prefault() const {
+        m_file.prefault(static_cast<size_t>(m_header->vertexOffset), static_cast<size_t>(vertexDataSize()));
+        m_file.prefault(static_cast<size_t>(m_header->indexOffset), static_cast<size_t>(indexDataSize()));
+    }
+    uint32_t vertexCount() const {
+        return m_header->vertexCount;
+    }
+    uint32_t indexCount() const {
+        return m_header->indexCount;
+    }
+    uint32_t flags() const {
+        return m_header->flags;
+    }
+    std::vector<Submesh> submeshes() const {
+        auto begin = reinterpret_cast<const Submesh*>(m_file.data() + m_header->submeshOffset);
+        return std::vector<Submesh>(begin, begin + m_header->submeshCount);
+    }
+    std::vector<std::string> materialTextures() const;
+    MeshBounds bounds() const {
+        return {glm::vec3(m_header->boundsMin[0], m_header->boundsMin[1], m_header->boundsMin[2]),
+                glm::vec3(m_header->boundsMax[0], m_header->boundsMax[1], m_header->boundsMax[2])};
+    }
+
+private:
+    MappedFile m_file;
+    const MeshCacheHeader* m_header = nullptr;
+};
+#endif
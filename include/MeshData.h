@@ -0,0 +1,47 @@
+﻿// MeshData.h: 加载到主机内存的模型
+// 解析、去重、优化与量化的结果，不依赖设备，可以在工作线程上生成后整体交给渲染线程，顶点与索引上传之后释放
+
+#ifndef LEARN_VK_MESH_DATA
+#define LEARN_VK_MESH_DATA
+#include "MeshCache.h"
+#include "Vertex.h"
+#include <cstdint>
+#include <glm/mat4x4.hpp>
+#include <string>
+#include <vector>
+
+struct MeshData {
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+    std::vector<CompactVertex> compactVertices;
+    bool halfTexCoord = false;                      // CompactVertex的纹理坐标格式
+    glm::mat4 positionDequantize = glm::mat4(1.0f); // 将量化的位置还原到包围盒，在模型矩阵中左乘
+    uint32_t indexCount = 0;
+    // 按材质纹理排序的子网格，每个子网格一次绘制
+    std::vector<Submesh> submeshes;
+    std::vector<std::string> materialTextures; // 相对于resource/textures，空字符串表示使用AppConfig::texture
+    MeshBounds bounds;
+    // 命中网格缓存时保持映射，顶点与索引直接从映射的文件上传
+    MeshCache cache;
+
+    // 上传使用的顶点与索引数据，命中缓存时指向映射的文件
+    const void* vertexData() const {
+        if (cache.isOpen()) {
+            return cache.vertexData();
+        }
+        return compactVertices.empty() ? static_cast<const void*>(vertices.data()) : compactVertices.data();
+    }
+    uint64_t vertexDataSize() const {
+        if (cache.isOpen()) {
+            return cache.vertexDataSize();
+        }
+        return compactVertices.empty() ? sizeof(Vertex) * vertices.size() : sizeof(CompactVertex) * compactVertices.size();
+    }
+    const uint32_t* indexData() const {
+        return cache.isOpen() ? cache.indexData() : indices.data();
+    }
+    uint64_t indexDataSize() const {
+        return sizeof(uint32_t) * static_cast<uint64_t>(indexCount);
+    }
+};
+#endif
@@ -0,0 +1,35 @@
+﻿// MeshOptimizer.h: 索引缓冲的顶点缓存、overdraw与顶点读取顺序优化
+// 三角形先按Tipsify排序提高post-transform顶点缓存命中率，再以簇为单位按朝外程度排序减少overdraw，最后按首次使用的顺序重排顶点
+
+#ifndef LEARN_VK_MESH_OPTIMIZER
+#define LEARN_VK_MESH_OPTIMIZER
+#include "Vertex.h"
+#include <cstdint>
+#include <vector>
+
+// 用FIFO缓存模拟得到的统计量
+struct VertexCacheStats {
+    float acmr; // 平均每个三角形的缓存未命中次数，理想值接近0.5
+    float atvr; // 平均每个顶点被变换的次数，理想值为1
+};
+
+class MeshOptimizer {
+public:
+    const static uint32_t DEFAULT_CACHE_SIZE = 16;
+
+    static VertexCacheStats analyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount,
+                                               uint32_t cacheSize = DEFAULT_CACHE_SIZE);
+
+    // Tipsify: Sander et al. 2007, "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw"
+    static void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount,
+                                    uint32_t cacheSize = DEFAULT_CACHE_SIZE);
+
+    // 将缓存优化后的三角形切分成簇，簇内顺序不变，簇之间按朝外程度从大到小排序
+    // threshold为簇内允许的ACMR相对整体的比例，越大簇越小、overdraw越少，但缓存命中率下降
+    static void optimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices,
+                                 float threshold = 1.05f, uint32_t cacheSize = DEFAULT_CACHE_SIZE);
+
+    // 按索引中首次出现的顺序重排顶点，同时丢弃未被引用的顶点
+    static void optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+};
+#endif
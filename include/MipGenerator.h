@@ -0,0 +1,32 @@
+﻿// MipGenerator.h: CPU上的mip链生成
+// 第0级先转换为16位线性值(sRGB通道查表解码)，之后每一级都在16位线性空间中做2x2盒式过滤，输出时再编码回RGBA8；
+// 行内过滤按编译目标使用AVX2/SSE2/NEON，层级内按行分块并行，用于设备不支持线性blit时的回退以及离线烘焙
+
+#ifndef LEARN_VK_MIP_GENERATOR
+#define LEARN_VK_MIP_GENERATOR
+#include "ThreadPool.h"
+#include <cstdint>
+#include <vector>
+
+class MipGenerator {
+public:
+    explicit MipGenerator(ThreadPool& threadPool);
+
+    // 包含第0级在内的完整mip链层级数
+    static uint32_t mipLevelCount(uint32_t width, uint32_t height);
+    // 所有层级的RGBA8数据连续存放(每级16字节对齐)时各级的偏移，返回总大小
+    static uint64_t levelOffsets(uint32_t width, uint32_t height, std::vector<uint64_t>& offsets);
+    // 编译进来的行过滤实现
+    static const char* simdPath();
+
+    // 由RGBA8的第0级生成完整mip链，按levelOffsets的布局写入output(可以是映射的暂存内存)，
+    // rgba与output起始相同时不再拷贝第0级；srgb为true时RGB通道按sRGB编码处理，alpha始终为线性
+    void generate(const uint8_t* rgba, uint32_t width, uint32_t height, bool srgb, uint8_t* output);
+
+    // 标量参考实现：逐级在float中过滤并使用精确的sRGB转换，用于校验generate的结果
+    static void generateReference(const uint8_t* rgba, uint32_t width, uint32_t height, bool srgb, uint8_t* output);
+
+private:
+    ThreadPool& m_threadPool;
+};
+#endif
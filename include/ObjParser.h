@@ -0,0 +1,68 @@
+﻿// ObjParser.h: 基于内存映射的并行obj解析器
+// 文件按行对齐切分为多个块，先并行统计各块的元素数量，再按前缀和并行写入预先分配好的数组，峰值内存只有最终数据本身
+
+#ifndef LEARN_VK_OBJ_PARSER
+#define LEARN_VK_OBJ_PARSER
+#include "MappedFile.h"
+#include "ThreadPool.h"
+#include "VertexDedup.h"
+#include "tiny_obj_loader.h"
+#include <map>
+#include <string>
+#include <vector>
+
+// obj中由o/g划分的一组连续三角形
+struct ObjShape {
+    std::string name;
+    size_t indexOffset;
+    size_t indexCount;
+};
+
+class ObjParser {
+public:
+    explicit ObjParser(ThreadPool& threadPool) :
+        m_threadPool(threadPool) {}
+
+    // 解析obj及其引用的mtl文件，多边形按扇形三角化；失败时抛出异常
+    void parse(const std::string& path);
+
+    // 顶点属性与tinyobj的布局一致，可直接交给VertexDeduplicator
+    const tinyobj::attrib_t& attrib() const {
+        return m_attrib;
+    }
+    const std::vector<tinyobj::index_t>& indices() const {
+        return m_indices;
+    }
+    // 每个三角形的材质序号，没有材质时为-1
+    const std::vector<int>& materialIds() const {
+        return m_materialIds;
+    }
+    const std::vector<tinyobj::material_t>& materials() const {
+        return m_materials;
+    }
+    const std::vector<ObjShape>& shapes() const {
+        return m_shapes;
+    }
+    std::vector<IndexRange> indexRanges() const;
+    // 最近一次解析的obj文件大小，用于统计吞吐
+    size_t fileSize() const {
+        return m_fileSize;
+    }
+
+private:
+    struct ChunkEvent;
+    struct Chunk;
+
+    void splitChunks(const MappedFile& file, std::vector<Chunk>& chunks) const;
+    void loadMaterials(const std::string& path, const std::vector<std::string>& materialLibs);
+
+    ThreadPool& m_threadPool;
+    tinyobj::attrib_t m_attrib;
+    std::vector<tinyobj::index_t> m_indices;
+    std::vector<int> m_materialIds;
+    std::vector<tinyobj::material_t> m_materials;
+    std::map<std::string, int> m_materialMap;
+    std::vector<ObjShape> m_shapes;
+    size_t m_fileSize = 0;
+};
+#endif
@@ -0,0 +1,45 @@
+﻿// PipelineCache.h: 持久化到磁盘的管线缓存
+// 启动时读取上次退出时保存的VkPipelineCache数据，校验头部的厂商ID、设备ID与pipelineCacheUUID，
+// 不匹配(换了显卡或驱动)时丢弃并创建空缓存；所有管线的创建共用这个缓存，退出时先写临时文件再替换
+
+#ifndef LEARN_VK_PIPELINE_CACHE
+#define LEARN_VK_PIPELINE_CACHE
+#include "vulkan/vulkan_core.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class PipelineCache {
+public:
+    PipelineCache() = default;
+    PipelineCache(const PipelineCache&) = delete;
+    PipelineCache& operator=(const PipelineCache&) = delete;
+
+    // 缓存文件的默认路径，放在工作目录下
+    static std::string defaultPath();
+
+    // 读取path中的缓存数据并创建VkPipelineCache，文件不存在或与设备不匹配时创建空缓存
+    void init(VkPhysicalDevice physicalDevice, VkDevice device, const std::string& path);
+    // 取出当前缓存数据写回磁盘，写入失败时返回false，不影响本次运行
+    bool save();
+    void destroy();
+
+    VkPipelineCache handle() const {
+        return m_cache;
+    }
+    // 是否从磁盘加载了有效的缓存数据
+    bool isWarm() const {
+        return m_warm;
+    }
+
+private:
+    // 检查数据头是否由当前设备与驱动生成
+    bool isCompatible(const std::vector<char>& data) const;
+
+    VkDevice m_device = VK_NULL_HANDLE;
+    VkPipelineCache m_cache = VK_NULL_HANDLE;
+    VkPhysicalDeviceProperties m_properties = {};
+    std::string m_path;
+    bool m_warm = false;
+};
+#endif
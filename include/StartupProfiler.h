@@ -0,0 +1,56 @@
+﻿// StartupProfiler.h: 启动阶段的CPU耗时统计
+// 记录初始化各阶段相对起点的开始与结束时间以及所在线程(主线程或工作线程)，可以从多个线程同时记录，
+// 按开始时间打印成时间线并可导出为CSV，用于观察后台加载与主线程的Vulkan对象创建是否真正重叠
+
+#ifndef LEARN_VK_STARTUP_PROFILER
+#define LEARN_VK_STARTUP_PROFILER
+#include <chrono>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// 一个启动阶段，时间单位为毫秒，相对于起点
+struct StartupPhase {
+    std::string name;
+    bool mainThread;
+    double startMs;
+    double endMs;
+};
+
+class StartupProfiler {
+public:
+    using Clock = std::chrono::high_resolution_clock;
+
+    // 起点为构造时刻，构造所在的线程视为主线程
+    StartupProfiler();
+    StartupProfiler(const StartupProfiler&) = delete;
+    StartupProfiler& operator=(const StartupProfiler&) = delete;
+
+    // 执行body并记录为一个阶段，body抛出异常时不记录
+    template <typename F>
+    void measure(const std::string& name, F&& body) {
+        Clock::time_point start = Clock::now();
+        body();
+        record(name, start, Clock::now());
+    }
+    void record(const std::string& name, Clock::time_point start, Clock::time_point end);
+    // 记录一个时长为0的时间点，例如第一帧提交完成
+    void mark(const std::string& name);
+    // 从起点到现在经过的时间
+    double elapsedMs() const;
+
+    // 按开始时间排序的所有阶段
+    std::vector<StartupPhase> phases() const;
+    void print(std::ostream& out) const;
+    // 写入失败时返回false
+    bool exportCsv(const std::string& path) const;
+
+private:
+    Clock::time_point m_origin;
+    std::thread::id m_mainThread;
+    mutable std::mutex m_mutex;
+    std::vector<StartupPhase> m_phases;
+};
+#endif
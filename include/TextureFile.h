@@ -0,0 +1,91 @@
+﻿// TextureFile.h: 烘焙后的纹理文件(.lvktex)
+// 保存预先生成的全部mip层级，像素为块压缩或RGBA8格式，加载时通过内存映射整体拷贝进暂存缓冲，一次拷贝指令上传所有层级
+
+#ifndef LEARN_VK_TEXTURE_FILE
+#define LEARN_VK_TEXTURE_FILE
+#include "MappedFile.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+const static uint32_t TEXTURE_FILE_MAGIC = 0x544b564c; // "LVKT"
+const static uint32_t TEXTURE_FILE_VERSION = 1;
+
+// 文件头，之后是mipLevels个TextureFileLevel，再之后是按层级顺序连续存放的像素数据
+struct TextureFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t format; // VkFormat
+    uint32_t width;
+    uint32_t height;
+    uint32_t mipLevels;
+    uint64_t sourceSize; // 源图片的大小与修改时间，任意一个改变都视为过期
+    int64_t sourceWriteTime;
+};
+
+struct TextureFileLevel {
+    uint64_t offset; // 相对于文件起始，16字节对齐
+    uint64_t size;
+    uint32_t width;
+    uint32_t height;
+};
+
+// 烘焙时一个mip层级的数据
+struct TextureLevelData {
+    uint32_t width;
+    uint32_t height;
+    std::vector<uint8_t> data;
+};
+
+class TextureFile {
+public:
+    // 纹理对应的烘焙文件路径，与源图片放在同一目录下
+    static std::string cookedPath(const std::string& texturePath);
+
+    // 映射烘焙文件并校验版本、源图片是否匹配以及各层级的尺寸链、数据大小与偏移，任意一项不符时返回false
+    bool open(const std::string& texturePath);
+
+    // 写入所有层级，先写临时文件再替换
+    static bool write(const std::string& texturePath, uint32_t format, const std::vector<TextureLevelData>& levels);
+
+    void close() {
+        m_file.close();
+        m_header = nullptr;
+    }
+    bool isOpen() const {
+        return m_header != nullptr;
+    }
+    uint32_t format() const {
+        return m_header->format;
+    }
+    uint32_t width() const {
+        return m_header->width;
+    }
+    uint32_t height() const {
+        return m_header->height;
+    }
+    uint32_t mipLevels() const {
+        return m_header->mipLevels;
+    }
+    const TextureFileLevel& level(uint32_t mipLevel) const {
+        return m_levels[mipLevel];
+    }
+    // 所有层级连续存放，从第0级开始的整段数据
+    const uint8_t* levelData() const {
+        return m_file.data() + m_levels[0].offset;
+    }
+    uint64_t levelDataSize() const {
+        const TextureFileLevel& last = m_levels[m_header->mipLevels - 1];
+        return last.offset + last.size - m_levels[0].offset;
+    }
+    // 把所有层级的数据读进内存
+    void prefault() const {
+        m_file.prefault(static_cast<size_t>(m_levels[0].offset), static_cast<size_t>(levelDataSize()));
+    }
+
+private:
+    MappedFile m_file;
+    const TextureFileHeader* m_header = nullptr;
+    const TextureFileLevel* m_levels = nullptr;
+};
+#endif
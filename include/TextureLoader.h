@@ -0,0 +1,67 @@
+﻿// TextureLoader.h: 并行纹理解码
+// 设备创建之后，load先读取各图片的尺寸并在暂存环形缓冲中预留空间，由线程池把图片直接解码进映射的暂存内存，没有中间的堆缓冲；
+// 设备创建之前可以先用decode在工作线程上解码到主机内存，与创建设备同时进行，之后再由load拷贝进暂存内存。
+// 纹理按总大小不超过环形缓冲一半的分组处理，拷贝后一组时前一组已经提交，可以在GPU上同时传输；
+// 需要时在暂存内存中直接用MipGenerator生成完整的mip链，按MipGenerator::levelOffsets的布局紧跟在第0级之后
+
+#ifndef LEARN_VK_TEXTURE_LOADER
+#define LEARN_VK_TEXTURE_LOADER
+#include "ThreadPool.h"
+#include "UploadContext.h"
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// 解码到主机内存的RGBA8图片
+struct DecodedImage {
+    std::string path;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::shared_ptr<uint8_t> pixels; // 由stb_image分配，为空表示未解码
+    double decodeMs = 0.0;
+};
+
+struct TextureInfo {
+    std::string path;
+    uint32_t width;
+    uint32_t height;
+    StagingRegion staging; // RGBA8像素在暂存缓冲中的位置
+    uint32_t mipLevels;    // 暂存缓冲中已生成的层级数，不生成mip链时为1
+    double decodeMs;       // 在工作线程上解码的耗时
+    double mipMs;          // CPU生成mip链的耗时
+    double uploadMs;       // 所在分组从提交到上传批次完成的耗时
+};
+
+class TextureLoader {
+public:
+    TextureLoader(ThreadPool& threadPool, UploadContext& uploadContext);
+
+    // 在调用线程上解码一张图片(统一转为RGBA8)，失败时抛出异常
+    static DecodedImage decodeImage(const std::string& path);
+    // 把尺寸为width x height的图片解码到output(capacity字节，通常是映射的暂存内存)，失败时抛出异常
+    static void decodeImageTo(const std::string& path, uint32_t width, uint32_t height, void* output, size_t capacity);
+    // 在线程池上并行解码paths中的所有图片，不访问UploadContext，可以在设备创建之前调用
+    std::vector<DecodedImage> decode(const std::vector<std::string>& paths);
+
+    // 上传images中的所有图片，每张的像素拷贝进暂存缓冲后即释放；
+    // record在调用线程上按顺序对每张纹理调用一次，用于创建图像并在上传批次中录制拷贝；返回时所有上传都已完成
+    // generateMips为true时按sRGB颜色在CPU上生成mip链，用于不支持线性blit的格式
+    std::vector<TextureInfo> load(std::vector<DecodedImage>& images,
+                                  const std::function<void(const TextureInfo&)>& record, bool generateMips = false);
+    // 与上面相同，但直接把paths中的图片解码进暂存内存
+    std::vector<TextureInfo> load(const std::vector<std::string>& paths,
+                                  const std::function<void(const TextureInfo&)>& record, bool generateMips = false);
+
+private:
+    // 在线程池上把第i张纹理的RGBA8第0级写进texture.staging，第三个参数为预留的字节数
+    using StagingFill = std::function<void(size_t i, TextureInfo& texture, VkDeviceSize capacity)>;
+    // 按分组预留暂存空间并调用fill，需要时生成mip链，录制并提交上传，返回时所有上传都已完成
+    void upload(std::vector<TextureInfo>& textures, const StagingFill& fill,
+                const std::function<void(const TextureInfo&)>& record, bool generateMips);
+
+    ThreadPool& m_threadPool;
+    UploadContext& m_uploadContext;
+};
+#endif
@@ -0,0 +1,52 @@
+﻿// ThreadPool.h: 固定数量工作线程的线程池，用于资源解析、解码等可并行的CPU任务
+
+#ifndef LEARN_VK_THREAD_POOL
+#define LEARN_VK_THREAD_POOL
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+public:
+    // threadCount为0时使用硬件线程数
+    explicit ThreadPool(uint32_t threadCount = 0);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    template <typename F>
+    auto submit(F&& task) -> std::future<decltype(task())> {
+        using Result = decltype(task());
+        auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+        std::future<Result> future = packaged->get_future();
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_tasks.emplace([packaged]() { (*packaged)(); });
+        }
+        m_condition.notify_one();
+        return future;
+    }
+
+    // 将[0, count)分发给工作线程执行，调用线程也参与执行并阻塞到全部完成
+    void parallelFor(size_t count, const std::function<void(size_t)>& body);
+
+    uint32_t threadCount() const {
+        return static_cast<uint32_t>(m_workers.size());
+    }
+
+private:
+    void workerLoop();
+
+    std::vector<std::thread> m_workers;
+    std::queue<std::function<void()>> m_tasks;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    bool m_stop = false;
+};
+#endif
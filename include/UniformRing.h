@@ -0,0 +1,55 @@
+﻿// UniformRing.h: 每帧的uniform环形缓冲
+// 一个持久映射的主机可见缓冲按预渲染帧数分段，每帧从自己的分段中线性子分配uniform块，
+// 通过VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC的动态偏移访问，帧内无需任何map/unmap
+
+#ifndef LEARN_VK_UNIFORM_RING
+#define LEARN_VK_UNIFORM_RING
+#include "DeviceMemoryAllocator.h"
+#include "vulkan/vulkan_core.h"
+#include <cstdint>
+#include <cstring>
+
+class UniformRing {
+public:
+    const static VkDeviceSize DEFAULT_FRAME_SIZE = 1ull << 20;
+
+    UniformRing() = default;
+    UniformRing(const UniformRing&) = delete;
+    UniformRing& operator=(const UniformRing&) = delete;
+
+    // alignment为设备的minUniformBufferOffsetAlignment
+    void init(VkDevice device, DeviceMemoryAllocator& allocator, VkDeviceSize alignment, uint32_t frameCount,
+              VkDeviceSize frameSize = DEFAULT_FRAME_SIZE);
+    void destroy();
+
+    // 开始写入某一帧的分段，调用前该帧的栅栏必须已经等待，分段中之前的数据不再被GPU读取
+    void beginFrame(uint32_t frameIndex);
+    // 在当前帧分段中分配size字节，返回动态偏移，mapped为写入地址；分段用尽时抛出异常
+    uint32_t allocate(VkDeviceSize size, void** mapped);
+    template <typename T>
+    uint32_t push(const T& data) {
+        void* mapped;
+        uint32_t offset = allocate(sizeof(T), &mapped);
+        memcpy(mapped, &data, sizeof(T));
+        return offset;
+    }
+
+    VkBuffer buffer() const {
+        return m_buffer;
+    }
+    // 当前帧已使用的字节数
+    VkDeviceSize frameUsed() const {
+        return m_head - m_frameBegin;
+    }
+
+private:
+    VkDevice m_device = VK_NULL_HANDLE;
+    DeviceMemoryAllocator* m_allocator = nullptr;
+    VkBuffer m_buffer = VK_NULL_HANDLE;
+    MemoryAllocation m_memory;
+    VkDeviceSize m_alignment = 0;
+    VkDeviceSize m_frameSize = 0;
+    VkDeviceSize m_frameBegin = 0;
+    VkDeviceSize m_head = 0;
+};
+#endif
@@ -0,0 +1,132 @@
+﻿// UploadContext.h: 批量上传管理
+// 拷贝、布局转换与mipmap生成都录制进同一个批次，一次提交并以栅栏跟踪；
+// 数据先写入持久映射的暂存环形缓冲，批次完成后其占用的环形空间被回收
+// 设备有独立的传输队列族时，拷贝在传输队列上执行，资源通过队列族所有权转移交给图形队列，两次提交之间用信号量同步
+
+#ifndef LEARN_VK_UPLOAD_CONTEXT
+#define LEARN_VK_UPLOAD_CONTEXT
+#include "DeviceMemoryAllocator.h"
+#include "GpuProfiler.h"
+#include "vulkan/vulkan_core.h"
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+// 一次提交的票据，序号单调递增，可用来查询或等待对应批次完成
+typedef uint64_t UploadTicket;
+
+// 暂存数据在暂存缓冲中的位置
+struct StagingRegion {
+    VkBuffer buffer;
+    VkDeviceSize offset;
+    void* mapped;
+};
+
+class UploadContext {
+public:
+    const static VkDeviceSize DEFAULT_RING_SIZE = 32ull << 20;
+
+    UploadContext() = default;
+    UploadContext(const UploadContext&) = delete;
+    UploadContext& operator=(const UploadContext&) = delete;
+
+    void init(VkDevice device, DeviceMemoryAllocator& allocator,
+              uint32_t transferFamily, VkQueue transferQueue, uint32_t graphicsFamily, VkQueue graphicsQueue,
+              VkExtent3D imageGranularity, VkDeviceSize ringSize = DEFAULT_RING_SIZE);
+    // 等待所有批次完成并释放资源
+    void destroy();
+    // 之后开始的每个批次在各自的指令缓冲首尾写入时间戳，profiler为空时不统计
+    void setProfiler(GpuProfiler* profiler);
+
+    // 当前批次在传输队列上执行的指令缓冲，只能录制拷贝与传输阶段的屏障；没有正在录制的批次时开始一个新批次
+    VkCommandBuffer transferCommandBuffer();
+    // 当前批次在图形队列上执行的指令缓冲，在传输指令完成并取得资源所有权之后执行，用于blit与附件的布局转换
+    VkCommandBuffer graphicsCommandBuffer();
+    bool hasDedicatedTransferQueue() const {
+        return m_transferFamily != m_graphicsFamily;
+    }
+    // 传输队列族的minImageTransferGranularity：只拷贝图像一部分时，偏移与范围需为其整数倍或到达子资源边界
+    VkExtent3D imageTransferGranularity() const {
+        return m_imageGranularity;
+    }
+
+    // 将传输队列写入的资源交给图形队列：队列族不同时录制一对释放/获取屏障，相同时为普通的内存屏障
+    void releaseBuffer(VkBuffer buffer, VkAccessFlags dstAccess, VkPipelineStageFlags dstStage);
+    void releaseImage(VkImage image, const VkImageSubresourceRange& range, VkImageLayout oldLayout,
+                      VkImageLayout newLayout, VkAccessFlags dstAccess, VkPipelineStageFlags dstStage);
+    // 分配暂存空间，数据由调用者写入mapped(可以在其他线程)，写完之前不能提交当前批次；
+    // 空间不足时会等待较早的批次完成，超过环形缓冲大小的数据使用临时缓冲
+    StagingRegion reserve(VkDeviceSize size, VkDeviceSize alignment = 16);
+    // 与reserve相同但从不等待：只回收已经完成的批次，环形缓冲的剩余空间仍然不足时返回false，供每帧限额的流式上传推迟到下一帧
+    bool tryReserve(VkDeviceSize size, StagingRegion& region, VkDeviceSize alignment = 16);
+    // 分配暂存空间并写入数据
+    StagingRegion stage(const void* data, VkDeviceSize size, VkDeviceSize alignment = 16);
+    // 暂存数据，录制拷贝到dstBuffer的指令并交给图形队列，dstAccess与dstStage为之后使用该缓冲的方式
+    void uploadBuffer(const void* data, VkDeviceSize size, VkBuffer dstBuffer, VkAccessFlags dstAccess,
+                      VkPipelineStageFlags dstStage);
+    // 暂存数据并录制拷贝到dstBuffer中dstOffset处的指令，不转移所有权；
+    // 一个缓冲分多个批次上传时，最后一段之后调用releaseBuffer，其屏障覆盖之前所有批次的写入
+    void copyToBuffer(const void* data, VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset);
+    // 使用tryReserve的copyToBuffer，暂存空间不足时不录制任何指令并返回false
+    bool tryCopyToBuffer(const void* data, VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset);
+
+    // 提交当前批次，没有录制任何指令时返回上一次的票据
+    UploadTicket submit();
+    bool isComplete(UploadTicket ticket);
+    void wait(UploadTicket ticket);
+    // 提交并等待完成
+    void flush();
+
+    VkDeviceSize ringSize() const {
+        return m_ringSize;
+    }
+    uint32_t submitCount() const {
+        return static_cast<uint32_t>(m_lastTicket);
+    }
+
+private:
+    struct Batch {
+        VkCommandBuffer transferCommandBuffer;
+        VkCommandBuffer graphicsCommandBuffer; // 没有独立传输队列时与transferCommandBuffer相同
+        VkSemaphore transferFinished;
+        VkFence fence;
+        UploadTicket ticket;
+        uint64_t ringEnd; // 批次提交时环形缓冲的写入位置，完成后回收到此处
+        uint32_t transferQuery; // GpuProfiler的帧外查询对，未统计时为INVALID_QUERY
+        uint32_t graphicsQuery;
+        std::vector<std::pair<VkBuffer, MemoryAllocation>> tempBuffers;
+    };
+
+    Batch* acquireBatch();
+    void beginBatch();
+    void retire(bool block);
+    bool allocateFromRing(VkDeviceSize size, VkDeviceSize alignment, StagingRegion& region);
+
+    VkDevice m_device = VK_NULL_HANDLE;
+    DeviceMemoryAllocator* m_allocator = nullptr;
+    uint32_t m_transferFamily = 0;
+    uint32_t m_graphicsFamily = 0;
+    VkExtent3D m_imageGranularity = {1, 1, 1};
+    VkQueue m_transferQueue = VK_NULL_HANDLE;
+    VkQueue m_graphicsQueue = VK_NULL_HANDLE;
+    VkCommandPool m_transferCommandPool = VK_NULL_HANDLE;
+    VkCommandPool m_graphicsCommandPool = VK_NULL_HANDLE;
+
+    VkBuffer m_ringBuffer = VK_NULL_HANDLE;
+    MemoryAllocation m_ringMemory;
+    VkDeviceSize m_ringSize = 0;
+    uint64_t m_ringHead = 0; // 单调递增的写入与回收位置，取模得到实际偏移
+    uint64_t m_ringTail = 0;
+
+    Batch* m_recording = nullptr;
+    std::deque<Batch*> m_inFlight;
+    std::vector<Batch*> m_freeBatches;
+    std::vector<Batch> m_batches;
+    UploadTicket m_lastTicket = 0;
+    UploadTicket m_completedTicket = 0;
+
+    GpuProfiler* m_profiler = nullptr;
+    uint32_t m_transferScope = GpuProfiler::INVALID_QUERY;
+    uint32_t m_graphicsScope = GpuProfiler::INVALID_QUERY;
+};
+#endif
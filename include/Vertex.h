@@ -0,0 +1,98 @@
+﻿// Vertex.h: 顶点格式及其在管线中的绑定与属性描述
+// Vertex为解析与去重使用的完整精度格式，CompactVertex为可选的量化格式，二者共用同一个顶点着色器
+
+#ifndef LEARN_VK_VERTEX
+#define LEARN_VK_VERTEX
+#ifndef GLM_ENABLE_EXPERIMENTAL
+#define GLM_ENABLE_EXPERIMENTAL
+#endif
+#include "vulkan/vulkan_core.h"
+#include <array>
+#include <cstddef>
+#include <glm/gtc/packing.hpp>
+#include <glm/gtc/type_precision.hpp>
+#include <glm/gtx/hash.hpp>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+
+struct Vertex {
+    glm::vec3 position;
+    glm::vec2 texCoord;
+
+    static VkVertexInputBindingDescription getBindDescription() {
+        VkVertexInputBindingDescription bindDescription = {};
+        bindDescription.binding = 0;
+        bindDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+        bindDescription.stride = sizeof(Vertex);
+        return bindDescription;
+    }
+    static std::array<VkVertexInputAttributeDescription, 2>
+    getAttributeDescriptions() {
+        std::array<VkVertexInputAttributeDescription, 2> attributeDescription{};
+        attributeDescription[0].binding = 0;
+        attributeDescription[0].location = 0;
+        attributeDescription[0].offset = offsetof(Vertex, position);
+        attributeDescription[0].format = VK_FORMAT_R32G32B32_SFLOAT;
+        attributeDescription[1].binding = 0;
+        attributeDescription[1].location = 2;
+        attributeDescription[1].offset = offsetof(Vertex, texCoord);
+        attributeDescription[1].format = VK_FORMAT_R32G32_SFLOAT;
+        return attributeDescription;
+    }
+    bool operator==(const Vertex& other) const {
+        return position == other.position && texCoord == other.texCoord;
+    }
+};
+
+// 12字节的紧凑顶点，位置相对网格包围盒量化为16位unorm，在着色器中由模型矩阵还原
+// 纹理坐标全部位于[0,1]时量化为16位unorm，否则存为half
+struct CompactVertex {
+    glm::u16vec4 position; // w分量只用于4字节对齐
+    glm::u16vec2 texCoord;
+
+    // boundsScale为包围盒尺寸的倒数
+    static CompactVertex fromVertex(const Vertex& vertex, const glm::vec3& boundsMin, const glm::vec3& boundsScale,
+                                    bool halfTexCoord) {
+        glm::vec3 normalized = (vertex.position - boundsMin) * boundsScale;
+        CompactVertex compact;
+        compact.position = glm::u16vec4(glm::packUnorm1x16(normalized.x), glm::packUnorm1x16(normalized.y),
+                                        glm::packUnorm1x16(normalized.z), 0);
+        if (halfTexCoord) {
+            compact.texCoord = glm::u16vec2(glm::packHalf1x16(vertex.texCoord.x), glm::packHalf1x16(vertex.texCoord.y));
+        } else {
+            compact.texCoord = glm::u16vec2(glm::packUnorm1x16(vertex.texCoord.x), glm::packUnorm1x16(vertex.texCoord.y));
+        }
+        return compact;
+    }
+
+    static VkVertexInputBindingDescription getBindDescription() {
+        VkVertexInputBindingDescription bindDescription = {};
+        bindDescription.binding = 0;
+        bindDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+        bindDescription.stride = sizeof(CompactVertex);
+        return bindDescription;
+    }
+    static std::array<VkVertexInputAttributeDescription, 2>
+    getAttributeDescriptions(bool halfTexCoord) {
+        std::array<VkVertexInputAttributeDescription, 2> attributeDescription{};
+        attributeDescription[0].binding = 0;
+        attributeDescription[0].location = 0;
+        attributeDescription[0].offset = offsetof(CompactVertex, position);
+        attributeDescription[0].format = VK_FORMAT_R16G16B16A16_UNORM;
+        attributeDescription[1].binding = 0;
+        attributeDescription[1].location = 2;
+        attributeDescription[1].offset = offsetof(CompactVertex, texCoord);
+        attributeDescription[1].format = halfTexCoord ? VK_FORMAT_R16G16_SFLOAT : VK_FORMAT_R16G16_UNORM;
+        return attributeDescription;
+    }
+};
+
+namespace std {
+template <>
+struct hash<Vertex> {
+    size_t operator()(Vertex const& vertex) const {
+        return (hash<glm::vec3>()(vertex.position) >> 1) ^ (hash<glm::vec2>()(vertex.texCoord) << 1);
+    }
+};
+} // namespace std
+#endif
@@ -0,0 +1,30 @@
+﻿// VertexDedup.h: 以obj的(顶点, 纹理坐标, 法线)索引三元组为键的顶点去重
+// 每个shape在线程池中并行建立局部的开放寻址哈希表，随后按shape顺序合并，输出与逐顶点哈希去重完全一致
+
+#ifndef LEARN_VK_VERTEX_DEDUP
+#define LEARN_VK_VERTEX_DEDUP
+#include "ThreadPool.h"
+#include "Vertex.h"
+#include "tiny_obj_loader.h"
+#include <cstdint>
+#include <vector>
+
+// 一段连续的面索引，对应obj中的一个shape
+struct IndexRange {
+    const tinyobj::index_t* indices;
+    size_t count;
+};
+
+class VertexDeduplicator {
+public:
+    explicit VertexDeduplicator(ThreadPool& threadPool) :
+        m_threadPool(threadPool) {}
+
+    // 根据属性数组与各shape的索引生成去重后的顶点与索引，结果追加到vertices与indices之后
+    void build(const tinyobj::attrib_t& attr, const std::vector<IndexRange>& shapes,
+               std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+
+private:
+    ThreadPool& m_threadPool;
+};
+#endif
@@ -0,0 +1,136 @@
+﻿// AssetStreamer.cpp: 后台资源流式加载的实现
+//
+#include "AssetStreamer.h"
+#include "MipGenerator.h"
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+AssetStreamer::AssetStreamer() : m_requests(QUEUE_CAPACITY), m_completed(QUEUE_CAPACITY) {
+}
+
+AssetStreamer::~AssetStreamer() {
+    stop();
+}
+
+void AssetStreamer::start(uint32_t threadCount, ThreadPool& threadPool, MeshLoader meshLoader, bool generateMips) {
+    if (running()) {
+        throw std::runtime_error("asset streamer is already running!");
+    }
+    m_threadPool = &threadPool;
+    m_meshLoader = std::move(meshLoader);
+    m_generateMips = generateMips;
+    m_stop = false;
+    for (uint32_t i = 0; i < std::max(1u, threadCount); i++) {
+        m_workers.emplace_back(&AssetStreamer::workerLoop, this);
+    }
+}
+
+void AssetStreamer::stop() {
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    for (auto& worker : m_workers) {
+        worker.join();
+    }
+    m_workers.clear();
+    // 工作线程都已退出，剩余的请求与结果直接丢弃
+    AssetRequest request;
+    while (m_requests.pop(request)) {
+    }
+    StreamedAsset asset;
+    while (m_completed.pop(asset)) {
+    }
+    m_queued = 0;
+    m_outstanding = 0;
+}
+
+bool AssetStreamer::request(AssetRequest request) {
+    if (m_outstanding.load(std::memory_order_relaxed) >= QUEUE_CAPACITY) {
+        return false;
+    }
+    m_outstanding++;
+    m_queued++; // 先计数再入队，工作线程看到计数时最多短暂地取不到请求，不会漏掉唤醒
+    m_requests.push(std::move(request));
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+    }
+    m_wake.notify_one();
+    return true;
+}
+
+bool AssetStreamer::poll(StreamedAsset& asset) {
+    if (!m_completed.pop(asset)) {
+        return false;
+    }
+    m_outstanding--;
+    return true;
+}
+
+void AssetStreamer::workerLoop() {
+    while (true) {
+        AssetRequest request;
+        if (!m_requests.pop(request)) {
+            std::unique_lock<std::mutex> lock(m_sleepMutex);
+            m_wake.wait(lock, [this]() { return m_stop || m_queued.load() > 0; });
+            if (m_stop) {
+                return;
+            }
+            lock.unlock();
+            std::this_thread::yield(); // 计数已增加而请求还未入队
+            continue;
+        }
+        m_queued--;
+        {
+            std::lock_guard<std::mutex> lock(m_sleepMutex);
+            if (m_stop) { // 退出时不再开始新的加载
+                return;
+            }
+        }
+        StreamedAsset asset = load(request);
+        m_completed.push(std::move(asset)); // 结果数不超过未取走的请求数，队列不会满
+    }
+}
+
+StreamedAsset AssetStreamer::load(const AssetRequest& request) {
+    StreamedAsset asset;
+    asset.request = request;
+    auto startTime = std::chrono::high_resolution_clock::now();
+    try {
+        if (request.type == AssetType::Mesh) {
+            asset.mesh = std::make_unique<MeshData>();
+            m_meshLoader(request.path, *asset.mesh);
+            if (asset.mesh->cache.isOpen()) { // 顶点与索引会从映射的缓存分块上传
+                asset.mesh->cache.prefault();
+            }
+        } else {
+            if (!request.ignoreCooked) {
+                auto cooked = std::make_unique<TextureFile>();
+                if (cooked->open(request.path)) {
+                    cooked->prefault();
+                    asset.cooked = std::move(cooked);
+                }
+            }
+            if (!asset.cooked) {
+                asset.image = TextureLoader::decodeImage(request.path);
+                if (m_generateMips) { // 渲染线程上只剩拷贝，mip链在这里生成
+                    std::vector<uint64_t> offsets;
+                    uint64_t size = MipGenerator::levelOffsets(asset.image.width, asset.image.height, offsets);
+                    std::shared_ptr<uint8_t> chain(new uint8_t[size], std::default_delete<uint8_t[]>());
+                    MipGenerator mipGenerator(*m_threadPool);
+                    mipGenerator.generate(asset.image.pixels.get(), asset.image.width, asset.image.height, true,
+                                          chain.get());
+                    asset.image.pixels = chain;
+                    asset.mipLevels = static_cast<uint32_t>(offsets.size());
+                }
+            }
+        }
+    } catch (...) {
+        asset.error = std::current_exception();
+    }
+    asset.loadMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime)
+                       .count();
+    return asset;
+}
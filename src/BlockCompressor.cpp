@@ -0,0 +1,378 @@
+﻿// BlockCompressor.cpp: 纹理块压缩的实现
+//
+
+#include "BlockCompressor.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// 求块内颜色在channels个通道上的主轴，返回均值与方向(幂迭代求协方差矩阵的最大特征向量)
+static void principalAxis(const uint8_t* pixels, int channels, float mean[4], float axis[4]) {
+    for (int c = 0; c < 4; c++) {
+        mean[c] = 0.0f;
+        axis[c] = 0.0f;
+    }
+    for (int i = 0; i < 16; i++) {
+        for (int c = 0; c < channels; c++) {
+            mean[c] += pixels[i * 4 + c];
+        }
+    }
+    for (int c = 0; c < channels; c++) {
+        mean[c] /= 16.0f;
+    }
+    float cov[4][4] = {};
+    for (int i = 0; i < 16; i++) {
+        float d[4];
+        for (int c = 0; c < channels; c++) {
+            d[c] = pixels[i * 4 + c] - mean[c];
+        }
+        for (int a = 0; a < channels; a++) {
+            for (int b = 0; b < channels; b++) {
+                cov[a][b] += d[a] * d[b];
+            }
+        }
+    }
+    // 以对角线最大的通道为初值，避免初值与主轴正交
+    int largest = 0;
+    for (int c = 1; c < channels; c++) {
+        if (cov[c][c] > cov[largest][largest]) {
+            largest = c;
+        }
+    }
+    axis[largest] = 1.0f;
+    for (int iteration = 0; iteration < 8; iteration++) {
+        float next[4] = {};
+        for (int a = 0; a < channels; a++) {
+            for (int b = 0; b < channels; b++) {
+                next[a] += cov[a][b] * axis[b];
+            }
+        }
+        float length = 0.0f;
+        for (int c = 0; c < channels; c++) {
+            length = std::max(length, std::fabs(next[c]));
+        }
+        if (length < 1e-6f) { // 块内颜色相同
+            break;
+        }
+        for (int c = 0; c < channels; c++) {
+            axis[c] = next[c] / length;
+        }
+    }
+}
+
+// 颜色投影到主轴上的最小与最大位置作为初始端点
+static void axisEndpoints(const uint8_t* pixels, int channels, float e0[4], float e1[4]) {
+    float mean[4], axis[4];
+    principalAxis(pixels, channels, mean, axis);
+    float minT = 0.0f, maxT = 0.0f;
+    float axisLength2 = 0.0f;
+    for (int c = 0; c < channels; c++) {
+        axisLength2 += axis[c] * axis[c];
+    }
+    if (axisLength2 > 0.0f) {
+        minT = maxT = 0.0f;
+        for (int i = 0; i < 16; i++) {
+            float t = 0.0f;
+            for (int c = 0; c < channels; c++) {
+                t += (pixels[i * 4 + c] - mean[c]) * axis[c];
+            }
+            t /= axisLength2;
+            minT = std::min(minT, t);
+            maxT = std::max(maxT, t);
+        }
+    }
+    for (int c = 0; c < 4; c++) {
+        e0[c] = c < channels ? std::clamp(mean[c] + axis[c] * maxT, 0.0f, 255.0f) : 255.0f;
+        e1[c] = c < channels ? std::clamp(mean[c] + axis[c] * minT, 0.0f, 255.0f) : 255.0f;
+    }
+}
+
+// 已知每个像素的插值权重w(0表示e0，1表示e1)，用最小二乘求使误差最小的两个端点；权重退化时返回false
+static bool leastSquaresEndpoints(const uint8_t* pixels, int channels, const float* weights, float e0[4],
+                                  float e1[4]) {
+    float aa = 0.0f, bb = 0.0f, ab = 0.0f;
+    float ax[4] = {}, bx[4] = {};
+    for (int i = 0; i < 16; i++) {
+        float b = weights[i];
+        float a = 1.0f - b;
+        aa += a * a;
+        bb += b * b;
+        ab += a * b;
+        for (int c = 0; c < channels; c++) {
+            ax[c] += a * pixels[i * 4 + c];
+            bx[c] += b * pixels[i * 4 + c];
+        }
+    }
+    float det = aa * bb - ab * ab;
+    if (std::fabs(det) < 1e-6f) {
+        return false;
+    }
+    for (int c = 0; c < channels; c++) {
+        e0[c] = std::clamp((ax[c] * bb - bx[c] * ab) / det, 0.0f, 255.0f);
+        e1[c] = std::clamp((bx[c] * aa - ax[c] * ab) / det, 0.0f, 255.0f);
+    }
+    return true;
+}
+
+static uint16_t packRGB565(const float color[4]) {
+    uint32_t r = static_cast<uint32_t>(color[0] * 31.0f / 255.0f + 0.5f);
+    uint32_t g = static_cast<uint32_t>(color[1] * 63.0f / 255.0f + 0.5f);
+    uint32_t b = static_cast<uint32_t>(color[2] * 31.0f / 255.0f + 0.5f);
+    return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+static void unpackRGB565(uint16_t packed, int color[3]) {
+    int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+}
+
+// 按给定端点为每个像素选择最近的调色板颜色，返回总误差
+static uint32_t fitBC1Indices(const uint8_t* pixels, uint16_t c0, uint16_t c1, uint32_t& indices) {
+    int palette[4][3];
+    unpackRGB565(c0, palette[0]);
+    unpackRGB565(c1, palette[1]);
+    for (int c = 0; c < 3; c++) {
+        palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+        palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+    uint32_t error = 0;
+    indices = 0;
+    for (int i = 0; i < 16; i++) {
+        uint32_t best = UINT32_MAX, bestIndex = 0;
+        for (uint32_t p = 0; p < 4; p++) {
+            uint32_t e = 0;
+            for (int c = 0; c < 3; c++) {
+                int d = pixels[i * 4 + c] - palette[p][c];
+                e += d * d;
+            }
+            if (e < best) {
+                best = e;
+                bestIndex = p;
+            }
+        }
+        error += best;
+        indices |= bestIndex << (2 * i);
+    }
+    return error;
+}
+
+// 编码一个4色模式的BC1颜色块(c0 > c1)，BC3的颜色部分与之相同
+static void encodeColorBlock(const uint8_t* pixels, uint8_t* block) {
+    static const float INDEX_WEIGHTS[4] = {0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f};
+    float e0[4], e1[4];
+    axisEndpoints(pixels, 3, e0, e1);
+    uint16_t c0 = packRGB565(e0), c1 = packRGB565(e1);
+    if (c0 < c1) {
+        std::swap(c0, c1);
+    }
+    uint32_t indices;
+    uint32_t error = fitBC1Indices(pixels, c0, c1, indices);
+    if (c0 != c1 && error > 0) { // 以当前索引为权重修正端点，误差更小时采用
+        float weights[16];
+        for (int i = 0; i < 16; i++) {
+            weights[i] = INDEX_WEIGHTS[(indices >> (2 * i)) & 3];
+        }
+        if (leastSquaresEndpoints(pixels, 3, weights, e0, e1)) {
+            uint16_t r0 = packRGB565(e0), r1 = packRGB565(e1);
+            if (r0 < r1) {
+                std::swap(r0, r1);
+            }
+            uint32_t refinedIndices;
+            uint32_t refinedError = r0 != r1 ? fitBC1Indices(pixels, r0, r1, refinedIndices) : UINT32_MAX;
+            if (refinedError < error) {
+                c0 = r0;
+                c1 = r1;
+                indices = refinedIndices;
+            }
+        }
+    }
+    if (c0 == c1) { // 端点相同时只会是3色模式，所有像素取索引0
+        indices = 0;
+    }
+    memcpy(block, &c0, 2);
+    memcpy(block + 2, &c1, 2);
+    memcpy(block + 4, &indices, 4);
+}
+
+void BlockCompressor::compressBC1(const uint8_t* pixels, uint8_t* block) {
+    encodeColorBlock(pixels, block);
+}
+
+void BlockCompressor::compressBC3(const uint8_t* pixels, uint8_t* block) {
+    // alpha块：a0 > a1时为8级插值，端点取块内最大与最小alpha
+    uint8_t a0 = 0, a1 = 255;
+    for (int i = 0; i < 16; i++) {
+        a0 = std::max(a0, pixels[i * 4 + 3]);
+        a1 = std::min(a1, pixels[i * 4 + 3]);
+    }
+    uint64_t indices = 0;
+    if (a0 > a1) {
+        int palette[8];
+        palette[0] = a0;
+        palette[1] = a1;
+        for (int p = 1; p < 7; p++) {
+            palette[p + 1] = ((7 - p) * a0 + p * a1) / 7;
+        }
+        for (int i = 0; i < 16; i++) {
+            int alpha = pixels[i * 4 + 3];
+            uint64_t bestIndex = 0;
+            int best = 256;
+            for (int p = 0; p < 8; p++) {
+                int d = std::abs(alpha - palette[p]);
+                if (d < best) {
+                    best = d;
+                    bestIndex = p;
+                }
+            }
+            indices |= bestIndex << (3 * i);
+        }
+    }
+    block[0] = a0;
+    block[1] = a1;
+    for (int i = 0; i < 6; i++) {
+        block[2 + i] = static_cast<uint8_t>(indices >> (8 * i));
+    }
+    encodeColorBlock(pixels, block + 8);
+}
+
+// BC7模式6：端点每通道7位加一个共享的p位，得到8位端点
+struct BC7Endpoint {
+    uint8_t bits[4]; // 7位分量
+    uint8_t pbit;
+    int value(int c) const {
+        return (bits[c] << 1) | pbit;
+    }
+};
+
+static BC7Endpoint quantizeBC7Endpoint(const float color[4]) {
+    BC7Endpoint best = {};
+    float bestError = INFINITY;
+    for (uint8_t pbit = 0; pbit < 2; pbit++) {
+        BC7Endpoint endpoint;
+        endpoint.pbit = pbit;
+        float error = 0.0f;
+        for (int c = 0; c < 4; c++) {
+            int q = static_cast<int>(std::lround((color[c] - pbit) / 2.0f));
+            endpoint.bits[c] = static_cast<uint8_t>(std::clamp(q, 0, 127));
+            float d = endpoint.value(c) - color[c];
+            error += d * d;
+        }
+        if (error < bestError) {
+            bestError = error;
+            best = endpoint;
+        }
+    }
+    return best;
+}
+
+static const int BC7_WEIGHTS4[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+static uint32_t fitBC7Indices(const uint8_t* pixels, const BC7Endpoint& e0, const BC7Endpoint& e1, uint8_t indices[16]) {
+    int palette[16][4];
+    for (int p = 0; p < 16; p++) {
+        for (int c = 0; c < 4; c++) {
+            palette[p][c] = ((64 - BC7_WEIGHTS4[p]) * e0.value(c) + BC7_WEIGHTS4[p] * e1.value(c) + 32) >> 6;
+        }
+    }
+    uint32_t error = 0;
+    for (int i = 0; i < 16; i++) {
+        uint32_t best = UINT32_MAX;
+        for (int p = 0; p < 16; p++) {
+            uint32_t e = 0;
+            for (int c = 0; c < 4; c++) {
+                int d = pixels[i * 4 + c] - palette[p][c];
+                e += d * d;
+            }
+            if (e < best) {
+                best = e;
+                indices[i] = static_cast<uint8_t>(p);
+            }
+        }
+        error += best;
+    }
+    return error;
+}
+
+// 从低位开始依次写入位域
+struct BitWriter {
+    uint8_t* data;
+    uint32_t position = 0;
+    void write(uint32_t value, uint32_t count) {
+        for (uint32_t i = 0; i < count; i++, position++) {
+            data[position >> 3] |= static_cast<uint8_t>(((value >> i) & 1) << (position & 7));
+        }
+    }
+};
+
+void BlockCompressor::compressBC7(const uint8_t* pixels, uint8_t* block) {
+    float f0[4], f1[4];
+    axisEndpoints(pixels, 4, f0, f1);
+    BC7Endpoint e0 = quantizeBC7Endpoint(f0), e1 = quantizeBC7Endpoint(f1);
+    uint8_t indices[16];
+    uint32_t error = fitBC7Indices(pixels, e0, e1, indices);
+    if (error > 0) {
+        float weights[16];
+        for (int i = 0; i < 16; i++) {
+            weights[i] = BC7_WEIGHTS4[indices[i]] / 64.0f;
+        }
+        if (leastSquaresEndpoints(pixels, 4, weights, f0, f1)) {
+            BC7Endpoint r0 = quantizeBC7Endpoint(f0), r1 = quantizeBC7Endpoint(f1);
+            uint8_t refinedIndices[16];
+            uint32_t refinedError = fitBC7Indices(pixels, r0, r1, refinedIndices);
+            if (refinedError < error) {
+                e0 = r0;
+                e1 = r1;
+                memcpy(indices, refinedIndices, sizeof(indices));
+            }
+        }
+    }
+    if (indices[0] & 8) { // 第一个像素的索引省略最高位，必须小于8，交换端点并翻转索引
+        std::swap(e0, e1);
+        for (int i = 0; i < 16; i++) {
+            indices[i] = 15 - indices[i];
+        }
+    }
+    memset(block, 0, 16);
+    BitWriter writer = {block};
+    writer.write(1 << 6, 7); // 模式6
+    for (int c = 0; c < 4; c++) {
+        writer.write(e0.bits[c], 7);
+        writer.write(e1.bits[c], 7);
+    }
+    writer.write(e0.pbit, 1);
+    writer.write(e1.pbit, 1);
+    writer.write(indices[0], 3);
+    for (int i = 1; i < 16; i++) {
+        writer.write(indices[i], 4);
+    }
+}
+
+void BlockCompressor::compressBlockRow(BlockFormat format, const uint8_t* rgba, uint32_t width, uint32_t height,
+                                       uint32_t blockY, uint8_t* output) {
+    uint32_t blockBytes = BlockCompressor::blockBytes(format);
+    uint32_t blocksX = (width + 3) / 4;
+    uint8_t pixels[64];
+    for (uint32_t blockX = 0; blockX < blocksX; blockX++) {
+        for (uint32_t y = 0; y < 4; y++) {
+            uint32_t sy = std::min(blockY * 4 + y, height - 1);
+            for (uint32_t x = 0; x < 4; x++) {
+                uint32_t sx = std::min(blockX * 4 + x, width - 1);
+                memcpy(pixels + (y * 4 + x) * 4, rgba + (static_cast<size_t>(sy) * width + sx) * 4, 4);
+            }
+        }
+        uint8_t* block = output + static_cast<size_t>(blockX) * blockBytes;
+        switch (format) {
+        case BlockFormat::BC1:
+            compressBC1(pixels, block);
+            break;
+        case BlockFormat::BC3:
+            compressBC3(pixels, block);
+            break;
+        case BlockFormat::BC7:
+            compressBC7(pixels, block);
+            break;
+        }
+    }
+}
@@ -0,0 +1,289 @@
+﻿// DeviceMemoryAllocator.cpp: 设备内存分配器的实现
+//
+#include "DeviceMemoryAllocator.h"
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+static uint32_t ceilLog2(VkDeviceSize value) {
+    uint32_t order = 0;
+    while ((VkDeviceSize(1) << order) < value) {
+        order++;
+    }
+    return order;
+}
+
+void DeviceMemoryAllocator::init(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize blockSize) {
+    m_physicalDevice = physicalDevice;
+    m_device = device;
+    vkGetPhysicalDeviceMemoryProperties(m_physicalDevice, &m_memoryProperties);
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(m_physicalDevice, &properties);
+    m_maxMemoryAllocationCount = properties.limits.maxMemoryAllocationCount;
+    m_blockOrder = ceilLog2(blockSize); // 伙伴算法要求块大小为2的幂
+    m_blockSize = VkDeviceSize(1) << m_blockOrder;
+    m_minOrder = ceilLog2(MIN_ALLOCATION_SIZE);
+}
+
+void DeviceMemoryAllocator::destroy() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& pool : m_pools) {
+        for (auto& block : pool.blocks) {
+            if (!block) {
+                continue;
+            }
+            if (block->allocationCount != 0) {
+                std::cerr << "device memory block destroyed with " << block->allocationCount << " live allocations" << std::endl;
+            }
+            vkFreeMemory(m_device, block->memory, nullptr); // 释放内存会隐式解除映射
+        }
+    }
+    m_pools.clear();
+    m_deviceMemoryCount = 0;
+}
+
+uint32_t DeviceMemoryAllocator::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const {
+    for (uint32_t i = 0; i < m_memoryProperties.memoryTypeCount; i++) {
+        // typeFilter要求只需要响应位域为1，
+        // 然后目标的properties位域要与遍历元素完全相同
+        if ((typeFilter & (1 << i)) && (properties & m_memoryProperties.memoryTypes[i].propertyFlags) == properties) {
+            return i;
+        }
+    }
+    throw std::runtime_error("failed to find suitable memory type!");
+}
+
+VkDeviceMemory DeviceMemoryAllocator::allocateDeviceMemory(VkDeviceSize size, uint32_t memoryType, void** mapped,
+                                                          const VkMemoryDedicatedAllocateInfo* dedicatedInfo) {
+    if (m_deviceMemoryCount >= m_maxMemoryAllocationCount) {
+        throw std::runtime_error("exceeded maxMemoryAllocationCount!");
+    }
+    VkMemoryAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.pNext = dedicatedInfo;
+    allocInfo.allocationSize = size;
+    allocInfo.memoryTypeIndex = memoryType;
+    VkDeviceMemory memory;
+    VkResult res = vkAllocateMemory(m_device, &allocInfo, nullptr, &memory);
+    if (res != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate device memory!");
+    }
+    *mapped = nullptr;
+    if (m_memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+        res = vkMapMemory(m_device, memory, 0, VK_WHOLE_SIZE, 0, mapped); // 主机可见的内存整块持久映射
+        if (res != VK_SUCCESS) {
+            vkFreeMemory(m_device, memory, nullptr);
+            throw std::runtime_error("failed to map device memory!");
+        }
+    }
+    m_deviceMemoryCount++;
+    return memory;
+}
+
+bool DeviceMemoryAllocator::allocateFromBlock(Block& block, uint32_t order, VkDeviceSize& offset) {
+    // 找到不小于所需大小的最小空闲块，逐级对半拆分
+    uint32_t current = order;
+    while (current <= m_blockOrder && block.freeLists[current].empty()) {
+        current++;
+    }
+    if (current > m_blockOrder) {
+        return false;
+    }
+    offset = *block.freeLists[current].begin(); // 优先使用低地址，减少碎片
+    block.freeLists[current].erase(block.freeLists[current].begin());
+    while (current > order) {
+        current--;
+        block.freeLists[current].insert(offset + (VkDeviceSize(1) << current));
+    }
+    block.allocationCount++;
+    return true;
+}
+
+void DeviceMemoryAllocator::freeToBlock(Block& block, uint32_t order, VkDeviceSize offset) {
+    // 伙伴也空闲时合并为上一级
+    while (order < m_blockOrder) {
+        VkDeviceSize buddy = offset ^ (VkDeviceSize(1) << order);
+        auto it = block.freeLists[order].find(buddy);
+        if (it == block.freeLists[order].end()) {
+            break;
+        }
+        block.freeLists[order].erase(it);
+        offset = std::min(offset, buddy);
+        order++;
+    }
+    block.freeLists[order].insert(offset);
+    block.allocationCount--;
+}
+
+bool DeviceMemoryAllocator::hasSpareBlock(uint32_t memoryType, const Block* except) const {
+    for (const auto& pool : m_pools) {
+        if (pool.memoryType != memoryType) {
+            continue;
+        }
+        for (const auto& block : pool.blocks) {
+            if (block && block.get() != except && block->allocationCount == 0) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+MemoryAllocation DeviceMemoryAllocator::allocate(const VkMemoryRequirements& requirements,
+                                                 VkMemoryPropertyFlags properties, bool linear,
+                                                 const VkMemoryDedicatedAllocateInfo* dedicatedInfo) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    MemoryAllocation allocation;
+    allocation.memoryType = findMemoryType(requirements.memoryTypeBits, properties);
+    allocation.size = requirements.size;
+
+    // 伙伴块的偏移总是其大小的整数倍，取整到不小于对齐的2的幂即可满足对齐要求
+    uint32_t order = std::max(m_minOrder, ceilLog2(std::max(requirements.size, requirements.alignment)));
+    // 大资源独立分配，避免一个资源占满整块；驱动要求或倾向独立分配的资源同样如此
+    if (dedicatedInfo || order >= m_blockOrder) {
+        void* mapped;
+        allocation.memory = allocateDeviceMemory(requirements.size, allocation.memoryType, &mapped, dedicatedInfo);
+        allocation.mapped = mapped;
+        m_dedicatedCount++;
+        m_dedicatedBytes += requirements.size;
+        return allocation;
+    }
+
+    auto poolIt = std::find_if(m_pools.begin(), m_pools.end(), [&](const Pool& pool) {
+        return pool.memoryType == allocation.memoryType && pool.linear == linear;
+    });
+    if (poolIt == m_pools.end()) {
+        m_pools.push_back({allocation.memoryType, linear, {}});
+        poolIt = m_pools.end() - 1;
+    }
+    Pool& pool = *poolIt;
+    allocation.poolIndex = static_cast<uint32_t>(poolIt - m_pools.begin());
+    allocation.order = order;
+    for (uint32_t b = 0; b < pool.blocks.size(); b++) {
+        if (pool.blocks[b] && allocateFromBlock(*pool.blocks[b], order, allocation.offset)) {
+            allocation.blockIndex = b;
+            allocation.memory = pool.blocks[b]->memory;
+            allocation.mapped = pool.blocks[b]->mapped ? pool.blocks[b]->mapped + allocation.offset : nullptr;
+            m_requestedBytes += requirements.size;
+            return allocation;
+        }
+    }
+
+    // 现有块都放不下，新建一块
+    auto block = std::make_unique<Block>();
+    void* mapped;
+    block->memory = allocateDeviceMemory(m_blockSize, allocation.memoryType, &mapped);
+    block->mapped = static_cast<uint8_t*>(mapped);
+    block->freeLists.resize(m_blockOrder + 1);
+    block->freeLists[m_blockOrder].insert(0);
+    block->allocationCount = 0;
+    allocateFromBlock(*block, order, allocation.offset);
+    allocation.memory = block->memory;
+    allocation.mapped = block->mapped ? block->mapped + allocation.offset : nullptr;
+    // 优先填入已释放块留下的空位
+    auto slot = std::find(pool.blocks.begin(), pool.blocks.end(), nullptr);
+    allocation.blockIndex = static_cast<uint32_t>(slot - pool.blocks.begin());
+    if (slot == pool.blocks.end()) {
+        pool.blocks.push_back(std::move(block));
+    } else {
+        *slot = std::move(block);
+    }
+    m_requestedBytes += requirements.size;
+    return allocation;
+}
+
+MemoryAllocation DeviceMemoryAllocator::allocateForBuffer(VkBuffer buffer, VkMemoryPropertyFlags properties) {
+    VkBufferMemoryRequirementsInfo2 reqInfo = {};
+    reqInfo.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2;
+    reqInfo.buffer = buffer;
+    VkMemoryDedicatedRequirements dedicatedReq = {};
+    dedicatedReq.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+    VkMemoryRequirements2 memReq = {};
+    memReq.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+    memReq.pNext = &dedicatedReq;
+    vkGetBufferMemoryRequirements2(m_device, &reqInfo, &memReq);
+    VkMemoryDedicatedAllocateInfo dedicatedInfo = {};
+    dedicatedInfo.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+    dedicatedInfo.buffer = buffer;
+    bool dedicated = dedicatedReq.requiresDedicatedAllocation || dedicatedReq.prefersDedicatedAllocation;
+    MemoryAllocation allocation = allocate(memReq.memoryRequirements, properties, true, dedicated ? &dedicatedInfo : nullptr);
+    vkBindBufferMemory(m_device, buffer, allocation.memory, allocation.offset);
+    return allocation;
+}
+
+MemoryAllocation DeviceMemoryAllocator::allocateForImage(VkImage image, VkMemoryPropertyFlags properties, VkImageTiling tiling) {
+    VkImageMemoryRequirementsInfo2 reqInfo = {};
+    reqInfo.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2;
+    reqInfo.image = image;
+    VkMemoryDedicatedRequirements dedicatedReq = {};
+    dedicatedReq.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+    VkMemoryRequirements2 memReq = {};
+    memReq.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+    memReq.pNext = &dedicatedReq;
+    vkGetImageMemoryRequirements2(m_device, &reqInfo, &memReq);
+    VkMemoryDedicatedAllocateInfo dedicatedInfo = {};
+    dedicatedInfo.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+    dedicatedInfo.image = image;
+    bool dedicated = dedicatedReq.requiresDedicatedAllocation || dedicatedReq.prefersDedicatedAllocation;
+    MemoryAllocation allocation = allocate(memReq.memoryRequirements, properties, tiling == VK_IMAGE_TILING_LINEAR,
+                                           dedicated ? &dedicatedInfo : nullptr);
+    vkBindImageMemory(m_device, image, allocation.memory, allocation.offset);
+    return allocation;
+}
+
+void DeviceMemoryAllocator::free(MemoryAllocation& allocation) {
+    if (allocation.memory == VK_NULL_HANDLE) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (allocation.poolIndex == UINT32_MAX) {
+        vkFreeMemory(m_device, allocation.memory, nullptr);
+        m_deviceMemoryCount--;
+        m_dedicatedCount--;
+        m_dedicatedBytes -= allocation.size;
+    } else {
+        auto& block = m_pools[allocation.poolIndex].blocks[allocation.blockIndex];
+        freeToBlock(*block, allocation.order, allocation.offset);
+        m_requestedBytes -= allocation.size;
+        // 块变空时，若该内存类型已有一块空闲备用块则直接释放，避免峰值过后长期占用显存
+        if (block->allocationCount == 0 && hasSpareBlock(allocation.memoryType, block.get())) {
+            vkFreeMemory(m_device, block->memory, nullptr);
+            block.reset();
+            m_deviceMemoryCount--;
+        }
+    }
+    allocation = MemoryAllocation();
+}
+
+MemoryStats DeviceMemoryAllocator::stats() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    MemoryStats stats = {};
+    for (const auto& pool : m_pools) {
+        for (const auto& block : pool.blocks) {
+            if (!block) {
+                continue;
+            }
+            stats.blockCount++;
+            stats.blockBytes += m_blockSize;
+            stats.allocationCount += block->allocationCount;
+            VkDeviceSize freeBytes = 0;
+            for (uint32_t order = 0; order <= m_blockOrder; order++) {
+                freeBytes += block->freeLists[order].size() << order;
+            }
+            stats.usedBytes += m_blockSize - freeBytes;
+        }
+    }
+    stats.requestedBytes = m_requestedBytes;
+    stats.dedicatedCount = m_dedicatedCount;
+    stats.dedicatedBytes = m_dedicatedBytes;
+    return stats;
+}
+
+void DeviceMemoryAllocator::printStats() const {
+    MemoryStats s = stats();
+    const double MB = 1024.0 * 1024.0;
+    std::cout << "device memory: " << s.blockCount << " blocks (" << s.blockBytes / MB << " MB), "
+              << s.allocationCount << " sub-allocations (" << s.requestedBytes / MB << " MB requested, "
+              << s.usedBytes / MB << " MB used), " << s.dedicatedCount << " dedicated ("
+              << s.dedicatedBytes / MB << " MB)" << std::endl;
+}
@@ -0,0 +1,308 @@
+﻿// FrustumCuller.cpp: BVH视锥剔除的实现
+//
+
+#include "FrustumCuller.h"
+#include <algorithm>
+#include <cmath>
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <limits>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define CULL_SIMD_AVX2
+const static uint32_t CULL_SIMD_WIDTH = 8;
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CULL_SIMD_SSE2
+const static uint32_t CULL_SIMD_WIDTH = 4;
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define CULL_SIMD_NEON
+const static uint32_t CULL_SIMD_WIDTH = 4;
+#else
+const static uint32_t CULL_SIMD_WIDTH = 1;
+#endif
+
+// 遍历栈的深度上限，中位数划分的BVH深度约为log2(物体数量 / LEAF_SIZE)
+const static uint32_t MAX_CULL_DEPTH = 64;
+
+const char* FrustumCuller::simdPath() {
+#if defined(CULL_SIMD_AVX2)
+    return "avx2";
+#elif defined(CULL_SIMD_SSE2)
+    return "sse2";
+#elif defined(CULL_SIMD_NEON)
+    return "neon";
+#else
+    return "scalar";
+#endif
+}
+
+void FrustumCuller::extractPlanes(const glm::mat4& viewProj, glm::vec4 planes[6]) {
+    // glm按列存储，row(i)为矩阵的第i行；裁剪空间中0 <= z <= w，近平面即第三行本身
+    auto row = [&](int i) { return glm::vec4(viewProj[0][i], viewProj[1][i], viewProj[2][i], viewProj[3][i]); };
+    planes[0] = row(3) + row(0);
+    planes[1] = row(3) - row(0);
+    planes[2] = row(3) + row(1);
+    planes[3] = row(3) - row(1);
+    planes[4] = row(2);
+    planes[5] = row(3) - row(2);
+    for (int i = 0; i < 6; i++) {
+        planes[i] /= glm::length(glm::vec3(planes[i]));
+    }
+}
+
+MeshBounds FrustumCuller::transformBounds(const glm::mat4& transform, const MeshBounds& bounds) {
+    // 中心按矩阵变换，半长取各列绝对值的加权和，与cull.comp中的计算相同
+    glm::vec3 center = (bounds.min + bounds.max) * 0.5f;
+    glm::vec3 extent = (bounds.max - bounds.min) * 0.5f;
+    glm::vec3 worldCenter = glm::vec3(transform * glm::vec4(center, 1.0f));
+    glm::vec3 worldExtent = glm::abs(glm::vec3(transform[0])) * extent.x + glm::abs(glm::vec3(transform[1])) * extent.y
+                            + glm::abs(glm::vec3(transform[2])) * extent.z;
+    return {worldCenter - worldExtent, worldCenter + worldExtent};
+}
+
+// 包围盒完全在平面外侧时返回false；d与r的计算顺序在标量、SIMD与参考实现中保持一致，结果逐个相同
+static bool intersectsPlane(const glm::vec4& plane, const float center[3], const float extent[3], bool* inside) {
+    float d = plane.x * center[0] + plane.y * center[1] + plane.z * center[2] + plane.w;
+    float r = std::abs(plane.x) * extent[0] + std::abs(plane.y) * extent[1] + std::abs(plane.z) * extent[2];
+    if (inside) {
+        *inside = d - r >= 0.0f;
+    }
+    return d + r >= 0.0f;
+}
+
+struct FrustumCuller::BuildEntry {
+    glm::vec3 centroid;
+    uint32_t object;
+};
+
+void FrustumCuller::build(const std::vector<MeshBounds>& bounds) {
+    uint32_t count = static_cast<uint32_t>(bounds.size());
+    m_nodes.clear();
+    m_order.resize(count);
+    if (count > 0) {
+        std::vector<BuildEntry> entries(count);
+        for (uint32_t i = 0; i < count; i++) {
+            entries[i] = {(bounds[i].min + bounds[i].max) * 0.5f, i};
+        }
+        m_nodes.reserve(2 * (count / LEAF_SIZE + 1));
+        MeshBounds rootBounds;
+        buildNode(0, count, bounds, entries, rootBounds);
+        for (uint32_t i = 0; i < count; i++) {
+            m_order[i] = entries[i].object;
+        }
+    }
+    // 按重排后的顺序写入SoA，填充部分的中心与半长为0，只会被掩码丢弃
+    for (auto* array : {&m_centerX, &m_centerY, &m_centerZ, &m_extentX, &m_extentY, &m_extentZ}) {
+        array->assign(count + CULL_SIMD_WIDTH, 0.0f);
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        const MeshBounds& box = bounds[m_order[i]];
+        glm::vec3 center = (box.min + box.max) * 0.5f;
+        glm::vec3 extent = (box.max - box.min) * 0.5f;
+        m_centerX[i] = center.x;
+        m_centerY[i] = center.y;
+        m_centerZ[i] = center.z;
+        m_extentX[i] = extent.x;
+        m_extentY[i] = extent.y;
+        m_extentZ[i] = extent.z;
+    }
+}
+
+uint32_t FrustumCuller::buildNode(uint32_t first, uint32_t count, const std::vector<MeshBounds>& bounds,
+                                  std::vector<BuildEntry>& entries, MeshBounds& nodeBounds) {
+    uint32_t index = static_cast<uint32_t>(m_nodes.size());
+    m_nodes.emplace_back();
+    Node node = {};
+    node.first = first;
+    node.count = count;
+    node.right = 0;
+    if (count > LEAF_SIZE) {
+        // 沿中心点分布最长的轴按中位数划分，两侧物体数量相同，树的深度有保证
+        glm::vec3 centroidMin(std::numeric_limits<float>::max());
+        glm::vec3 centroidMax(std::numeric_limits<float>::lowest());
+        for (uint32_t i = first; i < first + count; i++) {
+            centroidMin = glm::min(centroidMin, entries[i].centroid);
+            centroidMax = glm::max(centroidMax, entries[i].centroid);
+        }
+        glm::vec3 spread = centroidMax - centroidMin;
+        int axis = spread.x >= spread.y && spread.x >= spread.z ? 0 : (spread.y >= spread.z ? 1 : 2);
+        uint32_t half = count / 2;
+        std::nth_element(entries.begin() + first, entries.begin() + first + half, entries.begin() + first + count,
+                         [axis](const BuildEntry& a, const BuildEntry& b) { return a.centroid[axis] < b.centroid[axis]; });
+        MeshBounds leftBounds, rightBounds;
+        buildNode(first, half, bounds, entries, leftBounds);
+        node.right = buildNode(first + half, count - half, bounds, entries, rightBounds);
+        // 父节点的包围盒由子节点合并，只有叶节点访问物体的包围盒
+        nodeBounds.min = glm::min(leftBounds.min, rightBounds.min);
+        nodeBounds.max = glm::max(leftBounds.max, rightBounds.max);
+    } else {
+        nodeBounds.min = glm::vec3(std::numeric_limits<float>::max());
+        nodeBounds.max = glm::vec3(std::numeric_limits<float>::lowest());
+        for (uint32_t i = first; i < first + count; i++) {
+            const MeshBounds& box = bounds[entries[i].object];
+            nodeBounds.min = glm::min(nodeBounds.min, box.min);
+            nodeBounds.max = glm::max(nodeBounds.max, box.max);
+        }
+    }
+    for (int axis = 0; axis < 3; axis++) {
+        node.center[axis] = (nodeBounds.min[axis] + nodeBounds.max[axis]) * 0.5f;
+        node.extent[axis] = (nodeBounds.max[axis] - nodeBounds.min[axis]) * 0.5f;
+    }
+    m_nodes[index] = node; // 递归中m_nodes可能重新分配，最后再写入
+    return index;
+}
+
+void FrustumCuller::cull(const glm::vec4 planes[6], std::vector<uint32_t>& visible) const {
+    visible.clear();
+    if (m_nodes.empty()) {
+        return;
+    }
+    struct StackEntry {
+        uint32_t node;
+        uint32_t planeMask; // 父节点仍与之相交的平面，其余平面对整棵子树都成立
+    };
+    StackEntry stack[MAX_CULL_DEPTH];
+    uint32_t top = 0;
+    stack[top++] = {0, (1u << 6) - 1};
+    while (top > 0) {
+        StackEntry entry = stack[--top];
+        const Node& node = m_nodes[entry.node];
+        uint32_t planeMask = entry.planeMask;
+        bool outside = false;
+        for (int p = 0; p < 6; p++) {
+            if (!(planeMask & (1u << p))) {
+                continue;
+            }
+            bool inside = false;
+            if (!intersectsPlane(planes[p], node.center, node.extent, &inside)) {
+                outside = true;
+                break;
+            }
+            if (inside) {
+                planeMask &= ~(1u << p);
+            }
+        }
+        if (outside) {
+            continue;
+        }
+        if (planeMask == 0) { // 整棵子树在视锥内，不再逐个测试
+            visible.insert(visible.end(), m_order.begin() + node.first, m_order.begin() + node.first + node.count);
+        } else if (node.right == 0) {
+            cullLeaf(node.first, node.count, planes, planeMask, visible);
+        } else {
+            stack[top++] = {node.right, planeMask};
+            stack[top++] = {entry.node + 1, planeMask};
+        }
+    }
+}
+
+void FrustumCuller::cullLeaf(uint32_t first, uint32_t count, const glm::vec4 planes[6], uint32_t planeMask,
+                             std::vector<uint32_t>& visible) const {
+    uint32_t end = first + count;
+    for (uint32_t base = first; base < end; base += CULL_SIMD_WIDTH) {
+        uint32_t lanes = std::min(CULL_SIMD_WIDTH, end - base);
+        uint32_t laneMask = (1u << lanes) - 1;
+#if defined(CULL_SIMD_AVX2)
+        __m256 cx = _mm256_loadu_ps(&m_centerX[base]);
+        __m256 cy = _mm256_loadu_ps(&m_centerY[base]);
+        __m256 cz = _mm256_loadu_ps(&m_centerZ[base]);
+        __m256 ex = _mm256_loadu_ps(&m_extentX[base]);
+        __m256 ey = _mm256_loadu_ps(&m_extentY[base]);
+        __m256 ez = _mm256_loadu_ps(&m_extentZ[base]);
+        __m256 zero = _mm256_setzero_ps();
+        for (int p = 0; p < 6 && laneMask != 0; p++) {
+            if (!(planeMask & (1u << p))) {
+                continue;
+            }
+            const glm::vec4& plane = planes[p];
+            __m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane.x), cx),
+                                                                 _mm256_mul_ps(_mm256_set1_ps(plane.y), cy)),
+                                                   _mm256_mul_ps(_mm256_set1_ps(plane.z), cz)),
+                                     _mm256_set1_ps(plane.w));
+            __m256 r = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(std::abs(plane.x)), ex),
+                                                   _mm256_mul_ps(_mm256_set1_ps(std::abs(plane.y)), ey)),
+                                     _mm256_mul_ps(_mm256_set1_ps(std::abs(plane.z)), ez));
+            laneMask &= static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(_mm256_add_ps(d, r), zero, _CMP_GE_OQ)));
+        }
+#elif defined(CULL_SIMD_SSE2)
+        __m128 cx = _mm_loadu_ps(&m_centerX[base]);
+        __m128 cy = _mm_loadu_ps(&m_centerY[base]);
+        __m128 cz = _mm_loadu_ps(&m_centerZ[base]);
+        __m128 ex = _mm_loadu_ps(&m_extentX[base]);
+        __m128 ey = _mm_loadu_ps(&m_extentY[base]);
+        __m128 ez = _mm_loadu_ps(&m_extentZ[base]);
+        __m128 zero = _mm_setzero_ps();
+        for (int p = 0; p < 6 && laneMask != 0; p++) {
+            if (!(planeMask & (1u << p))) {
+                continue;
+            }
+            const glm::vec4& plane = planes[p];
+            __m128 d = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.x), cx),
+                                                        _mm_mul_ps(_mm_set1_ps(plane.y), cy)),
+                                             _mm_mul_ps(_mm_set1_ps(plane.z), cz)),
+                                  _mm_set1_ps(plane.w));
+            __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(std::abs(plane.x)), ex),
+                                             _mm_mul_ps(_mm_set1_ps(std::abs(plane.y)), ey)),
+                                  _mm_mul_ps(_mm_set1_ps(std::abs(plane.z)), ez));
+            laneMask &= static_cast<uint32_t>(_mm_movemask_ps(_mm_cmpge_ps(_mm_add_ps(d, r), zero)));
+        }
+#elif defined(CULL_SIMD_NEON)
+        float32x4_t cx = vld1q_f32(&m_centerX[base]);
+        float32x4_t cy = vld1q_f32(&m_centerY[base]);
+        float32x4_t cz = vld1q_f32(&m_centerZ[base]);
+        float32x4_t ex = vld1q_f32(&m_extentX[base]);
+        float32x4_t ey = vld1q_f32(&m_extentY[base]);
+        float32x4_t ez = vld1q_f32(&m_extentZ[base]);
+        uint32x4_t result = vdupq_n_u32(0xffffffffu);
+        for (int p = 0; p < 6; p++) {
+            if (!(planeMask & (1u << p))) {
+                continue;
+            }
+            const glm::vec4& plane = planes[p];
+            float32x4_t d = vaddq_f32(vaddq_f32(vaddq_f32(vmulq_n_f32(cx, plane.x), vmulq_n_f32(cy, plane.y)),
+                                                vmulq_n_f32(cz, plane.z)),
+                                      vdupq_n_f32(plane.w));
+            float32x4_t r = vaddq_f32(vaddq_f32(vmulq_n_f32(ex, std::abs(plane.x)), vmulq_n_f32(ey, std::abs(plane.y))),
+                                      vmulq_n_f32(ez, std::abs(plane.z)));
+            result = vandq_u32(result, vcgeq_f32(vaddq_f32(d, r), vdupq_n_f32(0.0f)));
+        }
+        uint32_t bits = (vgetq_lane_u32(result, 0) & 1) | (vgetq_lane_u32(result, 1) & 2)
+                        | (vgetq_lane_u32(result, 2) & 4) | (vgetq_lane_u32(result, 3) & 8);
+        laneMask &= bits;
+#else
+        float center[3] = {m_centerX[base], m_centerY[base], m_centerZ[base]};
+        float extent[3] = {m_extentX[base], m_extentY[base], m_extentZ[base]};
+        for (int p = 0; p < 6 && laneMask != 0; p++) {
+            if ((planeMask & (1u << p)) && !intersectsPlane(planes[p], center, extent, nullptr)) {
+                laneMask = 0;
+            }
+        }
+#endif
+        for (uint32_t lane = 0; lane < lanes; lane++) {
+            if (laneMask & (1u << lane)) {
+                visible.push_back(m_order[base + lane]);
+            }
+        }
+    }
+}
+
+void FrustumCuller::cullReference(const std::vector<MeshBounds>& bounds, const glm::vec4 planes[6],
+                                  std::vector<uint32_t>& visible) {
+    visible.clear();
+    for (uint32_t i = 0; i < static_cast<uint32_t>(bounds.size()); i++) {
+        glm::vec3 center = (bounds[i].min + bounds[i].max) * 0.5f;
+        glm::vec3 extent = (bounds[i].max - bounds[i].min) * 0.5f;
+        float centerArray[3] = {center.x, center.y, center.z};
+        float extentArray[3] = {extent.x, extent.y, extent.z};
+        bool inFrustum = true;
+        for (int p = 0; p < 6 && inFrustum; p++) {
+            inFrustum = intersectsPlane(planes[p], centerArray, extentArray, nullptr);
+        }
+        if (inFrustum) {
+            visible.push_back(i);
+        }
+    }
+}
@@ -0,0 +1,265 @@
+﻿// GpuProfiler.cpp: 时间戳查询的写入、非阻塞读取与统计
+//
+#include "GpuProfiler.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <stdexcept>
+
+void GpuProfiler::init(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t graphicsFamily,
+                       uint32_t frameCount, size_t historySize) {
+    m_device = device;
+    m_graphicsFamily = graphicsFamily;
+    m_frameCount = frameCount;
+    m_historySize = std::max<size_t>(historySize, 1);
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    m_timestampPeriod = properties.limits.timestampPeriod;
+
+    uint32_t familyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> families(familyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, families.data());
+    m_familyMasks.resize(familyCount);
+    for (uint32_t i = 0; i < familyCount; i++) {
+        uint32_t bits = families[i].timestampValidBits;
+        m_familyMasks[i] = bits >= 64 ? ~0ull : (1ull << bits) - 1;
+    }
+    if (!supportsFamily(graphicsFamily)) {
+        throw std::runtime_error("gpu profiling requires timestamp queries on the graphics queue!");
+    }
+
+    m_oneShotBase = frameCount * MAX_SCOPES * 2;
+    uint32_t queryCount = m_oneShotBase + ONE_SHOT_PAIRS * 2;
+    VkQueryPoolCreateInfo createInfo = {};
+    createInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    createInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    createInfo.queryCount = queryCount;
+    if (vkCreateQueryPool(device, &createInfo, nullptr, &m_queryPool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create query pool!");
+    }
+    // 查询在第一次使用前必须重置，之后每次读取完再由主机端重置，指令缓冲中不需要重置指令
+    vkResetQueryPool(device, m_queryPool, 0, queryCount);
+    m_freeOneShots.clear();
+    for (uint32_t i = ONE_SHOT_PAIRS; i > 0; i--) {
+        m_freeOneShots.push_back(m_oneShotBase + (i - 1) * 2);
+    }
+}
+
+void GpuProfiler::destroy() {
+    if (m_queryPool != VK_NULL_HANDLE) {
+        vkDestroyQueryPool(m_device, m_queryPool, nullptr);
+        m_queryPool = VK_NULL_HANDLE;
+    }
+    m_pendingOneShots.clear();
+    m_freeOneShots.clear();
+}
+
+bool GpuProfiler::supportsFamily(uint32_t family) const {
+    return family < m_familyMasks.size() && m_familyMasks[family] != 0;
+}
+
+uint32_t GpuProfiler::scope(const std::string& name) {
+    if (!enabled()) {
+        return INVALID_QUERY;
+    }
+    for (uint32_t i = 0; i < m_scopes.size(); i++) {
+        if (m_scopes[i].name == name) {
+            return i;
+        }
+    }
+    if (m_scopes.size() >= MAX_SCOPES) {
+        throw std::runtime_error("too many gpu profiler scopes!");
+    }
+    m_scopes.emplace_back();
+    m_scopes.back().name = name;
+    m_scopes.back().history.reserve(m_historySize);
+    return static_cast<uint32_t>(m_scopes.size() - 1);
+}
+
+void GpuProfiler::beginScope(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t scope) {
+    if (!enabled() || scope == INVALID_QUERY) {
+        return;
+    }
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_queryPool,
+                        (frameIndex * MAX_SCOPES + scope) * 2);
+}
+
+void GpuProfiler::endScope(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t scope) {
+    if (!enabled() || scope == INVALID_QUERY) {
+        return;
+    }
+    // 之前的所有指令执行完毕后才写入
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_queryPool,
+                        (frameIndex * MAX_SCOPES + scope) * 2 + 1);
+}
+
+uint32_t GpuProfiler::beginOneShot(VkCommandBuffer commandBuffer, uint32_t family, uint32_t scope) {
+    if (!enabled() || scope == INVALID_QUERY || !supportsFamily(family)) {
+        return INVALID_QUERY;
+    }
+    collectOneShots();
+    if (m_freeOneShots.empty()) { // 之前的批次还没有完成，丢弃这次样本而不是等待
+        return INVALID_QUERY;
+    }
+    uint32_t query = m_freeOneShots.back();
+    m_freeOneShots.pop_back();
+    m_pendingOneShots.push_back({query, scope, m_familyMasks[family]});
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_queryPool, query);
+    return query;
+}
+
+void GpuProfiler::endOneShot(VkCommandBuffer commandBuffer, uint32_t query) {
+    if (!enabled() || query == INVALID_QUERY) {
+        return;
+    }
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_queryPool, query + 1);
+}
+
+void GpuProfiler::collect(uint32_t frameIndex) {
+    if (!enabled()) {
+        return;
+    }
+    uint32_t scopeCount = static_cast<uint32_t>(m_scopes.size());
+    if (scopeCount > 0) {
+        // 每个查询的结果之后跟着可用标志，没有写入的区间(如本帧未执行的剔除)不可用，直接跳过
+        uint64_t results[MAX_SCOPES * 4];
+        uint32_t firstQuery = frameIndex * MAX_SCOPES * 2;
+        VkResult res = vkGetQueryPoolResults(m_device, m_queryPool, firstQuery, scopeCount * 2,
+                                             sizeof(uint64_t) * 4 * scopeCount, results, sizeof(uint64_t) * 2,
+                                             VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+        if (res != VK_SUCCESS && res != VK_NOT_READY) {
+            throw std::runtime_error("failed to get query pool results!");
+        }
+        for (uint32_t i = 0; i < scopeCount; i++) {
+            const uint64_t* pair = results + i * 4;
+            if (pair[1] != 0 && pair[3] != 0) {
+                addSample(i, pair[0], pair[2], m_familyMasks[m_graphicsFamily]);
+            }
+        }
+        vkResetQueryPool(m_device, m_queryPool, firstQuery, scopeCount * 2);
+    }
+    collectOneShots();
+}
+
+void GpuProfiler::collectAll() {
+    for (uint32_t i = 0; i < m_frameCount; i++) {
+        collect(i);
+    }
+}
+
+void GpuProfiler::resetSamples() {
+    for (Scope& scope : m_scopes) {
+        scope.history.clear();
+        scope.next = 0;
+        scope.total = 0;
+    }
+}
+
+void GpuProfiler::collectOneShots() {
+    for (size_t i = 0; i < m_pendingOneShots.size();) {
+        const OneShot& oneShot = m_pendingOneShots[i];
+        uint64_t results[4];
+        VkResult res = vkGetQueryPoolResults(m_device, m_queryPool, oneShot.query, 2, sizeof(results), results,
+                                             sizeof(uint64_t) * 2,
+                                             VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+        if (res != VK_SUCCESS && res != VK_NOT_READY) {
+            throw std::runtime_error("failed to get query pool results!");
+        }
+        if (results[1] == 0 || results[3] == 0) { // 批次还在执行
+            i++;
+            continue;
+        }
+        addSample(oneShot.scope, results[0], results[2], oneShot.mask);
+        vkResetQueryPool(m_device, m_queryPool, oneShot.query, 2);
+        m_freeOneShots.push_back(oneShot.query);
+        m_pendingOneShots[i] = m_pendingOneShots.back();
+        m_pendingOneShots.pop_back();
+    }
+}
+
+void GpuProfiler::addSample(uint32_t scope, uint64_t begin, uint64_t end, uint64_t mask) {
+    // 有效位之外的高位未定义，按有效位回绕计算差值
+    double ms = static_cast<double>((end - begin) & mask) * m_timestampPeriod / 1e6;
+    Scope& target = m_scopes[scope];
+    if (target.history.size() < m_historySize) {
+        target.history.push_back(ms);
+    } else {
+        target.history[target.next] = ms;
+    }
+    target.next = (target.next + 1) % m_historySize;
+    target.total++;
+}
+
+GpuScopeStats GpuProfiler::computeStats(const Scope& scope) const {
+    GpuScopeStats result = {scope.name, scope.total, scope.history.size(), 0.0, 0.0, 0.0, 0.0};
+    if (scope.history.empty()) {
+        return result;
+    }
+    std::vector<double> sorted(scope.history);
+    std::sort(sorted.begin(), sorted.end());
+    double sum = 0.0;
+    for (double ms : sorted) {
+        sum += ms;
+    }
+    size_t p99 = static_cast<size_t>(std::ceil(sorted.size() * 0.99)) - 1;
+    result.minMs = sorted.front();
+    result.avgMs = sum / sorted.size();
+    result.p99Ms = sorted[p99];
+    result.maxMs = sorted.back();
+    return result;
+}
+
+std::vector<GpuScopeStats> GpuProfiler::stats() const {
+    std::vector<GpuScopeStats> result;
+    for (const Scope& scope : m_scopes) {
+        result.push_back(computeStats(scope));
+    }
+    return result;
+}
+
+bool GpuProfiler::stats(const std::string& name, GpuScopeStats& result) const {
+    for (const Scope& scope : m_scopes) {
+        if (scope.name == name && !scope.history.empty()) {
+            result = computeStats(scope);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool GpuProfiler::samples(const std::string& name, std::vector<double>& result) const {
+    for (const Scope& scope : m_scopes) {
+        if (scope.name == name && !scope.history.empty()) {
+            // 环形缓冲写满后最早的样本位于next
+            result.assign(scope.history.begin() + scope.next % scope.history.size(), scope.history.end());
+            result.insert(result.end(), scope.history.begin(), scope.history.begin() + scope.next % scope.history.size());
+            return true;
+        }
+    }
+    return false;
+}
+
+void GpuProfiler::print(std::ostream& out) const {
+    for (const GpuScopeStats& scope : stats()) {
+        if (scope.windowSamples == 0) {
+            continue;
+        }
+        out << "gpu: " << scope.name << " min " << scope.minMs << " ms, avg " << scope.avgMs << " ms, p99 "
+            << scope.p99Ms << " ms (last " << scope.windowSamples << " of " << scope.totalSamples << " samples)"
+            << std::endl;
+    }
+}
+
+bool GpuProfiler::exportCsv(const std::string& path) const {
+    std::ofstream file(path);
+    if (!file.is_open()) {
+        return false;
+    }
+    file << "scope,total_samples,window_samples,min_ms,avg_ms,p99_ms,max_ms\n";
+    for (const GpuScopeStats& scope : stats()) {
+        file << scope.name << ',' << scope.totalSamples << ',' << scope.windowSamples << ',' << scope.minMs << ','
+             << scope.avgMs << ',' << scope.p99Ms << ',' << scope.maxMs << '\n';
+    }
+    return file.good();
+}
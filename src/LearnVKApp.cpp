@@ -1,55 +1,178 @@
-﻿// LearnVK.cpp: 定义应用程序的入口点。
+﻿// LearnVKApp.cpp: 渲染器的实现，入口点在main.cpp。
 //
+#define TINYOBJLOADER_IMPLEMENTATION // 实现只在这一个编译单元中展开，stb_image的实现在TextureLoader.cpp中
 #include "LearnVKApp.h"
 #include "vulkan/vulkan_core.h"
+#include <cassert>
+#include <cfloat>
 #include <cmath>
+#include <cstring>
 #include <stdexcept>
-#include <unordered_map>
+
+// 只在本编译单元中使用的辅助函数，不放在头文件中，避免包含LearnVKApp.h的main.cpp等出现未使用的静态函数
+static bool hasStencilComponent(VkFormat format) {
+    return (format == VK_FORMAT_D24_UNORM_S8_UINT) || (format == VK_FORMAT_D32_SFLOAT_S8_UINT);
+}
+
+// BC格式按4x4的块存放，一行块覆盖4行像素
+static bool isBlockCompressedFormat(VkFormat format) {
+    return format >= VK_FORMAT_BC1_RGB_UNORM_BLOCK && format <= VK_FORMAT_BC7_SRGB_BLOCK;
+}
+
+static VkSurfaceFormatKHR
+chooseBestfitSurfaceFormat(std::vector<VkSurfaceFormatKHR>& formats);
+
+static VkPresentModeKHR
+chooseBestfitPresentMode(std::vector<VkPresentModeKHR>& presentModes);
+
+static VkResult createDebugUtilsMessengerEXT(
+    VkInstance instance, const VkDebugUtilsMessengerCreateInfoEXT* pCreateInfo,
+    const VkAllocationCallbacks* pAllocator,
+    VkDebugUtilsMessengerEXT* pCallback);
+
+static void
+destroyDebugUtilsMessengerEXT(VkInstance instance,
+                              VkDebugUtilsMessengerEXT* pCallback,
+                              const VkAllocationCallbacks* pAllocator);
+
+static std::vector<char> readFile(const std::string& filename);
 
 bool LearnVKApp::s_framebufferResized = false;
+
+LearnVKApp::LearnVKApp(const AppConfig& config) :
+    m_config(config) {
+    if (m_config.headless) {
+        m_deviceExtentions.clear(); // 离屏渲染不需要交换链扩展
+    }
+}
+
 void LearnVKApp::run() { // 开始运行程序
-    initWindows();
+    if (!m_config.headless) {
+        m_startupProfiler.measure("window", [this]() { initWindows(); });
+    }
     initVK();
-    loop();
+    if (m_config.headless) {
+        headlessLoop();
+    } else {
+        loop();
+    }
     clear();
 }
 
 void LearnVKApp::initWindows() { // 初始化glfw
     glfwInit();
     glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-    m_window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, "LearnVK", nullptr,
+    m_window = glfwCreateWindow(m_config.width, m_config.height, "LearnVK", nullptr,
                                 nullptr);
     glfwSetFramebufferSizeCallback(m_window, frameBufferResizeCallback);
 }
 
 void LearnVKApp::initVK() { // 初始化Vulkan的设备
-    createVKInstance();
-    setupDebugCallback();
-    createSurface();
-    pickPhysicalDevice();
-    createLogicalDevice();
-    createSwapChain();
-    createImageViews();
-    createRenderPass();
-    createDescriptorSetLayout();
-    createGraphicsPipeline();
-    createCommandPool();
-    createColorResources();
-    createDepthResources();
-    createFrameBuffers();
-    loadModel("viking_room/viking_room.obj");
-    createTextureImage("viking_room/viking_room.png");
-    createTextureImageView();
-    createTextureSampler();
-    createLocalBuffer(g_vertices, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-                      m_vertexBuffer, m_vertexBufferMemory);
-    createLocalBuffer(g_indices, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, m_indexBuffer,
-                      m_indexBufferMemory);
-    createUniformBuffers();
-    createDescriptorPool();
-    createDescriptorSets();
-    createCommandBuffers();
-    createSyncObjects();
+    // 启动的依赖关系：模型解析与纹理解码只需要CPU，在工作线程上与主线程的实例、设备、交换链创建同时进行；
+    // 紧凑顶点的纹理坐标格式由模型数据决定，模型在创建管线之前汇合；解码后的纹理在上传之前汇合，
+    // 所有GPU上传最后在一次flush中提交。流式加载时模型与纹理都不在这里等待，只创建占位纹理
+    std::promise<void> modelLoaded;
+    std::future<void> modelReady = modelLoaded.get_future();
+    std::future<std::vector<DecodedImage>> texturesReady;
+    if (!m_config.stream) {
+        texturesReady = m_threadPool.submit([this, &modelLoaded]() {
+            try {
+                m_startupProfiler.measure("load model", [this]() {
+                    auto mesh = std::make_unique<MeshData>();
+                    loadModel(m_config.model, *mesh);
+                    adoptMesh(std::move(mesh));
+                });
+            } catch (...) {
+                modelLoaded.set_exception(std::current_exception());
+                throw;
+            }
+            modelLoaded.set_value();
+            std::vector<DecodedImage> decoded;
+            m_startupProfiler.measure("decode textures", [&]() { decoded = decodeMaterialTextures(); });
+            return decoded;
+        });
+    }
+    std::vector<DecodedImage> decoded;
+    try {
+        m_startupProfiler.measure("instance", [this]() {
+            createVKInstance();
+            setupDebugCallback();
+            if (!m_config.headless) {
+                createSurface();
+            }
+        });
+        m_startupProfiler.measure("device", [this]() {
+            pickPhysicalDevice();
+            createLogicalDevice();
+        });
+        m_startupProfiler.measure("pipeline cache",
+                                  [this]() { m_pipelineCache.init(m_physicalDevice, m_device, PipelineCache::defaultPath()); });
+        m_startupProfiler.measure("swapchain", [this]() {
+            if (m_config.headless) {
+                createOffscreenTargets(); // 离屏模式下用自己创建的图像代替交换链
+            } else {
+                createSwapChain();
+            }
+            createImageViews();
+            createRenderPass();
+            createDescriptorSetLayout();
+        });
+        if (!m_config.stream) {
+            m_startupProfiler.measure("wait for model", [&]() { modelReady.get(); });
+        }
+        m_startupProfiler.measure("pipelines", [this]() {
+            createGraphicsPipeline();
+            createCullPipeline();
+        });
+        m_startupProfiler.measure("attachments", [this]() {
+            createCommandPool();
+            createColorResources();
+            createDepthResources();
+            createFrameBuffers();
+        });
+        if (!m_config.stream) {
+            m_startupProfiler.measure("wait for textures", [&]() { decoded = texturesReady.get(); });
+        }
+    } catch (...) { // 后台任务引用了本函数的局部变量，先等待它结束
+        if (texturesReady.valid()) {
+            texturesReady.wait();
+        }
+        throw;
+    }
+    m_startupProfiler.measure("upload textures", [&]() {
+        if (m_config.stream) {
+            createPlaceholderTexture();
+        } else {
+            createTextureImages(decoded);
+            createTextureImageViews();
+        }
+        createTextureSampler();
+    });
+    m_startupProfiler.measure("scene buffers", [this]() {
+        if (!m_config.stream) {
+            createMeshBuffers();
+            createObjectBuffers();
+        }
+        createUniformBuffers();
+        createDescriptorPool();
+        createDescriptorSets();
+    });
+    m_startupProfiler.measure("command buffers", [this]() {
+        createCommandBuffers();
+        createCachedCommandBuffers();
+        createRecordPools();
+        createSyncObjects();
+    });
+    m_startupProfiler.measure("upload flush", [this]() {
+        m_uploadContext.flush(); // 以上所有的拷贝、布局转换与mipmap生成在这里一次提交
+    });
+    std::cout << "upload: " << m_uploadContext.submitCount() << " submissions during init" << std::endl;
+    m_allocator.printStats();
+    if (m_config.stream) {
+        startStreaming();
+    } else {
+        m_sceneReady = true;
+    }
 }
 
 void LearnVKApp::createVKInstance() {
@@ -65,7 +188,7 @@ void LearnVKApp::createVKInstance() {
     appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
     appInfo.pEngineName = "No Engine";
     appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-    appInfo.apiVersion = VK_API_VERSION_1_0;
+    appInfo.apiVersion = VK_API_VERSION_1_2; // 纹理数组需要1.2核心的descriptor indexing
 
     // 填写Vulkan实例创建信息
     VkInstanceCreateInfo createInfo = {};
@@ -142,11 +265,13 @@ void LearnVKApp::frameBufferResizeCallback(GLFWwindow* window, int width,
 
 // 获取glfw和校验层的扩展
 std::vector<const char*> LearnVKApp::getRequiredExtentions() {
-    uint32_t glfwExtentionCount = 0;
-    const char** glfwExtentionName;
-    glfwExtentionName = glfwGetRequiredInstanceExtensions(&glfwExtentionCount);
-    std::vector<const char*> extentionList(
-        glfwExtentionName, glfwExtentionName + glfwExtentionCount);
+    std::vector<const char*> extentionList;
+    if (!m_config.headless) { // 离屏模式下没有初始化glfw，也不需要窗口系统扩展
+        uint32_t glfwExtentionCount = 0;
+        const char** glfwExtentionName;
+        glfwExtentionName = glfwGetRequiredInstanceExtensions(&glfwExtentionCount);
+        extentionList.assign(glfwExtentionName, glfwExtentionName + glfwExtentionCount);
+    }
     if (enableValidationLayers) {
         extentionList.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
     }
@@ -257,18 +382,17 @@ void LearnVKApp::createSwapChain() {
     createInfo.imageExtent = extent;
     createInfo.imageFormat = surfaceFormat.format;
     createInfo.imageColorSpace = surfaceFormat.colorSpace;
-    createInfo.oldSwapchain = m_swapChain; // 允许重建交换链在渲染时进行
 
     QueueFamiliyIndices queueFamilyIndices =
         findDeviceQueueFamilies(m_physicalDevice);
     auto familyIndicesSet = queueFamilyIndices.familiesIndexSet;
+    // 队列族索引需要在vkCreateSwapchainKHR调用时仍然有效，不能指向临时对象
+    std::vector<uint32_t> familyIndices(familyIndicesSet.begin(), familyIndicesSet.end());
     if (familyIndicesSet.size() != 1) { // 存在多个队列族就会出现并发申请图片资源的问题
         createInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
         createInfo.queueFamilyIndexCount =
-            static_cast<uint32_t>(familyIndicesSet.size());
-        createInfo.pQueueFamilyIndices =
-            std::vector<uint32_t>(familyIndicesSet.begin(), familyIndicesSet.end())
-                .data();
+            static_cast<uint32_t>(familyIndices.size());
+        createInfo.pQueueFamilyIndices = familyIndices.data();
     } else {
         createInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
         createInfo.queueFamilyIndexCount =
@@ -280,14 +404,19 @@ void LearnVKApp::createSwapChain() {
     createInfo.compositeAlpha =
         VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR; // 窗口透明混合策略
     createInfo.presentMode = presentMode;
-    createInfo.clipped = VK_TRUE;             // 允许被遮挡像素剔除
-    createInfo.oldSwapchain = VK_NULL_HANDLE; // 重建交换链时用于指定之前的交换链
+    createInfo.clipped = VK_TRUE;           // 允许被遮挡像素剔除
+    createInfo.oldSwapchain = m_swapChain; // 重建交换链时用于指定之前的交换链，驱动可以复用其资源
 
+    VkSwapchainKHR swapChain;
     VkResult res =
-        vkCreateSwapchainKHR(m_device, &createInfo, nullptr, &m_swapChain);
+        vkCreateSwapchainKHR(m_device, &createInfo, nullptr, &swapChain);
     if (res != VK_SUCCESS) {
         throw std::runtime_error("failed to create swap chain!");
     }
+    if (m_swapChain != VK_NULL_HANDLE) { // 旧交换链已经退役，调用者保证其图像不再被使用
+        vkDestroySwapchainKHR(m_device, m_swapChain, nullptr);
+    }
+    m_swapChain = swapChain;
     uint32_t imgCount = 0;
     // 获取交换链图像的句柄
     vkGetSwapchainImagesKHR(m_device, m_swapChain, &imgCount, nullptr);
@@ -298,6 +427,23 @@ void LearnVKApp::createSwapChain() {
     m_swapChainImageExtent = extent;
 }
 
+void LearnVKApp::createOffscreenTargets() {
+    // 每一个预渲染帧一张解析目标图像，drawFrame直接使用当前帧的序号作为图像序号
+    m_swapChainImageFormat = findSupportedFormat(
+        {VK_FORMAT_R8G8B8A8_SRGB, VK_FORMAT_B8G8R8A8_SRGB},
+        VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT);
+    m_swapChainImageExtent = {m_config.width, m_config.height};
+    m_swapChainImages.resize(MAX_FRAMES_IN_FLIGHT);
+    m_offscreenImageMemories.resize(MAX_FRAMES_IN_FLIGHT);
+    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        createImage(m_swapChainImageExtent.width, m_swapChainImageExtent.height, 1,
+                    VK_SAMPLE_COUNT_1_BIT, m_swapChainImageFormat, VK_IMAGE_TILING_OPTIMAL,
+                    VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, // 保留读回结果的可能
+                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_swapChainImages[i],
+                    m_offscreenImageMemories[i]);
+    }
+}
+
 void LearnVKApp::createImageViews() {
     m_swapChainImageViews.resize(m_swapChainImages.size());
     for (int i = 0; i < m_swapChainImages.size(); i++) {
@@ -358,7 +504,8 @@ void LearnVKApp::createRenderPass() {
     colorAttachmentResolve.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     colorAttachmentResolve.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     colorAttachmentResolve.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachmentResolve.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR; // 转换为presentKHR
+    colorAttachmentResolve.finalLayout = m_config.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL // 离屏模式没有呈现，留作读回
+                                                           : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;     // 转换为presentKHR
 
     VkAttachmentDescription depthAttachment = {};
     depthAttachment.format = findDepthFormat();
@@ -425,29 +572,79 @@ void LearnVKApp::createDescriptorSetLayout() {
     VkDescriptorSetLayoutBinding uniformBindingInfo = {};
     uniformBindingInfo.binding = 0;
     uniformBindingInfo.descriptorCount = 1;
-    uniformBindingInfo.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    uniformBindingInfo.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    uniformBindingInfo.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    uniformBindingInfo.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
     uniformBindingInfo.pImmutableSamplers = nullptr;
 
-    VkDescriptorSetLayoutBinding samplerBindingInfo = {}; // 采样器
-    samplerBindingInfo.binding = 1;
-    samplerBindingInfo.descriptorCount = 1;
+    VkDescriptorSetLayoutBinding objectBindingInfo = {}; // 子网格的包围盒、索引范围与材质
+    objectBindingInfo.binding = 1;
+    objectBindingInfo.descriptorCount = 1;
+    objectBindingInfo.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    objectBindingInfo.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
+    objectBindingInfo.pImmutableSamplers = nullptr;
+
+    VkDescriptorSetLayoutBinding instanceBindingInfo = {}; // 实例的变换
+    instanceBindingInfo.binding = 2;
+    instanceBindingInfo.descriptorCount = 1;
+    instanceBindingInfo.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    instanceBindingInfo.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
+    instanceBindingInfo.pImmutableSamplers = nullptr;
+
+    // 当前帧的DrawInstance，顶点着色器按gl_InstanceIndex读取，绑定时由动态偏移指定帧分段
+    VkDescriptorSetLayoutBinding drawInstanceBindingInfo = {};
+    drawInstanceBindingInfo.binding = 3;
+    drawInstanceBindingInfo.descriptorCount = 1;
+    drawInstanceBindingInfo.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+    drawInstanceBindingInfo.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
+    drawInstanceBindingInfo.pImmutableSamplers = nullptr;
+
+    VkDescriptorSetLayoutBinding samplerBindingInfo = {}; // 所有材质纹理的采样器数组，片元着色器按材质序号索引
+    samplerBindingInfo.binding = 4;
+    samplerBindingInfo.descriptorCount = maxMaterialTextures();
     samplerBindingInfo.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
     samplerBindingInfo.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
     samplerBindingInfo.pImmutableSamplers = nullptr;
 
-    VkDescriptorSetLayoutBinding layoutBindings[2] = {uniformBindingInfo,
-                                                      samplerBindingInfo};
+    VkDescriptorSetLayoutBinding layoutBindings[5] = {uniformBindingInfo, objectBindingInfo, instanceBindingInfo,
+                                                      drawInstanceBindingInfo, samplerBindingInfo};
+    // 纹理数组的实际长度在分配描述符集时指定，可变长度的绑定必须是最后一个
+    VkDescriptorBindingFlags bindingFlags[5] = {0, 0, 0, 0, VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT
+                                                                | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT};
+    VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo = {};
+    bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+    bindingFlagsInfo.bindingCount = 5;
+    bindingFlagsInfo.pBindingFlags = bindingFlags;
 
     VkDescriptorSetLayoutCreateInfo createInfo = {};
     createInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    createInfo.bindingCount = 2;
+    createInfo.pNext = &bindingFlagsInfo;
+    createInfo.bindingCount = 5;
     createInfo.pBindings = layoutBindings;
     VkResult res = vkCreateDescriptorSetLayout(m_device, &createInfo, nullptr,
                                                &m_descriptorSetLayout);
     if (res != VK_SUCCESS) {
         throw std::runtime_error("failed to create descriptor set layout!");
     }
+    if (!m_config.gpuDriven) {
+        return;
+    }
+    // 剔除管线的set 1：当前帧的间接绘制参数与绘制数量
+    VkDescriptorSetLayoutBinding cullBindings[2] = {};
+    for (uint32_t i = 0; i < 2; i++) {
+        cullBindings[i].binding = i;
+        cullBindings[i].descriptorCount = 1;
+        cullBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        cullBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        cullBindings[i].pImmutableSamplers = nullptr;
+    }
+    VkDescriptorSetLayoutCreateInfo cullCreateInfo = {};
+    cullCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    cullCreateInfo.bindingCount = 2;
+    cullCreateInfo.pBindings = cullBindings;
+    res = vkCreateDescriptorSetLayout(m_device, &cullCreateInfo, nullptr, &m_cullDescriptorSetLayout);
+    if (res != VK_SUCCESS) {
+        throw std::runtime_error("failed to create descriptor set layout!");
+    }
 }
 
 void LearnVKApp::createGraphicsPipeline() {
@@ -472,9 +669,10 @@ void LearnVKApp::createGraphicsPipeline() {
     VkPipelineShaderStageCreateInfo shaderStages[2] = {vertStageCreateInfo,
                                                        fragStageCreateInfo};
 
-    // 获取顶点的绑定信息和属性信息
-    auto bindDesc = Vertex::getBindDescription();
-    auto attrDesc = Vertex::getAttributeDescriptions();
+    // 获取顶点的绑定信息和属性信息，两种顶点格式的属性数量相同
+    auto bindDesc = m_config.compactVertex ? CompactVertex::getBindDescription() : Vertex::getBindDescription();
+    auto attrDesc = m_config.compactVertex ? CompactVertex::getAttributeDescriptions(m_halfTexCoord)
+                                           : Vertex::getAttributeDescriptions();
     // 顶点输入
     VkPipelineVertexInputStateCreateInfo vertexInputCreateInfo = {};
     vertexInputCreateInfo.sType =
@@ -585,8 +783,6 @@ void LearnVKApp::createGraphicsPipeline() {
     layoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
     layoutCreateInfo.setLayoutCount = 1;
     layoutCreateInfo.pSetLayouts = &m_descriptorSetLayout;
-    layoutCreateInfo.pushConstantRangeCount = 0;
-    layoutCreateInfo.pPushConstantRanges = nullptr;
     res = vkCreatePipelineLayout(m_device, &layoutCreateInfo, nullptr,
                                  &m_pipelineLayout);
     if (res != VK_SUCCESS) {
@@ -618,18 +814,64 @@ void LearnVKApp::createGraphicsPipeline() {
     pipelineCreateInfo.basePipelineHandle = VK_NULL_HANDLE; // 通过已有管线创造新的管线
     pipelineCreateInfo.basePipelineIndex = -1;
 
-    res = vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1,
+    auto startTime = std::chrono::high_resolution_clock::now();
+    res = vkCreateGraphicsPipelines(m_device, m_pipelineCache.handle(), 1,
                                     &pipelineCreateInfo, nullptr,
                                     &m_graphicsPipeline);
     // 其中pipelinecache 是管线缓存对象，加速管线创立
     if (res != VK_SUCCESS) {
         throw std::runtime_error("failed to create graphics pipeline!");
     }
+    double createMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+    std::cout << "pipeline: graphics pipeline created in " << createMs << " ms ("
+              << (m_pipelineCache.isWarm() ? "warm" : "cold") << " disk cache)" << std::endl;
     // 销毁创建的shaderModule
     vkDestroyShaderModule(m_device, vertexShaderModule, nullptr);
     vkDestroyShaderModule(m_device, fragmentShaderModule, nullptr);
 }
 
+void LearnVKApp::createCullPipeline() {
+    if (!m_config.gpuDriven) {
+        return;
+    }
+    VkShaderModule cullShaderModule = createShaderModule(CULL_COMP);
+    VkPipelineShaderStageCreateInfo stageCreateInfo = {};
+    stageCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    stageCreateInfo.pName = "main";
+    stageCreateInfo.module = cullShaderModule;
+    stageCreateInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    // set 0与图形管线相同，绑定时可以直接复用当前帧的m_descriptorSets与ubo的动态偏移
+    VkDescriptorSetLayout setLayouts[2] = {m_descriptorSetLayout, m_cullDescriptorSetLayout};
+    VkPushConstantRange pushConstantRange = {}; // 物体数量，超出的线程直接返回
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(CullConstants);
+    VkPipelineLayoutCreateInfo layoutCreateInfo = {};
+    layoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layoutCreateInfo.setLayoutCount = 2;
+    layoutCreateInfo.pSetLayouts = setLayouts;
+    layoutCreateInfo.pushConstantRangeCount = 1;
+    layoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+    VkResult res = vkCreatePipelineLayout(m_device, &layoutCreateInfo, nullptr, &m_cullPipelineLayout);
+    if (res != VK_SUCCESS) {
+        throw std::runtime_error("failed to create pipeline layout!");
+    }
+
+    VkComputePipelineCreateInfo pipelineCreateInfo = {};
+    pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineCreateInfo.stage = stageCreateInfo;
+    pipelineCreateInfo.layout = m_cullPipelineLayout;
+    pipelineCreateInfo.basePipelineHandle = VK_NULL_HANDLE;
+    pipelineCreateInfo.basePipelineIndex = -1;
+    res = vkCreateComputePipelines(m_device, m_pipelineCache.handle(), 1, &pipelineCreateInfo, nullptr,
+                                   &m_cullPipeline);
+    if (res != VK_SUCCESS) {
+        throw std::runtime_error("failed to create compute pipeline!");
+    }
+    vkDestroyShaderModule(m_device, cullShaderModule, nullptr);
+}
+
 void LearnVKApp::createFrameBuffers() {
     m_swapChainFrameBuffers.resize(m_swapChainImageViews.size());
     for (int i = 0; i < m_swapChainImages.size(); i++) {
@@ -661,6 +903,22 @@ void LearnVKApp::createCommandPool() {
     if (res != VK_SUCCESS) {
         throw std::runtime_error("failed to create command pool!");
     }
+    m_uploadContext.init(m_device, m_allocator, indices.transferFamily, m_queueMap["transferFamily"],
+                         indices.graphicsFamily, m_queueMap["graphicsFamily"], indices.transferGranularity);
+    std::cout << "upload: " << (m_uploadContext.hasDedicatedTransferQueue() ? "dedicated transfer queue family " : "graphics queue family ")
+              << indices.transferFamily << ", image granularity " << indices.transferGranularity.width << "x"
+              << indices.transferGranularity.height << "x" << indices.transferGranularity.depth << std::endl;
+    if (m_config.gpuProfile) {
+        // 离屏模式保留每个测量帧的样本，供LearnVKBench计算分位数
+        size_t historySize = m_config.headless ? std::max<size_t>(GpuProfiler::HISTORY_SIZE, headlessFrameCount())
+                                               : GpuProfiler::HISTORY_SIZE;
+        m_gpuProfiler.init(m_physicalDevice, m_device, indices.graphicsFamily, MAX_FRAMES_IN_FLIGHT, historySize);
+        m_frameScope = m_gpuProfiler.scope("frame");
+        m_cullScope = m_gpuProfiler.scope("cull");
+        m_renderPassScope = m_gpuProfiler.scope("render pass");
+        m_mipScope = m_gpuProfiler.scope("mipmaps");
+        m_uploadContext.setProfiler(&m_gpuProfiler);
+    }
 }
 
 void LearnVKApp::createDepthResources() {
@@ -671,7 +929,7 @@ void LearnVKApp::createDepthResources() {
         VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_depthImage, m_depthImageMemory);
     m_depthImageView = createImageView(m_depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 1);
-    transitionImageLayout(m_depthImage, depthFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, 1); // 优化
+    transitionImageLayout(m_uploadContext.graphicsCommandBuffer(), m_depthImage, depthFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, 1); // 优化
 }
 
 void LearnVKApp::createColorResources() {
@@ -681,7 +939,7 @@ void LearnVKApp::createColorResources() {
                 VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT,
                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_colorImage, m_colorImageMemory);
     m_colorImageView = createImageView(m_colorImage, colorFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1);
-    transitionImageLayout(m_colorImage, colorFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, 1); // 优化
+    transitionImageLayout(m_uploadContext.graphicsCommandBuffer(), m_colorImage, colorFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, 1); // 优化
 }
 
 VkFormat LearnVKApp::findDepthFormat() {
@@ -708,53 +966,229 @@ VkFormat LearnVKApp::findSupportedFormat(const std::vector<VkFormat>& formats,
     throw std::runtime_error("failed to find supported format!");
 }
 
-void LearnVKApp::createTextureImage(const std::string& textureName) {
-    int texWidth, texHeight, texChannels;
-    stbi_uc* pixels = stbi_load((TEXTURE_PATH + textureName).c_str(), &texWidth,
-                                &texHeight, &texChannels, STBI_rgb_alpha);
-    if (!pixels) {
-        throw std::runtime_error(
-            "failed to load textures! searching:" + TEXTURE_PATH + textureName);
-    }
-    m_mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(texWidth, texHeight))));
-    VkDeviceSize imageSize = texWidth * texHeight * 4;
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-    createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                 stagingBuffer, stagingBufferMemory);
-    void* data;
-    vkMapMemory(m_device, stagingBufferMemory, 0, imageSize, 0, &data);
-    memcpy(data, pixels, static_cast<size_t>(imageSize));
-    vkUnmapMemory(m_device, stagingBufferMemory);
-    stbi_image_free(pixels);
-
-    createImage(static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight), m_mipLevels,
+uint32_t LearnVKApp::maxMaterialTextures() {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(m_physicalDevice, &properties);
+    const VkPhysicalDeviceLimits& limits = properties.limits;
+    return std::min({MAX_MATERIAL_TEXTURES, limits.maxPerStageDescriptorSamplers,
+                     limits.maxPerStageDescriptorSampledImages, limits.maxDescriptorSetSamplers,
+                     limits.maxDescriptorSetSampledImages});
+}
+
+std::string LearnVKApp::materialTexturePath(size_t index) const {
+    return TEXTURE_PATH + (m_materialTextures[index].empty() ? m_config.texture : m_materialTextures[index]);
+}
+
+std::vector<DecodedImage> LearnVKApp::decodeMaterialTextures() {
+    std::vector<std::string> decodePaths;
+    std::vector<size_t> decodeSlots;
+    for (size_t i = 0; i < m_materialTextures.size(); i++) {
+        std::string path = materialTexturePath(i);
+        TextureFile cooked;
+        if (cooked.open(path)) { // 格式是否被设备支持要等设备创建之后才知道，不支持时上传前再解码
+            continue;
+        }
+        decodePaths.push_back(path);
+        decodeSlots.push_back(i);
+    }
+    TextureLoader loader(m_threadPool, m_uploadContext);
+    std::vector<DecodedImage> images = loader.decode(decodePaths);
+    std::vector<DecodedImage> decoded(m_materialTextures.size());
+    for (size_t i = 0; i < images.size(); i++) {
+        decoded[decodeSlots[i]] = std::move(images[i]);
+    }
+    return decoded;
+}
+
+void LearnVKApp::createTextureImages(std::vector<DecodedImage>& decoded) {
+    if (m_materialTextures.size() > maxMaterialTextures()) {
+        throw std::runtime_error("too many material textures!");
+    }
+    m_textures.resize(m_materialTextures.size());
+    auto startTime = std::chrono::high_resolution_clock::now();
+    // 优先使用TextureCooker烘焙的文件，其余使用启动时在工作线程上解码好的像素
+    std::vector<DecodedImage> images;
+    std::vector<size_t> imageSlots;
+    std::vector<std::string> fallbackPaths;
+    std::vector<size_t> fallbackSlots;
+    for (size_t i = 0; i < m_materialTextures.size(); i++) {
+        std::string path = materialTexturePath(i);
+        if (!decoded[i].pixels) {
+            TextureFile cooked;
+            if (cooked.open(path) && isSampledFormatSupported(static_cast<VkFormat>(cooked.format()))) {
+                uploadCookedTexture(cooked, m_textures[i]);
+                std::cout << "texture: " << TextureFile::cookedPath(path) << " " << cooked.width() << "x"
+                          << cooked.height() << ", " << cooked.mipLevels() << " mips, " << cooked.levelDataSize() / 1024
+                          << " KB staged" << std::endl;
+                continue;
+            }
+            fallbackPaths.push_back(path);
+            fallbackSlots.push_back(i);
+            continue;
+        }
+        images.push_back(std::move(decoded[i]));
+        imageSlots.push_back(i);
+    }
+    // 设备不能对纹理格式做线性过滤的blit时，mip链在CPU上生成并与第0级一起上传
+    bool cpuMips = !isLinearBlitSupported(VK_FORMAT_R8G8B8A8_SRGB);
+    TextureLoader loader(m_threadPool, m_uploadContext);
+    size_t recorded = 0; // record按images的顺序调用
+    std::vector<TextureInfo> textures = loader.load(images, [&](const TextureInfo& texture) {
+        recordTextureUpload(texture, m_textures[imageSlots[recorded++]]);
+    }, cpuMips);
+    // 设备不支持烘焙格式的纹理在设备创建之前被跳过，现在直接解码进暂存内存
+    recorded = 0;
+    std::vector<TextureInfo> fallback = loader.load(fallbackPaths, [&](const TextureInfo& texture) {
+        recordTextureUpload(texture, m_textures[fallbackSlots[recorded++]]);
+    }, cpuMips);
+    textures.insert(textures.end(), fallback.begin(), fallback.end());
+    double totalMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+    for (const auto& texture : textures) {
+        std::cout << "texture: " << texture.path << " " << texture.width << "x" << texture.height
+                  << " decode " << texture.decodeMs << " ms, ";
+        if (cpuMips) {
+            std::cout << "cpu mips (" << MipGenerator::simdPath() << ") " << texture.mipMs << " ms, ";
+        }
+        std::cout << "upload " << texture.uploadMs << " ms" << std::endl;
+    }
+    std::cout << "texture: " << m_textures.size() << " loaded (" << m_textures.size() - textures.size()
+              << " cooked) in " << totalMs << " ms on " << m_threadPool.threadCount() + 1 << " threads" << std::endl;
+    m_textureResident.assign(m_textures.size(), true);
+}
+
+void LearnVKApp::uploadCookedTexture(const TextureFile& texture, MaterialTexture& target) {
+    target.mipLevels = texture.mipLevels();
+    target.format = static_cast<VkFormat>(texture.format());
+    StagingRegion staging = m_uploadContext.stage(texture.levelData(), texture.levelDataSize());
+
+    createImage(texture.width(), texture.height(), target.mipLevels, VK_SAMPLE_COUNT_1_BIT, target.format,
+                VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, target.image, target.memory);
+    VkCommandBuffer commandBuffer = m_uploadContext.transferCommandBuffer();
+    transitionImageLayout(commandBuffer, target.image, target.format, VK_IMAGE_LAYOUT_UNDEFINED,
+                          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, target.mipLevels);
+    std::vector<VkBufferImageCopy> regions(target.mipLevels);
+    for (uint32_t i = 0; i < target.mipLevels; i++) {
+        const TextureFileLevel& level = texture.level(i);
+        regions[i] = {};
+        regions[i].bufferOffset = staging.offset + (level.offset - texture.level(0).offset);
+        regions[i].imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        regions[i].imageSubresource.mipLevel = i;
+        regions[i].imageSubresource.baseArrayLayer = 0;
+        regions[i].imageSubresource.layerCount = 1;
+        regions[i].imageExtent = {level.width, level.height, 1};
+    }
+    vkCmdCopyBufferToImage(commandBuffer, staging.buffer, target.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                           target.mipLevels, regions.data());
+    VkImageSubresourceRange mipRange = {};
+    mipRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    mipRange.baseMipLevel = 0;
+    mipRange.levelCount = target.mipLevels;
+    mipRange.baseArrayLayer = 0;
+    mipRange.layerCount = 1;
+    m_uploadContext.releaseImage(target.image, mipRange, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                 VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_SHADER_READ_BIT,
+                                 VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+}
+
+bool LearnVKApp::isLinearBlitSupported(VkFormat format) {
+    VkFormatProperties props;
+    vkGetPhysicalDeviceFormatProperties(m_physicalDevice, format, &props);
+    VkFormatFeatureFlags features = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT
+                                    | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    return (props.optimalTilingFeatures & features) == features;
+}
+
+bool LearnVKApp::isSampledFormatSupported(VkFormat format) {
+    if (isBlockCompressedFormat(format) && !m_textureCompressionBC) {
+        return false;
+    }
+    VkFormatProperties props;
+    vkGetPhysicalDeviceFormatProperties(m_physicalDevice, format, &props);
+    return (props.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) != 0;
+}
+
+void LearnVKApp::recordTextureUpload(const TextureInfo& texture, MaterialTexture& target) {
+    int texWidth = static_cast<int>(texture.width);
+    int texHeight = static_cast<int>(texture.height);
+    const StagingRegion& staging = texture.staging;
+    target.format = VK_FORMAT_R8G8B8A8_SRGB;
+    target.mipLevels = MipGenerator::mipLevelCount(texture.width, texture.height);
+
+    createImage(static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight), target.mipLevels,
                 VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL,
                 VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
-                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_textureImage,
-                m_textureImageMemory);
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, target.image,
+                target.memory);
+    VkCommandBuffer commandBuffer = m_uploadContext.transferCommandBuffer(); // 拷贝在传输队列上执行
     transitionImageLayout(
-        m_textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED,
-        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, m_mipLevels); // oldlayout
+        commandBuffer, target.image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, target.mipLevels); // oldlayout
                                                             // 在创建时我们指定为了UNDEFINED
-    copyBufferToImage(stagingBuffer, m_textureImage,
+    VkImageSubresourceRange mipRange = {};
+    mipRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    mipRange.baseMipLevel = 0;
+    mipRange.levelCount = target.mipLevels;
+    mipRange.baseArrayLayer = 0;
+    mipRange.layerCount = 1;
+    if (texture.mipLevels == target.mipLevels) { // mip链已在CPU上生成，所有层级一次拷贝
+        std::vector<uint64_t> offsets;
+        MipGenerator::levelOffsets(texture.width, texture.height, offsets);
+        std::vector<VkBufferImageCopy> regions(target.mipLevels);
+        uint32_t mipWidth = texture.width, mipHeight = texture.height;
+        for (uint32_t i = 0; i < target.mipLevels; i++) {
+            regions[i] = {};
+            regions[i].bufferOffset = staging.offset + offsets[i];
+            regions[i].imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            regions[i].imageSubresource.mipLevel = i;
+            regions[i].imageSubresource.baseArrayLayer = 0;
+            regions[i].imageSubresource.layerCount = 1;
+            regions[i].imageExtent = {mipWidth, mipHeight, 1};
+            mipWidth = std::max(1u, mipWidth / 2);
+            mipHeight = std::max(1u, mipHeight / 2);
+        }
+        vkCmdCopyBufferToImage(commandBuffer, staging.buffer, target.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                               target.mipLevels, regions.data());
+        m_uploadContext.releaseImage(target.image, mipRange, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                     VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_SHADER_READ_BIT,
+                                     VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+        return;
+    }
+    copyBufferToImage(commandBuffer, staging.buffer, staging.offset, target.image,
                       static_cast<uint32_t>(texWidth),
                       static_cast<uint32_t>(texHeight));
     // transitionImageLayout(
     //     m_textureImage, VK_FORMAT_R8G8B8A8_SRGB,
     //     VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
     //     VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, m_mipLevels); // 再次将图片layout转换为着色器可以使用
-    generateMipmaps(m_textureImage, VK_FORMAT_R8G8B8A8_SRGB, texWidth, texHeight, m_mipLevels); // 创建mipmaps最后会将布局转为SHADRE_READ_ONLY_OPTIMAL
-
-    vkDestroyBuffer(m_device, stagingBuffer, nullptr);
-    vkFreeMemory(m_device, stagingBufferMemory, nullptr);
+    recordMipmapBlit(target, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight));
+}
+
+void LearnVKApp::recordMipmapBlit(MaterialTexture& target, uint32_t width, uint32_t height) {
+    VkImageSubresourceRange mipRange = {};
+    mipRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    mipRange.baseMipLevel = 0;
+    mipRange.levelCount = target.mipLevels;
+    mipRange.baseArrayLayer = 0;
+    mipRange.layerCount = 1;
+    // blit需要图形队列，先将整个mip链的所有权交给图形队列，布局保持TRANSFER_DST
+    m_uploadContext.releaseImage(target.image, mipRange, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                 VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                 VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+    VkCommandBuffer graphicsCommandBuffer = m_uploadContext.graphicsCommandBuffer();
+    uint32_t mipQuery = GpuProfiler::INVALID_QUERY;
+    if (m_gpuProfiler.enabled()) {
+        mipQuery = m_gpuProfiler.beginOneShot(graphicsCommandBuffer, findDeviceQueueFamilies(m_physicalDevice).graphicsFamily,
+                                              m_mipScope);
+    }
+    generateMipmaps(graphicsCommandBuffer, target.image, target.format, width, height, target.mipLevels); // 创建mipmaps最后会将布局转为SHADRE_READ_ONLY_OPTIMAL
+    m_gpuProfiler.endOneShot(graphicsCommandBuffer, mipQuery);
 }
 
 void LearnVKApp::createImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkSampleCountFlagBits numSamples, VkFormat format,
                              VkImageTiling tiling, VkImageUsageFlags usage,
                              VkMemoryPropertyFlags properties, VkImage& image,
-                             VkDeviceMemory& memory) {
+                             MemoryAllocation& memory) {
     VkImageCreateInfo imageInfo = {};
     imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
     imageInfo.imageType = VK_IMAGE_TYPE_2D;
@@ -774,23 +1208,11 @@ void LearnVKApp::createImage(uint32_t width, uint32_t height, uint32_t mipLevels
         throw std::runtime_error("failed to create image!");
     }
 
-    VkMemoryRequirements memReq = {};
-    vkGetImageMemoryRequirements(m_device, image, &memReq);
-    VkMemoryAllocateInfo allocInfo = {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memReq.size;
-    allocInfo.memoryTypeIndex = findMemoryType(memReq.memoryTypeBits, properties);
-    res = vkAllocateMemory(m_device, &allocInfo, nullptr, &memory);
-    if (res != VK_SUCCESS) {
-        throw std::runtime_error("failed to allocate image memory!");
-    }
-    vkBindImageMemory(m_device, image, memory, 0);
+    memory = m_allocator.allocateForImage(image, properties, tiling);
 }
 
-void LearnVKApp::generateMipmaps(VkImage image, VkFormat imageFormat, uint32_t texWidth, uint32_t texHeight, uint32_t mipLevels) {
-    VkFormatProperties formatProperties;
-    vkGetPhysicalDeviceFormatProperties(m_physicalDevice, imageFormat, &formatProperties);
-    if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT)) {
+void LearnVKApp::generateMipmaps(VkCommandBuffer commandBuffer, VkImage image, VkFormat imageFormat, uint32_t texWidth, uint32_t texHeight, uint32_t mipLevels) {
+    if (!isLinearBlitSupported(imageFormat)) { // 调用前应已改用MipGenerator在CPU上生成
         throw std::runtime_error("texture format linear bilt not support!");
     }
     VkImageMemoryBarrier imageBarrier = {};
@@ -803,8 +1225,6 @@ void LearnVKApp::generateMipmaps(VkImage image, VkFormat imageFormat, uint32_t t
     imageBarrier.subresourceRange.layerCount = 1;
     imageBarrier.subresourceRange.levelCount = 1;
 
-    VkCommandBuffer commandBuffer = beginSingleTimeCommand();
-
     int mipWidth = static_cast<int>(texWidth);
     int mipHeight = static_cast<int>(texHeight);
     for (int i = 1; i < mipLevels; i++) {
@@ -865,14 +1285,11 @@ void LearnVKApp::generateMipmaps(VkImage image, VkFormat imageFormat, uint32_t t
                          0, nullptr,
                          0, nullptr,
                          1, &imageBarrier);
-
-    endSingleTimeCommand(commandBuffer);
 }
 
-void LearnVKApp::transitionImageLayout(VkImage image, VkFormat format,
+void LearnVKApp::transitionImageLayout(VkCommandBuffer commandBuffer, VkImage image, VkFormat format,
                                        VkImageLayout oldLayout,
                                        VkImageLayout newLayout, uint32_t mipsLevels) {
-    VkCommandBuffer commandBuffer = beginSingleTimeCommand();
     VkImageMemoryBarrier imageBarrier = {};
     imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
     imageBarrier.oldLayout = oldLayout;
@@ -927,17 +1344,15 @@ void LearnVKApp::transitionImageLayout(VkImage image, VkFormat format,
     vkCmdPipelineBarrier(commandBuffer, sourceStage,
                          destinationStage, // 屏障前和屏障后的管线阶段
                          0, 0, nullptr, 0, nullptr, 1, &imageBarrier);
-    endSingleTimeCommand(commandBuffer);
 }
 
-void LearnVKApp::copyBufferToImage(VkBuffer buffer, VkImage image,
-                                   uint32_t width, uint32_t height) {
-    VkCommandBuffer commandBuffer = beginSingleTimeCommand();
+void LearnVKApp::copyBufferToImage(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize bufferOffset,
+                                   VkImage image, uint32_t width, uint32_t height) {
     VkBufferImageCopy region = {};
     region.bufferRowLength = 0;
     region.bufferImageHeight =
         0; // 以上两参数用于设置内存对其，如果设置为0则紧凑存放
-    region.bufferOffset = 0;
+    region.bufferOffset = bufferOffset;
     region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
     region.imageSubresource.baseArrayLayer = 0;
     region.imageSubresource.layerCount = 1;
@@ -946,12 +1361,13 @@ void LearnVKApp::copyBufferToImage(VkBuffer buffer, VkImage image,
     region.imageExtent = {width, height, 1};
     vkCmdCopyBufferToImage(commandBuffer, buffer, image,
                            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-    endSingleTimeCommand(commandBuffer);
 }
 
-void LearnVKApp::createTextureImageView() {
-    m_textureImageView = createImageView(m_textureImage, VK_FORMAT_R8G8B8A8_SRGB,
-                                         VK_IMAGE_ASPECT_COLOR_BIT, m_mipLevels);
+void LearnVKApp::createTextureImageViews() {
+    for (auto& texture : m_textures) {
+        texture.view = createImageView(texture.image, texture.format,
+                                       VK_IMAGE_ASPECT_COLOR_BIT, texture.mipLevels);
+    }
 }
 
 void LearnVKApp::createTextureSampler() {
@@ -973,7 +1389,11 @@ void LearnVKApp::createTextureSampler() {
     samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
     samplerInfo.mipLodBias = 0.0f;
     samplerInfo.minLod = 0.0f;
-    samplerInfo.maxLod = static_cast<float>(m_mipLevels);
+    uint32_t maxMipLevels = 1; // 所有纹理共用一个采样器，取最大的层级数
+    for (const auto& texture : m_textures) {
+        maxMipLevels = std::max(maxMipLevels, texture.mipLevels);
+    }
+    samplerInfo.maxLod = static_cast<float>(maxMipLevels);
     VkResult res =
         vkCreateSampler(m_device, &samplerInfo, nullptr, &m_textureSampler);
     if (res != VK_SUCCESS) {
@@ -981,133 +1401,364 @@ void LearnVKApp::createTextureSampler() {
     }
 }
 
-void LearnVKApp::loadModel(const std::string& modelName) {
-    tinyobj::attrib_t attr;
-    std::vector<tinyobj::shape_t> shapes;
-    std::vector<tinyobj::material_t> materials;
-    std::string warn, err;
+void LearnVKApp::loadModel(const std::string& modelName, MeshData& mesh) {
     std::string modelPath = MODEL_PATH + modelName;
+    uint32_t cacheFlags = (m_config.optimizeMesh ? MESH_CACHE_FLAG_OPTIMIZED : 0)
+                          | (m_config.compactVertex ? MESH_CACHE_FLAG_COMPACT : 0);
+    uint32_t vertexStride = m_config.compactVertex ? sizeof(CompactVertex) : sizeof(Vertex);
+    if (mesh.cache.open(modelPath, vertexStride, cacheFlags)) { // 命中烘焙缓存，直接使用映射的顶点与索引流
+        mesh.indexCount = mesh.cache.indexCount();
+        mesh.submeshes = mesh.cache.submeshes();
+        mesh.materialTextures = mesh.cache.materialTextures();
+        mesh.bounds = mesh.cache.bounds();
+        mesh.halfTexCoord = (mesh.cache.flags() & MESH_CACHE_FLAG_HALF_TEXCOORD) != 0;
+        if (m_config.compactVertex) {
+            compactVertices(mesh);
+        }
+        return;
+    }
 
-    if (!tinyobj::LoadObj(&attr, &shapes, &materials, &warn, &err,
-                          modelPath.c_str())) {
-        throw std::runtime_error(err);
-    }
-    std::unordered_map<Vertex, uint32_t> uniqueVertexIndexMap{}; // 顶点去重
-    for (const auto& shape : shapes) {
-        for (const auto& index : shape.mesh.indices) {
-            Vertex vertex;
-            vertex.position = {
-                attr.vertices[3 * index.vertex_index + 0],
-                attr.vertices[3 * index.vertex_index + 1],
-                attr.vertices[3 * index.vertex_index + 2],
-            };
-            vertex.texCoord = {attr.texcoords[2 * index.texcoord_index + 0],
-                               1.0f - attr.texcoords[2 * index.texcoord_index + 1]};
-            vertex.color = {1.0f, 1.0f, 1.0f};
-            if (uniqueVertexIndexMap.count(vertex) == 0) {
-                uniqueVertexIndexMap[vertex] = static_cast<uint32_t>(g_vertices.size());
-                g_vertices.push_back(vertex);
-            }
-            g_indices.push_back(uniqueVertexIndexMap[vertex]);
+    auto startTime = std::chrono::high_resolution_clock::now();
+    ObjParser parser(m_threadPool);
+    parser.parse(modelPath);
+    auto endTime = std::chrono::high_resolution_clock::now();
+    double parseMs = std::chrono::duration<double, std::milli>(endTime - startTime).count();
+    double fileMB = parser.fileSize() / (1024.0 * 1024.0);
+    std::cout << "obj: parsed " << fileMB << " MB in " << parseMs << " ms, "
+              << fileMB * 1000.0 / parseMs << " MB/s" << std::endl;
+    const tinyobj::attrib_t& attr = parser.attrib();
+    std::vector<IndexRange> indexRanges = parser.indexRanges();
+    VertexDeduplicator deduplicator(m_threadPool);
+    deduplicator.build(attr, indexRanges, mesh.vertices, mesh.indices); // 顶点去重
+    buildSubmeshes(modelName, parser, mesh);
+    if (m_config.optimizeMesh) {
+        optimizeMesh(mesh);
+    }
+    mesh.indexCount = static_cast<uint32_t>(mesh.indices.size());
+
+    mesh.bounds.min = glm::vec3(std::numeric_limits<float>::max());
+    mesh.bounds.max = glm::vec3(std::numeric_limits<float>::lowest());
+    for (const auto& vertex : mesh.vertices) {
+        mesh.bounds.min = glm::min(mesh.bounds.min, vertex.position);
+        mesh.bounds.max = glm::max(mesh.bounds.max, vertex.position);
+    }
+    const void* vertexData = mesh.vertices.data();
+    if (m_config.compactVertex) {
+        compactVertices(mesh);
+        vertexData = mesh.compactVertices.data();
+        cacheFlags |= mesh.halfTexCoord ? MESH_CACHE_FLAG_HALF_TEXCOORD : 0;
+    }
+    // 烘焙缓存，下次启动时跳过obj解析；写入失败(如资源目录只读)不影响本次运行
+    if (!MeshCache::write(modelPath, vertexStride, cacheFlags,
+                          vertexData, static_cast<uint32_t>(m_config.compactVertex ? mesh.compactVertices.size() : mesh.vertices.size()),
+                          mesh.indices.data(), mesh.indexCount, mesh.submeshes, mesh.materialTextures, mesh.bounds)) {
+        std::cerr << "failed to write mesh cache: " << MeshCache::cachePath(modelPath) << std::endl;
+    }
+}
+
+// 去重后的索引与解析得到的三角形一一对应，按材质纹理做计数排序，同一纹理的三角形保持原有顺序
+void LearnVKApp::buildSubmeshes(const std::string& modelName, const ObjParser& parser, MeshData& mesh) {
+    // 漫反射贴图按文件名在resource/textures/<模型目录>/下查找，多个材质共用一张贴图时合并为一个子网格
+    std::string textureDir = std::filesystem::path(modelName).parent_path().generic_string();
+    const std::vector<tinyobj::material_t>& materials = parser.materials();
+    std::vector<uint32_t> materialSlots(materials.size());
+    std::map<std::string, uint32_t> textureSlots;
+    mesh.materialTextures.clear();
+    auto findSlot = [&](const std::string& texture) {
+        auto it = textureSlots.find(texture);
+        if (it != textureSlots.end()) {
+            return it->second;
         }
+        uint32_t slot = static_cast<uint32_t>(mesh.materialTextures.size());
+        textureSlots.emplace(texture, slot);
+        mesh.materialTextures.push_back(texture);
+        return slot;
+    };
+    for (size_t m = 0; m < materials.size(); m++) {
+        std::string texture;
+        if (!materials[m].diffuse_texname.empty()) {
+            std::string fileName = std::filesystem::path(materials[m].diffuse_texname).filename().generic_string();
+            texture = textureDir.empty() ? fileName : textureDir + "/" + fileName;
+        }
+        materialSlots[m] = findSlot(texture);
+    }
+    const std::vector<int>& materialIds = parser.materialIds();
+    size_t triangleCount = mesh.indices.size() / 3;
+    if (materialIds.size() != triangleCount) {
+        throw std::runtime_error("triangle material count mismatch!");
+    }
+    std::vector<uint32_t> triangleSlots(triangleCount);
+    for (size_t t = 0; t < triangleCount; t++) {
+        int material = materialIds[t];
+        triangleSlots[t] = material < 0 ? findSlot("") : materialSlots[material];
     }
-}
 
-template <typename T>
-void LearnVKApp::createLocalBuffer(const std::vector<T>& info,
-                                   VkBufferUsageFlags usage, VkBuffer& buffer,
-                                   VkDeviceMemory& memory) {
-    VkDeviceSize bufferSize = sizeof(T) * info.size();
-    VkBuffer stageBuffer;
-    VkDeviceMemory stageBufferMemory;
-    // 创建暂存缓存区
-    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                 stageBuffer, stageBufferMemory);
-    // 映射内存
-    void* data; // 内存映射后的地址
-    vkMapMemory(m_device, stageBufferMemory, 0, bufferSize, 0, &data);
-    memcpy(data, info.data(), static_cast<size_t>(bufferSize));
-    vkUnmapMemory(m_device, stageBufferMemory);
-    // 创建CPU不可访问的顶点缓存
-    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage,
-                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer, memory);
-    copyBuffer(stageBuffer, buffer, bufferSize);
-    vkDestroyBuffer(m_device, stageBuffer, nullptr);
-    vkFreeMemory(m_device, stageBufferMemory, nullptr);
+    std::vector<uint32_t> slotOffsets(mesh.materialTextures.size() + 1, 0);
+    for (uint32_t slot : triangleSlots) {
+        slotOffsets[slot + 1]++;
+    }
+    for (size_t s = 1; s < slotOffsets.size(); s++) {
+        slotOffsets[s] += slotOffsets[s - 1];
+    }
+    mesh.submeshes.clear();
+    for (uint32_t slot = 0; slot < mesh.materialTextures.size(); slot++) {
+        uint32_t count = slotOffsets[slot + 1] - slotOffsets[slot];
+        if (count > 0) { // 没有三角形引用的贴图仍留在纹理表中，保持材质序号与描述符下标一致
+            mesh.submeshes.push_back({slotOffsets[slot] * 3, count * 3, slot});
+        }
+    }
+    std::vector<uint32_t> sortedIndices(mesh.indices.size());
+    for (size_t t = 0; t < triangleCount; t++) {
+        uint32_t dst = slotOffsets[triangleSlots[t]]++;
+        std::copy_n(mesh.indices.begin() + t * 3, 3, sortedIndices.begin() + dst * 3);
+    }
+    mesh.indices.swap(sortedIndices);
+    for (auto& submesh : mesh.submeshes) { // 子网格的包围盒，作为剔除的单位
+        glm::vec3 boundsMin(std::numeric_limits<float>::max());
+        glm::vec3 boundsMax(std::numeric_limits<float>::lowest());
+        for (uint32_t i = submesh.indexOffset; i < submesh.indexOffset + submesh.indexCount; i++) {
+            const glm::vec3& position = mesh.vertices[mesh.indices[i]].position;
+            boundsMin = glm::min(boundsMin, position);
+            boundsMax = glm::max(boundsMax, position);
+        }
+        for (int axis = 0; axis < 3; axis++) {
+            submesh.boundsMin[axis] = boundsMin[axis];
+            submesh.boundsMax[axis] = boundsMax[axis];
+        }
+    }
+    std::cout << "submesh: " << mesh.submeshes.size() << " draws, " << mesh.materialTextures.size() << " material textures, "
+              << materials.size() << " materials" << std::endl;
+}
+
+void LearnVKApp::optimizeMesh(MeshData& mesh) { // 优化三角形与顶点顺序，减少顶点着色的重复计算与overdraw
+    auto startTime = std::chrono::high_resolution_clock::now();
+    VertexCacheStats before = MeshOptimizer::analyzeVertexCache(mesh.indices, mesh.vertices.size());
+    // 三角形只在各子网格内部重排，保持按材质划分的索引范围不变
+    std::vector<uint32_t> submeshIndices;
+    for (const auto& submesh : mesh.submeshes) {
+        auto begin = mesh.indices.begin() + submesh.indexOffset;
+        submeshIndices.assign(begin, begin + submesh.indexCount);
+        MeshOptimizer::optimizeVertexCache(submeshIndices, mesh.vertices.size());
+        MeshOptimizer::optimizeOverdraw(submeshIndices, mesh.vertices);
+        std::copy(submeshIndices.begin(), submeshIndices.end(), begin);
+    }
+    MeshOptimizer::optimizeVertexFetch(mesh.vertices, mesh.indices);
+    VertexCacheStats after = MeshOptimizer::analyzeVertexCache(mesh.indices, mesh.vertices.size());
+    auto endTime = std::chrono::high_resolution_clock::now();
+    double totalMs = std::chrono::duration<double, std::milli>(endTime - startTime).count();
+    std::cout << "mesh optimize: ACMR " << before.acmr << " -> " << after.acmr << ", ATVR " << before.atvr
+              << " -> " << after.atvr << " (cache size " << MeshOptimizer::DEFAULT_CACHE_SIZE << ") in "
+              << totalMs << " ms" << std::endl;
+}
+
+// 将顶点量化为CompactVertex并计算还原矩阵；命中缓存时mesh.vertices为空，只计算还原矩阵
+void LearnVKApp::compactVertices(MeshData& mesh) {
+    glm::vec3 extent = mesh.bounds.max - mesh.bounds.min;
+    for (int axis = 0; axis < 3; axis++) {
+        if (!(extent[axis] > 0.0f)) { // 扁平的包围盒在该轴上量化值恒为0
+            extent[axis] = 1.0f;
+        }
+    }
+    mesh.positionDequantize = glm::scale(glm::translate(glm::mat4(1.0f), mesh.bounds.min), extent);
+    if (mesh.vertices.empty()) {
+        return;
+    }
+    mesh.halfTexCoord = false; // 超出[0,1]的纹理坐标(如重复平铺)无法用unorm表示
+    for (const auto& vertex : mesh.vertices) {
+        if (vertex.texCoord.x < 0.0f || vertex.texCoord.x > 1.0f || vertex.texCoord.y < 0.0f || vertex.texCoord.y > 1.0f) {
+            mesh.halfTexCoord = true;
+            break;
+        }
+    }
+    glm::vec3 boundsScale = glm::vec3(1.0f) / extent;
+    mesh.compactVertices.resize(mesh.vertices.size());
+    for (size_t i = 0; i < mesh.vertices.size(); i++) {
+        mesh.compactVertices[i] = CompactVertex::fromVertex(mesh.vertices[i], mesh.bounds.min, boundsScale, mesh.halfTexCoord);
+    }
+    std::cout << "compact vertex: " << mesh.vertices.size() * sizeof(Vertex) / 1024 << " KB -> "
+              << mesh.compactVertices.size() * sizeof(CompactVertex) / 1024 << " KB, texcoord "
+              << (mesh.halfTexCoord ? "half" : "unorm16") << std::endl;
+    mesh.vertices = std::vector<Vertex>();
 }
 
-void LearnVKApp::copyBuffer(VkBuffer& srcBuffer, VkBuffer& dstBuffer,
-                            VkDeviceSize size) {
-    VkCommandBuffer commandBuffer = beginSingleTimeCommand();
-    VkBufferCopy bufferCopyRegion = {};
-    bufferCopyRegion.size = size;
-    bufferCopyRegion.srcOffset = 0;
-    bufferCopyRegion.dstOffset = 0;
-    vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &bufferCopyRegion);
-    endSingleTimeCommand(commandBuffer);
+void LearnVKApp::adoptMesh(std::unique_ptr<MeshData> mesh) {
+    m_submeshes = std::move(mesh->submeshes);
+    m_materialTextures = std::move(mesh->materialTextures);
+    m_halfTexCoord = mesh->halfTexCoord;
+    m_positionDequantize = mesh->positionDequantize;
+    m_meshData = std::move(mesh);
 }
 
-VkCommandBuffer LearnVKApp::beginSingleTimeCommand() {
-    VkCommandBufferAllocateInfo allocInfo = {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocInfo.commandPool = m_commandPool;
-    allocInfo.commandBufferCount = 1;
-    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    VkCommandBuffer commandBuffer;
-    vkAllocateCommandBuffers(m_device, &allocInfo, &commandBuffer);
-
-    VkCommandBufferBeginInfo beginInfo = {};
-    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+void LearnVKApp::createMeshBuffers() {
+    // 命中网格缓存时从映射的文件直接拷贝进暂存缓冲；之后主机内存中的顶点与索引不再需要
+    createLocalBuffer(m_meshData->vertexData(), m_meshData->vertexDataSize(), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                      m_vertexBuffer, m_vertexBufferMemory);
+    createLocalBuffer(m_meshData->indexData(), m_meshData->indexDataSize(), VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+                      m_indexBuffer, m_indexBufferMemory);
+    m_meshData.reset();
+}
+
+void LearnVKApp::createObjectBuffers() {
+    // 包围盒变换到顶点流所在的空间，与顶点一样经过ubo.model(其中包含量化的还原矩阵)
+    glm::mat4 quantize = glm::inverse(m_positionDequantize);
+    std::vector<ObjectData> objects(m_submeshes.size());
+    for (size_t i = 0; i < m_submeshes.size(); i++) {
+        const Submesh& submesh = m_submeshes[i];
+        ObjectData& object = objects[i];
+        object.boundsMin = quantize * glm::vec4(submesh.boundsMin[0], submesh.boundsMin[1], submesh.boundsMin[2], 1.0f);
+        object.boundsMax = quantize * glm::vec4(submesh.boundsMax[0], submesh.boundsMax[1], submesh.boundsMax[2], 1.0f);
+        object.indexOffset = submesh.indexOffset;
+        object.indexCount = submesh.indexCount;
+        object.materialIndex = submesh.materialIndex;
+        object.padding = 0;
+    }
+    m_objectCount = static_cast<uint32_t>(objects.size());
+    createLocalBuffer(objects, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, m_objectBuffer, m_objectBufferMemory);
+
+    std::vector<InstanceData> instances = buildInstances();
+    m_instanceCount = static_cast<uint32_t>(instances.size());
+    createLocalBuffer(instances, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, m_instanceBuffer, m_instanceBufferMemory);
+    uint64_t pairCount = static_cast<uint64_t>(m_instanceCount) * m_objectCount;
+    if (pairCount > UINT32_MAX) {
+        throw std::runtime_error("instance count times submesh count exceeds 2^32!");
+    }
+
+    // 每个(实例, 子网格)在DrawInstance中最多出现一次，每帧一个分段
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(m_physicalDevice, &properties);
+    VkDeviceSize alignment = properties.limits.minStorageBufferOffsetAlignment;
+    m_drawInstanceStride = (sizeof(DrawInstance) * std::max<uint64_t>(pairCount, 1) + alignment - 1) / alignment * alignment;
+    createBuffer(m_drawInstanceStride * MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                 m_config.gpuDriven ? VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+                                    : VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                 m_drawInstanceBuffer, m_drawInstanceMemory);
+
+    if (!m_config.gpuDriven) {
+        // 模型矩阵与实例变换都不随时间变化，世界空间的包围盒只需计算一次
+        std::vector<MeshBounds> worldBounds(pairCount);
+        glm::mat4 model = modelMatrix();
+        for (uint32_t instance = 0; instance < m_instanceCount; instance++) {
+            glm::mat4 transform = instances[instance].transform * model;
+            for (uint32_t object = 0; object < m_objectCount; object++) {
+                MeshBounds bounds = {glm::vec3(objects[object].boundsMin), glm::vec3(objects[object].boundsMax)};
+                worldBounds[static_cast<size_t>(instance) * m_objectCount + object] =
+                    FrustumCuller::transformBounds(transform, bounds);
+            }
+        }
+        auto startTime = std::chrono::high_resolution_clock::now();
+        m_frustumCuller.build(worldBounds);
+        double buildMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+        std::cout << "culling: BVH over " << m_instanceCount << " instances x " << m_objectCount << " submeshes ("
+                  << m_frustumCuller.nodeCount() << " nodes) built in " << buildMs << " ms, "
+                  << FrustumCuller::simdPath() << std::endl;
+        return;
+    }
+    if (m_objectCount > properties.limits.maxDrawIndirectCount) {
+        throw std::runtime_error("object count exceeds maxDrawIndirectCount!");
+    }
+    if ((pairCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE > properties.limits.maxComputeWorkGroupCount[0]) {
+        throw std::runtime_error("instance count exceeds maxComputeWorkGroupCount!");
+    }
+    // 绘制参数每帧由剔除着色器重写，每个预渲染帧一份，避免覆盖仍在使用的上一帧；
+    // 每个子网格至多一次实例化绘制，数量缓冲在绘制数量之后存放每个子网格的可见实例数
+    m_indirectDraws.resize(MAX_FRAMES_IN_FLIGHT);
+    for (auto& draws : m_indirectDraws) {
+        createBuffer(sizeof(VkDrawIndexedIndirectCommand) * std::max<uint32_t>(m_objectCount, 1),
+                     VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                     VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, draws.commands, draws.commandsMemory);
+        createBuffer(sizeof(uint32_t) * (1 + m_objectCount),
+                     VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT
+                         | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                     VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, draws.count, draws.countMemory);
+    }
+    std::cout << "gpu driven: " << m_instanceCount << " instances x " << m_objectCount << " submeshes culled on the GPU, "
+              << (pairCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE << " workgroups per frame" << std::endl;
+}
 
-    return commandBuffer;
+std::vector<InstanceData> LearnVKApp::buildInstances() {
+    // 模型空间的整体包围盒决定网格间距，相邻拷贝之间留出四分之一的空隙
+    glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+    for (const Submesh& submesh : m_submeshes) {
+        boundsMin = glm::min(boundsMin, glm::vec3(submesh.boundsMin[0], submesh.boundsMin[1], submesh.boundsMin[2]));
+        boundsMax = glm::max(boundsMax, glm::vec3(submesh.boundsMax[0], submesh.boundsMax[1], submesh.boundsMax[2]));
+    }
+    glm::vec3 extent = m_submeshes.empty() ? glm::vec3(0.0f) : boundsMax - boundsMin;
+    float spacing = 1.25f * std::max(extent.x, extent.y);
+    // 在XY平面上排成居中的正方形网格，只有一个实例时位于原点，与之前的单模型场景一致
+    uint32_t side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(m_config.instanceCount))));
+    float center = (side - 1) * 0.5f;
+    std::vector<InstanceData> instances(m_config.instanceCount);
+    for (uint32_t i = 0; i < m_config.instanceCount; i++) {
+        glm::vec3 offset((i % side - center) * spacing, (i / side - center) * spacing, 0.0f);
+        instances[i].transform = glm::translate(glm::mat4(1.0f), offset);
+    }
+    return instances;
 }
 
-void LearnVKApp::endSingleTimeCommand(VkCommandBuffer& commandBuffer) {
-    vkEndCommandBuffer(commandBuffer);
+template <typename T>
+void LearnVKApp::createLocalBuffer(const std::vector<T>& info,
+                                   VkBufferUsageFlags usage, VkBuffer& buffer,
+                                   MemoryAllocation& memory) {
+    createLocalBuffer(info.data(), sizeof(T) * info.size(), usage, buffer, memory);
+}
 
-    VkSubmitInfo submitInfo = {};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffer;
-    VkQueue queue = m_queueMap["graphicsFamily"];
-    vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE);
-    vkQueueWaitIdle(queue);
-    vkFreeCommandBuffers(m_device, m_commandPool, 1, &commandBuffer);
+void LearnVKApp::createLocalBuffer(const void* info, VkDeviceSize bufferSize,
+                                   VkBufferUsageFlags usage, VkBuffer& buffer,
+                                   MemoryAllocation& memory) {
+    // 创建CPU不可访问的缓存，数据经暂存环形缓冲拷贝，随当前上传批次一起提交
+    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage,
+                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer, memory);
+    VkAccessFlags dstAccess = 0;
+    if (usage & VK_BUFFER_USAGE_VERTEX_BUFFER_BIT) {
+        dstAccess |= VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+    }
+    if (usage & VK_BUFFER_USAGE_INDEX_BUFFER_BIT) {
+        dstAccess |= VK_ACCESS_INDEX_READ_BIT;
+    }
+    VkPipelineStageFlags dstStage = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+    if (usage & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT) { // 物体缓冲由顶点着色器与剔除着色器读取
+        dstAccess |= VK_ACCESS_SHADER_READ_BIT;
+        dstStage |= VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    }
+    m_uploadContext.uploadBuffer(info, bufferSize, buffer, dstAccess, dstStage);
 }
 
 void LearnVKApp::createUniformBuffers() {
-    VkDeviceSize bufferSize = sizeof(UniformBufferObject);
-    // 每一个swapchain image一个ubo buffer
-    size_t imagesNum = m_swapChainImages.size();
-    m_uboBuffers.resize(imagesNum);
-    m_uboBufferMemories.resize(imagesNum);
-    for (int i = 0; i < imagesNum; i++) {
-        createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                     m_uboBuffers[i], m_uboBufferMemories[i]);
-    }
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(m_physicalDevice, &properties);
+    // 每一个预渲染帧一个分段，帧内的ubo块按minUniformBufferOffsetAlignment对齐后依次排列
+    m_uniformRing.init(m_device, m_allocator, properties.limits.minUniformBufferOffsetAlignment,
+                       MAX_FRAMES_IN_FLIGHT);
 }
 
 void LearnVKApp::createDescriptorPool() {
+    // 流式加载时材质数量要等模型读完才知道，纹理数组按设备上限分配
+    m_textureDescriptorCount = m_config.stream ? maxMaterialTextures() : static_cast<uint32_t>(m_textures.size());
+    uint32_t frameCount = MAX_FRAMES_IN_FLIGHT;
+
     VkDescriptorPoolSize uniformPoolSize = {};
-    uint32_t imageCount = static_cast<uint32_t>(m_swapChainImages.size());
-    uniformPoolSize.descriptorCount = imageCount;
-    uniformPoolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    uniformPoolSize.descriptorCount = frameCount;
+    uniformPoolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 
     VkDescriptorPoolSize samplerPoolSize = {};
-    samplerPoolSize.descriptorCount = imageCount;
+    samplerPoolSize.descriptorCount = frameCount * std::max<uint32_t>(m_textureDescriptorCount, 1);
     samplerPoolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 
-    VkDescriptorPoolSize poolSizes[2] = {uniformPoolSize, samplerPoolSize};
+    VkDescriptorPoolSize storagePoolSize = {}; // 物体与实例缓冲，以及每帧剔除管线的绘制参数与数量
+    storagePoolSize.descriptorCount = 2 * frameCount + (m_config.gpuDriven ? 2 * frameCount : 0);
+    storagePoolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+
+    VkDescriptorPoolSize drawInstancePoolSize = {};
+    drawInstancePoolSize.descriptorCount = frameCount;
+    drawInstancePoolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+
+    VkDescriptorPoolSize poolSizes[4] = {uniformPoolSize, samplerPoolSize, storagePoolSize, drawInstancePoolSize};
 
     VkDescriptorPoolCreateInfo createInfo = {};
     createInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    createInfo.poolSizeCount = 2;
+    createInfo.poolSizeCount = 4;
     createInfo.pPoolSizes = poolSizes;
-    createInfo.maxSets = imageCount;
+    createInfo.maxSets = frameCount + (m_config.gpuDriven ? frameCount : 0);
 
     VkResult res =
         vkCreateDescriptorPool(m_device, &createInfo, nullptr, &m_descriptorPool);
@@ -1117,52 +1768,143 @@ void LearnVKApp::createDescriptorPool() {
 }
 
 void LearnVKApp::createDescriptorSets() {
-    size_t imageCount = m_swapChainImages.size();
-    std::vector<VkDescriptorSetLayout> layouts(imageCount, m_descriptorSetLayout);
+    // 每个预渲染帧一个set 0，流式加载完成的纹理只改写即将录制的帧，不会碰到GPU仍在使用的set
+    m_descriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
+    std::vector<VkDescriptorSetLayout> layouts(m_descriptorSets.size(), m_descriptorSetLayout);
+    std::vector<uint32_t> textureCounts(m_descriptorSets.size(), m_textureDescriptorCount);
     VkDescriptorSetAllocateInfo allocInfo = {};
     allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
     allocInfo.descriptorPool = m_descriptorPool;
-    allocInfo.descriptorSetCount = static_cast<uint32_t>(imageCount);
+    allocInfo.descriptorSetCount = static_cast<uint32_t>(layouts.size());
     allocInfo.pSetLayouts = layouts.data();
+    VkDescriptorSetVariableDescriptorCountAllocateInfo variableCountInfo = {}; // 纹理数组的实际长度
+    variableCountInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO;
+    variableCountInfo.descriptorSetCount = static_cast<uint32_t>(textureCounts.size());
+    variableCountInfo.pDescriptorCounts = textureCounts.data();
+    allocInfo.pNext = &variableCountInfo;
 
-    m_descriptorSets.resize(imageCount);
     VkResult res =
         vkAllocateDescriptorSets(m_device, &allocInfo, m_descriptorSets.data());
     if (res != VK_SUCCESS) {
         throw std::runtime_error("failed to create descriptor sets!");
     }
-
-    for (int i = 0; i < imageCount; i++) {
-        VkDescriptorBufferInfo bufferInfo = {}; // Uniform Object Buffer
-        bufferInfo.buffer = m_uboBuffers[i];
-        bufferInfo.range = sizeof(UniformBufferObject);
-        bufferInfo.offset = 0;
-
-        VkDescriptorImageInfo imageInfo = {}; // image sampler
-        imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        imageInfo.imageView = m_textureImageView;
-        imageInfo.sampler = m_textureSampler;
-
-        VkWriteDescriptorSet bufferWrite = {};
-        bufferWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        bufferWrite.dstSet = m_descriptorSets[i];
-        bufferWrite.dstBinding = 0;
-        bufferWrite.dstArrayElement = 0;
-        bufferWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        bufferWrite.descriptorCount = 1;
-        bufferWrite.pBufferInfo = &bufferInfo; // 指定缓冲
-
-        VkWriteDescriptorSet imageWrite = {};
-        imageWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        imageWrite.dstSet = m_descriptorSets[i];
-        imageWrite.dstBinding = 1;
-        imageWrite.dstArrayElement = 0;
-        imageWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        imageWrite.descriptorCount = 1;
-        imageWrite.pImageInfo = &imageInfo; //指定引用的图像
-
-        VkWriteDescriptorSet descWrites[2] = {bufferWrite, imageWrite};
-        vkUpdateDescriptorSets(m_device, 2, descWrites, 0, nullptr);
+    m_descriptorSetVersions.assign(m_descriptorSets.size(), 0);
+    for (uint32_t i = 0; i < m_descriptorSets.size(); i++) {
+        writeDescriptorSet(i);
+    }
+    createCullDescriptorSets();
+}
+
+void LearnVKApp::writeDescriptorSet(uint32_t frameIndex) {
+    VkDescriptorSet descriptorSet = m_descriptorSets[frameIndex];
+    std::vector<VkWriteDescriptorSet> descWrites;
+
+    VkDescriptorBufferInfo bufferInfo = {}; // Uniform Object Buffer，绑定时由动态偏移指定实际位置
+    bufferInfo.buffer = m_uniformRing.buffer();
+    bufferInfo.range = sizeof(UniformBufferObject);
+    bufferInfo.offset = 0;
+
+    VkWriteDescriptorSet bufferWrite = {};
+    bufferWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    bufferWrite.dstSet = descriptorSet;
+    bufferWrite.dstBinding = 0;
+    bufferWrite.dstArrayElement = 0;
+    bufferWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    bufferWrite.descriptorCount = 1;
+    bufferWrite.pBufferInfo = &bufferInfo; // 指定缓冲
+    descWrites.push_back(bufferWrite);
+
+    // 物体相关的缓冲在流式加载的模型上传完成前还不存在，场景就绪前也不会有绘制引用它们
+    VkDescriptorBufferInfo objectInfo = {};
+    objectInfo.buffer = m_objectBuffer;
+    objectInfo.offset = 0;
+    objectInfo.range = VK_WHOLE_SIZE;
+
+    VkWriteDescriptorSet objectWrite = {};
+    objectWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    objectWrite.dstSet = descriptorSet;
+    objectWrite.dstBinding = 1;
+    objectWrite.dstArrayElement = 0;
+    objectWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    objectWrite.descriptorCount = 1;
+    objectWrite.pBufferInfo = &objectInfo;
+
+    VkDescriptorBufferInfo instanceInfo = {};
+    instanceInfo.buffer = m_instanceBuffer;
+    instanceInfo.offset = 0;
+    instanceInfo.range = VK_WHOLE_SIZE;
+
+    VkWriteDescriptorSet instanceWrite = objectWrite;
+    instanceWrite.dstBinding = 2;
+    instanceWrite.pBufferInfo = &instanceInfo;
+
+    VkDescriptorBufferInfo drawInstanceInfo = {}; // 一个帧分段，绑定时由动态偏移指定实际位置
+    drawInstanceInfo.buffer = m_drawInstanceBuffer;
+    drawInstanceInfo.offset = 0;
+    drawInstanceInfo.range = m_drawInstanceStride;
+
+    VkWriteDescriptorSet drawInstanceWrite = objectWrite;
+    drawInstanceWrite.dstBinding = 3;
+    drawInstanceWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+    drawInstanceWrite.pBufferInfo = &drawInstanceInfo;
+
+    if (m_objectBuffer != VK_NULL_HANDLE) {
+        descWrites.push_back(objectWrite);
+        descWrites.push_back(instanceWrite);
+        descWrites.push_back(drawInstanceWrite);
+    }
+
+    // image sampler，按材质序号排列，尚未驻留的纹理先指向占位纹理
+    std::vector<VkDescriptorImageInfo> imageInfos(m_textures.size());
+    for (size_t i = 0; i < m_textures.size(); i++) {
+        imageInfos[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        imageInfos[i].imageView = m_textureResident[i] ? m_textures[i].view : m_placeholderTexture.view;
+        imageInfos[i].sampler = m_textureSampler;
+    }
+
+    VkWriteDescriptorSet imageWrite = {};
+    imageWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    imageWrite.dstSet = descriptorSet;
+    imageWrite.dstBinding = 4;
+    imageWrite.dstArrayElement = 0;
+    imageWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    imageWrite.descriptorCount = static_cast<uint32_t>(imageInfos.size());
+    imageWrite.pImageInfo = imageInfos.data(); //指定引用的图像
+    if (!imageInfos.empty()) {
+        descWrites.push_back(imageWrite);
+    }
+
+    vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(descWrites.size()), descWrites.data(), 0, nullptr);
+    m_descriptorSetVersions[frameIndex] = m_descriptorVersion;
+}
+
+void LearnVKApp::createCullDescriptorSets() {
+    for (auto& draws : m_indirectDraws) { // 剔除管线每个预渲染帧一个set 1
+        VkDescriptorSetAllocateInfo cullAllocInfo = {};
+        cullAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        cullAllocInfo.descriptorPool = m_descriptorPool;
+        cullAllocInfo.descriptorSetCount = 1;
+        cullAllocInfo.pSetLayouts = &m_cullDescriptorSetLayout;
+        VkResult res = vkAllocateDescriptorSets(m_device, &cullAllocInfo, &draws.descriptorSet);
+        if (res != VK_SUCCESS) {
+            throw std::runtime_error("failed to create descriptor sets!");
+        }
+        VkDescriptorBufferInfo cullInfos[2] = {};
+        cullInfos[0].buffer = draws.commands;
+        cullInfos[0].range = VK_WHOLE_SIZE;
+        cullInfos[1].buffer = draws.count;
+        cullInfos[1].range = VK_WHOLE_SIZE;
+        VkWriteDescriptorSet cullWrites[2] = {};
+        for (uint32_t i = 0; i < 2; i++) {
+            cullWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            cullWrites[i].dstSet = draws.descriptorSet;
+            cullWrites[i].dstBinding = i;
+            cullWrites[i].dstArrayElement = 0;
+            cullWrites[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            cullWrites[i].descriptorCount = 1;
+            cullWrites[i].pBufferInfo = &cullInfos[i];
+        }
+        vkUpdateDescriptorSets(m_device, 2, cullWrites, 0, nullptr);
     }
 }
 
@@ -1181,6 +1923,75 @@ void LearnVKApp::createCommandBuffers() {
     }
 }
 
+void LearnVKApp::createCachedCommandBuffers() {
+    if (!m_cachedCommandBuffers.empty()) {
+        vkFreeCommandBuffers(m_device, m_commandPool,
+                             static_cast<uint32_t>(m_cachedCommandBuffers.size()),
+                             m_cachedCommandBuffers.data());
+        m_cachedCommandBuffers.clear();
+    }
+    if (!m_config.cacheCommands) {
+        return;
+    }
+    m_cachedCommandBuffers.resize(m_swapChainImages.size() * MAX_FRAMES_IN_FLIGHT);
+    VkCommandBufferAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandPool = m_commandPool;
+    allocInfo.commandBufferCount = static_cast<uint32_t>(m_cachedCommandBuffers.size());
+    VkResult res =
+        vkAllocateCommandBuffers(m_device, &allocInfo, m_cachedCommandBuffers.data());
+    if (res != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate command buffer!");
+    }
+    m_cachedUboOffsets.assign(m_cachedCommandBuffers.size(), 0);
+    invalidateCommandBuffers();
+}
+
+void LearnVKApp::createRecordPools() {
+    if (!m_config.parallelRecord) {
+        return;
+    }
+    QueueFamiliyIndices indices = findDeviceQueueFamilies(m_physicalDevice);
+    m_recordSlotCount = m_threadPool.threadCount() + 1; // parallelFor的调用线程也参与录制
+    m_recordPools.resize(MAX_FRAMES_IN_FLIGHT * m_recordSlotCount);
+    m_secondaryCommandBuffers.resize(m_recordPools.size());
+    for (size_t i = 0; i < m_recordPools.size(); i++) {
+        VkCommandPoolCreateInfo createInfo = {};
+        createInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        createInfo.queueFamilyIndex = indices.graphicsFamily;
+        createInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT; // 每帧整体重置，不单独重置指令缓冲
+        if (vkCreateCommandPool(m_device, &createInfo, nullptr, &m_recordPools[i]) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create command pool!");
+        }
+        VkCommandBufferAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+        allocInfo.commandPool = m_recordPools[i];
+        allocInfo.commandBufferCount = 1;
+        if (vkAllocateCommandBuffers(m_device, &allocInfo, &m_secondaryCommandBuffers[i]) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate command buffer!");
+        }
+    }
+    std::cout << "commands: recording draws on " << m_recordSlotCount << " threads with secondary command buffers"
+              << std::endl;
+}
+
+void LearnVKApp::invalidateCommandBuffers() {
+    m_cachedCommandValid.assign(m_cachedCommandBuffers.size(), false);
+}
+
+void LearnVKApp::printCommandStats(uint32_t frameCount) {
+    std::cout << "commands: " << m_commandRecordCount << " command buffer records in " << frameCount << " frames"
+              << (m_config.cacheCommands ? " (cached)" : "") << ", "
+              << (m_commandRecordCount > 0 ? m_commandRecordMs / m_commandRecordCount : 0.0) << " ms per record" << std::endl;
+    if (m_cullCount > 0) {
+        std::cout << "culling: " << m_visibleObjects.size() << " of " << m_instanceCount * m_objectCount
+                  << " submesh instances visible in " << m_drawBatches.size() << " instanced draws, "
+                  << m_cullMs / m_cullCount << " ms per frame" << std::endl;
+    }
+}
+
 void LearnVKApp::createSyncObjects() {
     VkSemaphoreCreateInfo createInfo = {};
     createInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
@@ -1206,7 +2017,8 @@ void LearnVKApp::createSyncObjects() {
 }
 
 void LearnVKApp::recordCommandBuffers(VkCommandBuffer commandBuffer,
-                                      uint32_t imageIndex) {
+                                      uint32_t imageIndex, uint32_t uboOffset) {
+    auto startTime = std::chrono::high_resolution_clock::now();
     // 让command buffer 开始记录执行指令
     VkCommandBufferBeginInfo beginInfo = {};
     beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
@@ -1216,6 +2028,17 @@ void LearnVKApp::recordCommandBuffers(VkCommandBuffer commandBuffer,
     if (res != VK_SUCCESS) {
         throw std::runtime_error("failed to begin command buffer!");
     }
+    // 缓存的指令缓冲跨帧复用，而次级指令缓冲所在的池每帧重置，所以缓存模式下直接在主指令缓冲中录制；
+    // gpuDriven模式下只有一次间接绘制，没有可以分给多个线程的工作；
+    // 流式加载的模型上传完成之前只清屏
+    bool parallel = m_sceneReady && !m_recordPools.empty() && !m_config.cacheCommands && !m_config.gpuDriven;
+    m_gpuProfiler.beginScope(commandBuffer, m_currentFrameIndex, m_frameScope);
+    if (m_sceneReady && m_config.gpuDriven) { // 计算分派不能在渲染流程内录制
+        m_gpuProfiler.beginScope(commandBuffer, m_currentFrameIndex, m_cullScope);
+        recordCulling(commandBuffer, uboOffset);
+        m_gpuProfiler.endScope(commandBuffer, m_currentFrameIndex, m_cullScope);
+    }
+    size_t drawCount = m_drawBatches.size();
     // 开始渲染流程
     VkRenderPassBeginInfo renderPassBeginInfo = {};
     renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
@@ -1228,8 +2051,54 @@ void LearnVKApp::recordCommandBuffers(VkCommandBuffer commandBuffer,
     clearValues[1].depthStencil = {1.0f, 0};
     renderPassBeginInfo.clearValueCount = 2;
     renderPassBeginInfo.pClearValues = clearValues.data();
+    // 使用次级指令缓冲的子流程中只能执行vkCmdExecuteCommands，时间戳写在渲染流程之外
+    m_gpuProfiler.beginScope(commandBuffer, m_currentFrameIndex, m_renderPassScope);
     vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo,
-                         VK_SUBPASS_CONTENTS_INLINE);
+                         parallel ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
+    if (parallel) {
+        // 实例化绘制均分给各录制槽，每个槽在线程池上重置自己的指令池并录制一个次级指令缓冲
+        size_t slotCount = std::max<size_t>(1, std::min<size_t>(m_recordSlotCount, drawCount));
+        std::vector<VkCommandBuffer> secondaries(slotCount);
+        m_threadPool.parallelFor(slotCount, [&](size_t slot) {
+            size_t index = m_currentFrameIndex * m_recordSlotCount + slot;
+            vkResetCommandPool(m_device, m_recordPools[index], 0);
+            VkCommandBuffer secondary = m_secondaryCommandBuffers[index];
+            VkCommandBufferInheritanceInfo inheritanceInfo = {};
+            inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+            inheritanceInfo.renderPass = m_renderPass;
+            inheritanceInfo.subpass = 0;
+            inheritanceInfo.framebuffer = m_swapChainFrameBuffers[imageIndex];
+            VkCommandBufferBeginInfo secondaryBeginInfo = {};
+            secondaryBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            secondaryBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+                                       | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+            secondaryBeginInfo.pInheritanceInfo = &inheritanceInfo;
+            if (vkBeginCommandBuffer(secondary, &secondaryBeginInfo) != VK_SUCCESS) {
+                throw std::runtime_error("failed to begin secondary command buffer!");
+            }
+            recordDraws(secondary, uboOffset, drawCount * slot / slotCount, drawCount * (slot + 1) / slotCount);
+            if (vkEndCommandBuffer(secondary) != VK_SUCCESS) {
+                throw std::runtime_error("failed to record secondary command buffer!");
+            }
+            secondaries[slot] = secondary;
+        });
+        vkCmdExecuteCommands(commandBuffer, static_cast<uint32_t>(secondaries.size()), secondaries.data());
+    } else if (m_sceneReady) {
+        recordDraws(commandBuffer, uboOffset, 0, drawCount);
+    }
+    vkCmdEndRenderPass(commandBuffer);
+    m_gpuProfiler.endScope(commandBuffer, m_currentFrameIndex, m_renderPassScope);
+    m_gpuProfiler.endScope(commandBuffer, m_currentFrameIndex, m_frameScope);
+    res = vkEndCommandBuffer(commandBuffer);
+    if (res != VK_SUCCESS) {
+        throw std::runtime_error("failed to record command buffer!");
+    }
+    m_commandRecordCount++;
+    m_commandRecordMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+}
+
+void LearnVKApp::recordDraws(VkCommandBuffer commandBuffer, uint32_t uboOffset, size_t firstDraw, size_t lastDraw) {
+    // 次级指令缓冲不继承主指令缓冲的任何状态，管线、动态状态与绑定都需要重新设置
     vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
                       m_graphicsPipeline);
 
@@ -1253,18 +2122,77 @@ void LearnVKApp::recordCommandBuffers(VkCommandBuffer commandBuffer,
     vkCmdBindVertexBuffers(commandBuffer, 0, 1, pBuffer, offsets);
     // 开始绑定顶点索引
     vkCmdBindIndexBuffer(commandBuffer, m_indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+    uint32_t dynamicOffsets[2] = {uboOffset, drawInstanceOffset()};
     vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                            m_pipelineLayout, 0, 1, &m_descriptorSets[imageIndex],
-                            0, nullptr);
+                            m_pipelineLayout, 0, 1, &m_descriptorSets[m_currentFrameIndex],
+                            2, dynamicOffsets);
     // vkCmdDraw(commandBuffer, static_cast<uint32_t>(g_vertices.size()), 1, 0,
     // 0);
-    vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(g_indices.size()), 1, 0,
-                     0, 0);
-    vkCmdEndRenderPass(commandBuffer);
-    res = vkEndCommandBuffer(commandBuffer);
-    if (res != VK_SUCCESS) {
-        throw std::runtime_error("failed to record command buffer!");
+    if (m_config.gpuDriven) { // 绘制参数与数量都由剔除着色器写入，CPU的开销与物体数量无关
+        const IndirectDrawBuffers& draws = m_indirectDraws[m_currentFrameIndex];
+        vkCmdDrawIndexedIndirectCount(commandBuffer, draws.commands, 0, draws.count, 0, m_objectCount,
+                                      sizeof(VkDrawIndexedIndirectCommand));
+        return;
     }
+    // 每个有可见实例的子网格一次实例化绘制，firstInstance指向它在DrawInstance中的起始位置
+    for (size_t i = firstDraw; i < lastDraw; i++) {
+        const DrawBatch& batch = m_drawBatches[i];
+        const Submesh& submesh = m_submeshes[batch.objectIndex];
+        vkCmdDrawIndexed(commandBuffer, submesh.indexCount, batch.instanceCount, submesh.indexOffset,
+                         0, batch.firstInstance);
+    }
+}
+
+void LearnVKApp::recordCulling(VkCommandBuffer commandBuffer, uint32_t uboOffset) {
+    const IndirectDrawBuffers& draws = m_indirectDraws[m_currentFrameIndex];
+    // 绘制数量与每个子网格的实例数清零后才能被剔除着色器累加
+    vkCmdFillBuffer(commandBuffer, draws.count, 0, VK_WHOLE_SIZE, 0);
+    VkBufferMemoryBarrier resetBarrier = {};
+    resetBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    resetBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    resetBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    resetBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    resetBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    resetBarrier.buffer = draws.count;
+    resetBarrier.offset = 0;
+    resetBarrier.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                         0, nullptr, 1, &resetBarrier, 0, nullptr);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_cullPipeline);
+    VkDescriptorSet descriptorSets[2] = {m_descriptorSets[m_currentFrameIndex], draws.descriptorSet};
+    uint32_t dynamicOffsets[2] = {uboOffset, drawInstanceOffset()};
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_cullPipelineLayout, 0, 2,
+                            descriptorSets, 2, dynamicOffsets);
+    // 第一遍逐(实例, 子网格)剔除，可见的实例写入所属子网格在DrawInstance中的区间
+    uint32_t pairCount = m_instanceCount * m_objectCount;
+    CullConstants constants = {m_objectCount, m_instanceCount, 0};
+    vkCmdPushConstants(commandBuffer, m_cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                       sizeof(CullConstants), &constants);
+    vkCmdDispatch(commandBuffer, (pairCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+    // 第二遍读取每个子网格的可见实例数
+    VkMemoryBarrier countBarrier = {};
+    countBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    countBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    countBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                         1, &countBarrier, 0, nullptr, 0, nullptr);
+
+    // 第二遍逐子网格生成实例化绘制，没有可见实例的子网格不占用绘制
+    constants.phase = 1;
+    vkCmdPushConstants(commandBuffer, m_cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                       sizeof(CullConstants), &constants);
+    vkCmdDispatch(commandBuffer, (m_objectCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+    // 剔除着色器写入的绘制参数与数量在间接绘制阶段读取，DrawInstance由顶点着色器读取
+    VkMemoryBarrier drawBarrier = {};
+    drawBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    drawBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    drawBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0,
+                         1, &drawBarrier, 0, nullptr, 0, nullptr);
 }
 
 VkShaderModule
@@ -1282,21 +2210,6 @@ LearnVKApp::createShaderModule(const std::vector<unsigned char>& code) {
     return shaderModule;
 }
 
-// 查找合适的内存类型
-uint32_t LearnVKApp::findMemoryType(uint32_t typeFilter,
-                                    VkMemoryPropertyFlags properties) {
-    VkPhysicalDeviceMemoryProperties memProperties;
-    vkGetPhysicalDeviceMemoryProperties(m_physicalDevice, &memProperties);
-    for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-        // typeFilter要求只需要响应位域为1，
-        // 然后目标的properties位域要与遍历元素完全相同
-        if ((typeFilter & (1 << i)) && (properties & memProperties.memoryTypes[i].propertyFlags) == properties) {
-            return i;
-        }
-    }
-    throw std::runtime_error("failed to find suitable memory type!");
-}
-
 bool LearnVKApp::checkValidationLayersProperties() {
     uint32_t validationLayersCount = 0;
     vkEnumerateInstanceLayerProperties(&validationLayersCount, nullptr);
@@ -1336,6 +2249,12 @@ void LearnVKApp::pickPhysicalDevice() {
     if (m_physicalDevice == VK_NULL_HANDLE) {
         throw std::runtime_error("failed to pick a suitable GPU!");
     }
+    if (m_config.msaaSamples != 0) { // 基准测试需要固定的采样数，设备不支持时报错而不是静默降级
+        if (m_config.msaaSamples > static_cast<uint32_t>(m_msaaSampleCount)) {
+            throw std::runtime_error("requested msaa sample count is not supported by the device!");
+        }
+        m_msaaSampleCount = static_cast<VkSampleCountFlagBits>(m_config.msaaSamples);
+    }
 }
 
 // 通过获取properties 和 features然后判断是否满足需求
@@ -1349,19 +2268,35 @@ bool LearnVKApp::isDeviceSuitable(VkPhysicalDevice physicalDevice) {
     QueueFamiliyIndices indices = findDeviceQueueFamilies(physicalDevice);
     // 查询设备是否支持要求的扩展
     bool extentionsSupport = checkDeviceExtentionsSupport(physicalDevice);
-    bool swapChainAdequate = false;
-    if (extentionsSupport) {
+    bool swapChainAdequate = m_config.headless; // 离屏模式不需要交换链
+    if (extentionsSupport && !m_config.headless) {
         auto swapChainDetails = queryDeviceSwapChainSupport(physicalDevice);
         swapChainAdequate = !swapChainDetails.formats.empty() && !swapChainDetails.presentModes.empty();
     }
-    return indices.isComplete() && extentionsSupport && swapChainAdequate && features.samplerAnisotropy;
+    // 材质纹理数组需要运行时长度的描述符数组与可变长度的绑定
+    bool descriptorIndexing = false;
+    if (properties.apiVersion >= VK_API_VERSION_1_2) {
+        VkPhysicalDeviceVulkan12Features features12 = {};
+        features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+        VkPhysicalDeviceFeatures2 features2 = {};
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features2.pNext = &features12;
+        vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+        descriptorIndexing = features12.runtimeDescriptorArray && features12.descriptorBindingVariableDescriptorCount
+                             && features12.descriptorBindingPartiallyBound
+                             && features.shaderSampledImageArrayDynamicIndexing;
+    }
+    return indices.isComplete() && extentionsSupport && swapChainAdequate && features.samplerAnisotropy
+           && descriptorIndexing;
 }
 
 void LearnVKApp::createLogicalDevice() {
     QueueFamiliyIndices indices = findDeviceQueueFamilies(m_physicalDevice);
     std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
     float queuePriority = 1.0f;
-    for (auto index : indices.familiesIndexSet) {
+    std::set<uint32_t> queueFamilies = indices.familiesIndexSet;
+    queueFamilies.insert(indices.transferFamily); // 传输队列只在设备内部使用，不参与交换链图片的共享
+    for (auto index : queueFamilies) {
         VkDeviceQueueCreateInfo queueCreateInfo = {};
         queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
         queueCreateInfo.queueCount = 1;
@@ -1371,9 +2306,43 @@ void LearnVKApp::createLogicalDevice() {
     }
 
     // 填写物理设备features
-    VkPhysicalDeviceFeatures features = {};
+    VkPhysicalDeviceFeatures supportedFeatures = {};
+    vkGetPhysicalDeviceFeatures(m_physicalDevice, &supportedFeatures);
+    VkPhysicalDeviceVulkan12Features features12 = {}; // 1.2核心的descriptor indexing，用于材质纹理数组
+    features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    features12.runtimeDescriptorArray = VK_TRUE;
+    features12.descriptorBindingVariableDescriptorCount = VK_TRUE;
+    features12.descriptorBindingPartiallyBound = VK_TRUE;
+    VkPhysicalDeviceFeatures2 features2 = {}; // 使用pNext链时features通过它传入，pEnabledFeatures需为空
+    features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features2.pNext = &features12;
+    VkPhysicalDeviceFeatures& features = features2.features;
     features.samplerAnisotropy = VK_TRUE; // 此处我们需要启用各项异性
     features.sampleRateShading = VK_TRUE; // 开启多重采样着色
+    features.shaderSampledImageArrayDynamicIndexing = VK_TRUE; // 按物体数据中的材质序号索引纹理数组
+    features.textureCompressionBC = supportedFeatures.textureCompressionBC; // 烘焙纹理使用BC格式，不支持时回退到源图片
+    m_textureCompressionBC = supportedFeatures.textureCompressionBC == VK_TRUE;
+    VkPhysicalDeviceVulkan12Features supported12 = {};
+    supported12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    VkPhysicalDeviceFeatures2 supported2 = {};
+    supported2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    supported2.pNext = &supported12;
+    vkGetPhysicalDeviceFeatures2(m_physicalDevice, &supported2);
+    if (m_config.gpuDriven) { // 间接绘制的数量从缓冲中读取，每条绘制通过firstInstance传入物体序号
+        if (!supported12.drawIndirectCount || !supportedFeatures.multiDrawIndirect
+            || !supportedFeatures.drawIndirectFirstInstance) {
+            throw std::runtime_error("gpu driven rendering requires drawIndirectCount, multiDrawIndirect and drawIndirectFirstInstance!");
+        }
+        features12.drawIndirectCount = VK_TRUE;
+        features.multiDrawIndirect = VK_TRUE;
+        features.drawIndirectFirstInstance = VK_TRUE;
+    }
+    if (m_config.gpuProfile) { // 时间戳查询读取后在主机端重置，不需要在指令缓冲中录制重置
+        if (!supported12.hostQueryReset) {
+            throw std::runtime_error("gpu profiling requires hostQueryReset!");
+        }
+        features12.hostQueryReset = VK_TRUE;
+    }
 
     VkDeviceCreateInfo deviceCreateInfo = {};
     deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -1381,7 +2350,8 @@ void LearnVKApp::createLogicalDevice() {
     // 只创建一个队列
     deviceCreateInfo.queueCreateInfoCount =
         static_cast<uint32_t>(queueCreateInfos.size());
-    deviceCreateInfo.pEnabledFeatures = &features;
+    deviceCreateInfo.pNext = &features2;
+    deviceCreateInfo.pEnabledFeatures = nullptr;
     deviceCreateInfo.enabledExtensionCount =
         static_cast<uint32_t>(m_deviceExtentions.size());
     deviceCreateInfo.ppEnabledExtensionNames = m_deviceExtentions.data();
@@ -1407,6 +2377,10 @@ void LearnVKApp::createLogicalDevice() {
     vkGetDeviceQueue(m_device, static_cast<uint32_t>(indices.presentFamily), 0,
                      &queue);
     m_queueMap.insert(std::make_pair("presentFamily", queue));
+    vkGetDeviceQueue(m_device, static_cast<uint32_t>(indices.transferFamily), 0,
+                     &queue);
+    m_queueMap.insert(std::make_pair("transferFamily", queue));
+    m_allocator.init(m_physicalDevice, m_device);
 }
 
 QueueFamiliyIndices
@@ -1424,31 +2398,152 @@ LearnVKApp::findDeviceQueueFamilies(VkPhysicalDevice physicalDevice) {
 
     for (uint32_t i = 0; i < deviceQueueFamilyCount; i++) {
         VkQueueFamilyProperties queueFamily = properties[i];
-        vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, i, m_surface,
-                                             &presentSupport);
+        if (m_config.headless) { // 离屏模式没有surface，呈现队列族直接复用图形队列族
+            presentSupport = (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0;
+        } else {
+            vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, i, m_surface,
+                                                 &presentSupport);
+        }
+        if (indices.isComplete()) // 图形与呈现队列族确定后继续遍历，只为寻找传输队列族
+            continue;
         if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
             indices.graphicsFamily = i;
         }
         if (presentSupport) {
             indices.presentFamily = i;
         }
-        if (indices.isComplete())
+    }
+    // 只带TRANSFER位的队列族通常对应独立的DMA引擎，其次是任意与图形不同的队列族，都没有时退回图形队列族
+    int otherFamily = -1;
+    for (uint32_t i = 0; i < deviceQueueFamilyCount; i++) {
+        VkQueueFlags flags = properties[i].queueFlags;
+        if (static_cast<int>(i) == indices.graphicsFamily || properties[i].queueCount == 0) {
+            continue;
+        }
+        if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+            indices.transferFamily = i;
             break;
+        }
+        if (otherFamily < 0 && (flags & (VK_QUEUE_TRANSFER_BIT | VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+            otherFamily = i; // 支持图形或计算的队列族隐含支持传输
+        }
     }
+    if (indices.transferFamily < 0) {
+        indices.transferFamily = otherFamily >= 0 ? otherFamily : indices.graphicsFamily;
+    }
+    // 图形队列族的粒度固定为(1,1,1)，只传输的队列族可能更粗，全0时只能拷贝整个子资源
+    indices.transferGranularity = properties[indices.transferFamily].minImageTransferGranularity;
     indices.familiesIndexSet.insert(indices.graphicsFamily);
     indices.familiesIndexSet.insert(indices.presentFamily);
     return indices;
 }
 
 void LearnVKApp::loop() { // 应用的主循环
-    while (!glfwWindowShouldClose(m_window)) {
+    uint32_t frame = 0;
+    while (!glfwWindowShouldClose(m_window) && (m_config.frameCount == 0 || frame < m_config.frameCount)) {
         glfwPollEvents();
         drawFrame();
+        frame++;
+        if (frame == 1) {
+            reportStartup();
+        }
     }
     vkDeviceWaitIdle(m_device);
+    printCommandStats(frame);
+    printStreamStats(frame);
+    reportGpuProfile();
+}
+
+void LearnVKApp::headlessLoop() { // 离屏模式的主循环，渲染固定帧数并统计吞吐
+    uint32_t frameCount = headlessFrameCount();
+    if (m_config.warmupFrames > 0) {
+        // 预热帧让驱动完成延迟的编译与分配、缓存的指令缓冲完成录制，之后清空所有统计
+        for (uint32_t frame = 0; frame < m_config.warmupFrames; frame++) {
+            drawFrame();
+            if (frame == 0) {
+                reportStartup();
+            }
+        }
+        vkDeviceWaitIdle(m_device);
+        m_gpuProfiler.collectAll();
+        m_gpuProfiler.resetSamples();
+        m_commandRecordCount = 0;
+        m_commandRecordMs = 0.0;
+        m_cullCount = 0;
+        m_cullMs = 0.0;
+        std::cout << "headless: " << m_config.warmupFrames << " warm-up frames" << std::endl;
+    }
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(m_physicalDevice, &properties);
+    m_frameTimings.deviceName = properties.deviceName;
+    m_frameTimings.msaaSamples = static_cast<uint32_t>(m_msaaSampleCount);
+    m_frameTimings.cpuMs.clear();
+    m_frameTimings.cpuMs.reserve(frameCount);
+    auto startTime = std::chrono::high_resolution_clock::now();
+    for (uint32_t frame = 0; frame < frameCount; frame++) {
+        auto frameStart = std::chrono::high_resolution_clock::now();
+        drawFrame();
+        m_frameTimings.cpuMs.push_back(
+            std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - frameStart).count());
+        if (frame == 0) {
+            reportStartup(); // 没有预热帧时在这里输出，不计入第一帧的耗时
+        }
+    }
+    vkDeviceWaitIdle(m_device);
+    auto endTime = std::chrono::high_resolution_clock::now();
+    double totalMs = std::chrono::duration<double, std::milli>(endTime - startTime).count();
+    std::cout << "headless: " << frameCount << " frames (" << m_swapChainImageExtent.width << "x"
+              << m_swapChainImageExtent.height << ") in " << totalMs << " ms, "
+              << totalMs / frameCount << " ms/frame, " << frameCount * 1000.0 / totalMs << " fps" << std::endl;
+    printCommandStats(frameCount);
+    printStreamStats(frameCount);
+    reportGpuProfile(); // 读取了所有剩余的时间戳
+    m_gpuProfiler.samples("frame", m_frameTimings.gpuMs);
+}
+
+uint32_t LearnVKApp::headlessFrameCount() const {
+    return m_config.frameCount == 0 ? 300 : m_config.frameCount;
+}
+
+void LearnVKApp::reportGpuProfile() {
+    if (!m_gpuProfiler.enabled()) {
+        return;
+    }
+    m_gpuProfiler.collectAll();
+    m_gpuProfiler.print(std::cout);
+    if (m_config.gpuProfileCsv.empty()) {
+        return;
+    }
+    if (m_gpuProfiler.exportCsv(m_config.gpuProfileCsv)) {
+        std::cout << "gpu: profile written to " << m_config.gpuProfileCsv << std::endl;
+    } else {
+        std::cerr << "failed to write gpu profile: " << m_config.gpuProfileCsv << std::endl;
+    }
 }
 
-void LearnVKApp::updateUniformBuffers(uint32_t imageIndex) {
+void LearnVKApp::reportStartup() {
+    if (m_startupReported) {
+        return;
+    }
+    m_startupReported = true;
+    // drawFrame返回时第一帧只是提交(与呈现)，等待它的栅栏，首帧时间以GPU完成渲染为准；
+    // 其余预渲染帧的栅栏尚未提交过，创建时即为有信号状态，只会等到刚提交的这一帧，这次等待只发生一次
+    vkWaitForFences(m_device, static_cast<uint32_t>(m_fences.size()), m_fences.data(), VK_TRUE, MAX_TIMEOUT);
+    m_startupProfiler.mark("first frame");
+    double firstFrameMs = m_startupProfiler.elapsedMs();
+    m_startupProfiler.print(std::cout);
+    std::cout << "startup: first frame after " << firstFrameMs << " ms" << std::endl;
+    if (m_config.startupCsv.empty()) {
+        return;
+    }
+    if (m_startupProfiler.exportCsv(m_config.startupCsv)) {
+        std::cout << "startup: timeline written to " << m_config.startupCsv << std::endl;
+    } else {
+        std::cerr << "failed to write startup timeline: " << m_config.startupCsv << std::endl;
+    }
+}
+
+uint32_t LearnVKApp::updateUniformBuffers() {
     static auto startTime = std::chrono::high_resolution_clock::now();
 
     auto currentTime = std::chrono::high_resolution_clock::now();
@@ -1456,20 +2551,351 @@ void LearnVKApp::updateUniformBuffers(uint32_t imageIndex) {
                      currentTime - startTime)
                      .count();
     UniformBufferObject ubo = {};
-    ubo.model = glm::rotate(glm::mat4(1.0f), 0.0f,        // time * glm::radians(90.0f),
-                            glm::vec3(0.0f, 0.0f, 1.0f)); // 以Z轴为轴每秒旋转90°
+    ubo.model = modelMatrix();
     ubo.view = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0),
                            glm::vec3(0.0f, 0.0f, 1.0f)); // 从(2,2,2)看向(0,0,0)
     ubo.proj = glm::perspective(glm::radians(45.0f),
                                 m_swapChainImageExtent.width / static_cast<float>(m_swapChainImageExtent.height),
                                 0.1f, 10.0f); // 投影矩阵，fov:45 平截头体近0.1远10
     ubo.proj[1][1] *= -1;                     // 因为OpenGL与Vulkan的y轴正方向是反的，因此需要将y轴缩放系数取相反数
+    FrustumCuller::extractPlanes(ubo.proj * ubo.view, ubo.frustumPlanes);
+    if (m_sceneReady && !m_config.gpuDriven) {
+        cullObjects(ubo.frustumPlanes);
+    }
+
+    return m_uniformRing.push(ubo);
+}
 
-    void* data;
-    vkMapMemory(m_device, m_uboBufferMemories[imageIndex], 0, sizeof(ubo), 0,
-                &data);
-    memcpy(data, &ubo, sizeof(ubo));
-    vkUnmapMemory(m_device, m_uboBufferMemories[imageIndex]);
+glm::mat4 LearnVKApp::modelMatrix() const {
+    glm::mat4 model = glm::rotate(glm::mat4(1.0f), 0.0f,        // time * glm::radians(90.0f),
+                                  glm::vec3(0.0f, 0.0f, 1.0f)); // 以Z轴为轴每秒旋转90°
+    return model * m_positionDequantize;
+}
+
+void LearnVKApp::cullObjects(const glm::vec4 planes[6]) {
+    auto startTime = std::chrono::high_resolution_clock::now();
+    m_frustumCuller.cull(planes, m_cullResult);
+    if (m_cullResult != m_visibleObjects) { // 相机不动时可见集合不变，缓存的指令缓冲仍然有效
+        m_visibleObjects.swap(m_cullResult);
+        // 按子网格计数排序，同一子网格的可见实例连续存放，合并为一次实例化绘制
+        std::vector<uint32_t> offsets(m_objectCount + 1, 0);
+        for (uint32_t visible : m_visibleObjects) {
+            offsets[visible % m_objectCount + 1]++;
+        }
+        m_drawBatches.clear();
+        for (uint32_t object = 0; object < m_objectCount; object++) {
+            if (offsets[object + 1] > 0) {
+                m_drawBatches.push_back({object, offsets[object], offsets[object + 1]});
+            }
+            offsets[object + 1] += offsets[object];
+        }
+        m_drawInstances.resize(m_visibleObjects.size());
+        for (uint32_t visible : m_visibleObjects) {
+            uint32_t object = visible % m_objectCount;
+            m_drawInstances[offsets[object]++] = {visible / m_objectCount, object};
+        }
+        invalidateCommandBuffers();
+    }
+    // 每个预渲染帧有自己的分段，栅栏已经等待，当前帧的分段可以直接覆盖
+    if (!m_drawInstances.empty()) {
+        memcpy(static_cast<uint8_t*>(m_drawInstanceMemory.mapped) + drawInstanceOffset(), m_drawInstances.data(),
+               sizeof(DrawInstance) * m_drawInstances.size());
+    }
+    m_cullCount++;
+    m_cullMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+}
+
+uint32_t LearnVKApp::drawInstanceOffset() const {
+    return static_cast<uint32_t>(m_currentFrameIndex * m_drawInstanceStride);
+}
+
+void LearnVKApp::createPlaceholderTexture() {
+    // 材质纹理流式加载完成之前，纹理数组的所有元素都指向这张1x1的灰色纹理
+    const uint8_t pixel[4] = {128, 128, 128, 255};
+    TextureInfo texture = {};
+    texture.path = "placeholder";
+    texture.width = 1;
+    texture.height = 1;
+    texture.staging = m_uploadContext.stage(pixel, sizeof(pixel));
+    texture.mipLevels = 1;
+    recordTextureUpload(texture, m_placeholderTexture);
+    m_placeholderTexture.view = createImageView(m_placeholderTexture.image, m_placeholderTexture.format,
+                                                VK_IMAGE_ASPECT_COLOR_BIT, m_placeholderTexture.mipLevels);
+}
+
+void LearnVKApp::startStreaming() {
+    // 渲染循环立即开始，场景就绪之前只清屏；模型在工作线程上解析后再请求它引用的材质纹理
+    bool cpuMips = !isLinearBlitSupported(VK_FORMAT_R8G8B8A8_SRGB);
+    m_assetStreamer.start(STREAM_THREAD_COUNT, m_threadPool,
+                          [this](const std::string& path, MeshData& mesh) { loadModel(path, mesh); }, cpuMips);
+    AssetRequest request;
+    request.type = AssetType::Mesh;
+    request.path = m_config.model;
+    m_assetStreamer.request(std::move(request));
+    std::cout << "stream: " << STREAM_THREAD_COUNT << " loader threads, upload budget " << m_config.streamBudgetMB
+              << " MB per frame" << std::endl;
+}
+
+void LearnVKApp::updateStreaming() {
+    // 上传批次完成后资源才开始被引用：纹理替换占位纹理，网格完成后开始绘制
+    for (size_t i = 0; i < m_streamUploads.size();) {
+        const StreamUpload& upload = m_streamUploads[i];
+        if (!m_uploadContext.isComplete(upload.ticket)) {
+            i++;
+            continue;
+        }
+        if (upload.type == AssetType::Mesh) {
+            m_sceneReady = true;
+            std::cout << "stream: scene ready after " << m_startupProfiler.elapsedMs() << " ms" << std::endl;
+        } else {
+            m_textureResident[upload.slot] = true;
+            if (std::count(m_textureResident.begin(), m_textureResident.end(), true)
+                == static_cast<std::ptrdiff_t>(m_textureResident.size())) {
+                std::cout << "stream: " << m_textureResident.size() << " textures resident after "
+                          << m_startupProfiler.elapsedMs() << " ms" << std::endl;
+            }
+        }
+        m_descriptorVersion++;
+        m_streamUploads.erase(m_streamUploads.begin() + i);
+    }
+
+    // 取走工作线程加载完成的资源，纹理排队等待上传
+    StreamedAsset asset;
+    while (m_assetStreamer.poll(asset)) {
+        if (asset.error) {
+            if (asset.request.type == AssetType::Mesh) { // 没有模型就没有场景，与同步加载一样视为致命错误
+                std::rethrow_exception(asset.error);
+            }
+            try { // 纹理加载失败时保留占位纹理
+                std::rethrow_exception(asset.error);
+            } catch (const std::exception& e) {
+                std::cerr << "stream: failed to load " << asset.request.path << ": " << e.what() << std::endl;
+            }
+        } else if (asset.request.type == AssetType::Mesh) {
+            std::cout << "stream: " << asset.request.path << " loaded in " << asset.loadMs << " ms" << std::endl;
+            beginStreamedMesh(std::move(asset.mesh));
+        } else if (asset.cooked && !isSampledFormatSupported(static_cast<VkFormat>(asset.cooked->format()))) {
+            AssetRequest request = asset.request; // 设备不支持烘焙的格式，改为解码原图
+            request.ignoreCooked = true;
+            if (!m_assetStreamer.request(std::move(request))) {
+                throw std::runtime_error("asset stream request queue is full!");
+            }
+        } else {
+            m_streamQueue.push_back(std::move(asset));
+        }
+        asset = StreamedAsset();
+    }
+
+    // 按每帧的预算录制上传，网格优先；顶点、索引与纹理都分段拷贝，超过预算的资源跨多帧上传。
+    // 预算不超过暂存环形缓冲的1/(MAX_FRAMES_IN_FLIGHT + 1)，尚未完成的几帧上传不会占满环形缓冲；
+    // 分段使用不等待的tryReserve，环形缓冲仍然不足时剩余部分推迟到下一帧，渲染线程不会阻塞在上传的栅栏上
+    VkDeviceSize budget = std::min(static_cast<VkDeviceSize>(m_config.streamBudgetMB) << 20,
+                                   m_uploadContext.ringSize() / (MAX_FRAMES_IN_FLIGHT + 1));
+    VkDeviceSize frameBytes = 0;
+    std::vector<StreamUpload> recorded;
+    if (m_streamingMesh) {
+        VkDeviceSize vertexSize = m_meshData->vertexDataSize();
+        VkDeviceSize totalSize = vertexSize + m_meshData->indexDataSize();
+        while (m_meshUploadOffset < totalSize && frameBytes < budget) {
+            bool vertex = m_meshUploadOffset < vertexSize;
+            VkDeviceSize regionOffset = vertex ? m_meshUploadOffset : m_meshUploadOffset - vertexSize;
+            VkDeviceSize size = std::min((vertex ? vertexSize : totalSize) - m_meshUploadOffset, budget - frameBytes);
+            const uint8_t* data = vertex ? static_cast<const uint8_t*>(m_meshData->vertexData())
+                                         : reinterpret_cast<const uint8_t*>(m_meshData->indexData());
+            if (!m_uploadContext.tryCopyToBuffer(data + regionOffset, size, vertex ? m_vertexBuffer : m_indexBuffer,
+                                                 regionOffset)) {
+                break;
+            }
+            m_meshUploadOffset += size;
+            frameBytes += size;
+        }
+        if (m_meshUploadOffset == totalSize) {
+            m_uploadContext.releaseBuffer(m_vertexBuffer, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
+                                          VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+            m_uploadContext.releaseBuffer(m_indexBuffer, VK_ACCESS_INDEX_READ_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+            createObjectBuffers(); // 物体与实例缓冲很小，随网格的最后一段一起上传
+            if (m_config.gpuDriven) {
+                createCullDescriptorSets();
+            }
+            m_meshData.reset();
+            m_streamingMesh = false;
+            recorded.push_back({0, AssetType::Mesh, 0});
+        }
+    }
+    while (!m_streamQueue.empty() && frameBytes < budget) {
+        const StreamedAsset& texture = m_streamQueue.front();
+        if (m_textureUploadLevels.empty()) {
+            beginStreamedTexture(texture);
+        }
+        frameBytes += uploadStreamedTexture(texture, budget - frameBytes, frameBytes == 0);
+        if (m_textureUploadLevel < m_textureUploadLevels.size()) { // 预算已用完，下一帧继续
+            break;
+        }
+        // 只有最后一段所在的批次完成后才替换占位纹理，之前的批次按提交顺序先于它完成
+        finishStreamedTexture(texture);
+        recorded.push_back({0, AssetType::Texture, texture.request.slot});
+        m_streamQueue.pop_front();
+    }
+    if (frameBytes == 0 && recorded.empty()) {
+        return;
+    }
+    UploadTicket ticket = m_uploadContext.submit(); // 只提交不等待，之后的帧通过票据查询是否完成
+    for (StreamUpload& upload : recorded) {
+        upload.ticket = ticket;
+        m_streamUploads.push_back(upload);
+    }
+    m_streamedBytes += frameBytes;
+    m_streamMaxFrameBytes = std::max(m_streamMaxFrameBytes, frameBytes);
+    m_streamUploadFrames++;
+}
+
+void LearnVKApp::beginStreamedMesh(std::unique_ptr<MeshData> mesh) {
+    if (mesh->materialTextures.size() > m_textureDescriptorCount) {
+        throw std::runtime_error("too many material textures!");
+    }
+    // 图形管线在模型加载之前按默认的纹理坐标格式创建，与模型不同时重建一次
+    bool rebuildPipeline = m_config.compactVertex && mesh->halfTexCoord != m_halfTexCoord;
+    adoptMesh(std::move(mesh));
+    if (rebuildPipeline) {
+        rebuildGraphicsPipeline();
+    }
+    // 顶点与索引之后按预算分段拷贝，所有段都完成后才转移给图形队列
+    createBuffer(m_meshData->vertexDataSize(), VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_vertexBuffer, m_vertexBufferMemory);
+    createBuffer(m_meshData->indexDataSize(), VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_indexBuffer, m_indexBufferMemory);
+    m_streamingMesh = true;
+    m_meshUploadOffset = 0;
+    m_textures.resize(m_materialTextures.size());
+    m_textureResident.assign(m_materialTextures.size(), false);
+    m_descriptorVersion++; // 纹理数组的长度改变，先全部指向占位纹理
+    for (size_t i = 0; i < m_materialTextures.size(); i++) {
+        AssetRequest request;
+        request.type = AssetType::Texture;
+        request.path = materialTexturePath(i);
+        request.slot = static_cast<uint32_t>(i);
+        if (!m_assetStreamer.request(std::move(request))) {
+            throw std::runtime_error("asset stream request queue is full!");
+        }
+    }
+}
+
+void LearnVKApp::beginStreamedTexture(const StreamedAsset& asset) {
+    MaterialTexture& target = m_textures[asset.request.slot];
+    m_textureUploadLevels.clear();
+    m_textureUploadLevel = 0;
+    m_textureUploadRow = 0;
+    VkImageUsageFlags usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    if (asset.cooked) {
+        const TextureFile& cooked = *asset.cooked;
+        target.format = static_cast<VkFormat>(cooked.format());
+        target.mipLevels = cooked.mipLevels();
+        for (uint32_t i = 0; i < target.mipLevels; i++) {
+            TextureFileLevel level = cooked.level(i);
+            level.offset -= cooked.level(0).offset;
+            m_textureUploadLevels.push_back(level);
+        }
+    } else {
+        // mip链已在工作线程上生成时按levelOffsets的布局逐级拷贝，否则只有第0级，最后一段之后由blit生成其余层级
+        const DecodedImage& image = asset.image;
+        target.format = VK_FORMAT_R8G8B8A8_SRGB;
+        target.mipLevels = MipGenerator::mipLevelCount(image.width, image.height);
+        usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        std::vector<uint64_t> offsets;
+        MipGenerator::levelOffsets(image.width, image.height, offsets);
+        uint32_t width = image.width, height = image.height;
+        for (uint32_t i = 0; i < asset.mipLevels; i++) { // 层级之间有对齐填充，大小按像素计算
+            m_textureUploadLevels.push_back({offsets[i], VkDeviceSize(width) * height * 4, width, height});
+            width = std::max(1u, width / 2);
+            height = std::max(1u, height / 2);
+        }
+    }
+    const TextureFileLevel& base = m_textureUploadLevels[0];
+    createImage(base.width, base.height, target.mipLevels, VK_SAMPLE_COUNT_1_BIT, target.format,
+                VK_IMAGE_TILING_OPTIMAL, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, target.image, target.memory);
+    // 之后各批次的拷贝都在传输队列上按提交顺序执行，布局一直保持TRANSFER_DST
+    transitionImageLayout(m_uploadContext.transferCommandBuffer(), target.image, target.format,
+                          VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, target.mipLevels);
+}
+
+// forceProgress为true时本帧还没有上传任何数据，即使一段超过预算也至少拷贝一段，避免粒度粗于预算时永远无法推进
+VkDeviceSize LearnVKApp::uploadStreamedTexture(const StreamedAsset& asset, VkDeviceSize budget, bool forceProgress) {
+    const MaterialTexture& target = m_textures[asset.request.slot];
+    const uint8_t* pixels = asset.cooked ? asset.cooked->levelData() : asset.image.pixels.get();
+    uint32_t blockHeight = isBlockCompressedFormat(target.format) ? 4 : 1;
+    // 传输队列的拷贝粒度对压缩格式以块为单位，与这里的行一致：分段的起始行与行数需为其整数倍，到达层级底部的最后一段除外
+    uint32_t granularity = m_uploadContext.imageTransferGranularity().height;
+    VkDeviceSize recordedBytes = 0;
+    while (m_textureUploadLevel < m_textureUploadLevels.size()) {
+        const TextureFileLevel& level = m_textureUploadLevels[m_textureUploadLevel];
+        uint32_t rowCount = (level.height + blockHeight - 1) / blockHeight;
+        VkDeviceSize rowSize = level.size / rowCount; // 层级内的行紧密排列
+        uint32_t remaining = rowCount - m_textureUploadRow;
+        uint32_t step = granularity == 0 ? rowCount : granularity; // 粒度为0时只能整级拷贝
+        uint32_t rows = static_cast<uint32_t>(std::min<VkDeviceSize>(remaining, (budget - recordedBytes) / rowSize));
+        if (rows < remaining) {
+            rows -= rows % step;
+        }
+        if (rows == 0) { // 本帧剩余的预算放不下一段
+            if (!forceProgress || recordedBytes > 0) {
+                break;
+            }
+            rows = std::min(step, remaining);
+        }
+        VkDeviceSize size = rowSize * rows;
+        StagingRegion staging;
+        if (!m_uploadContext.tryReserve(size, staging)) { // 暂存空间仍被之前的批次占用，剩余的行推迟到下一帧
+            break;
+        }
+        memcpy(staging.mapped, pixels + level.offset + rowSize * m_textureUploadRow, static_cast<size_t>(size));
+        uint32_t y = m_textureUploadRow * blockHeight;
+        VkBufferImageCopy region = {};
+        region.bufferOffset = staging.offset;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = m_textureUploadLevel;
+        region.imageSubresource.baseArrayLayer = 0;
+        region.imageSubresource.layerCount = 1;
+        region.imageOffset = {0, static_cast<int32_t>(y), 0};
+        region.imageExtent = {level.width, std::min(rows * blockHeight, level.height - y), 1};
+        vkCmdCopyBufferToImage(m_uploadContext.transferCommandBuffer(), staging.buffer, target.image,
+                               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+        recordedBytes += size;
+        m_textureUploadRow += rows;
+        if (m_textureUploadRow == rowCount) {
+            m_textureUploadLevel++;
+            m_textureUploadRow = 0;
+        }
+    }
+    return recordedBytes;
+}
+
+void LearnVKApp::finishStreamedTexture(const StreamedAsset& asset) {
+    MaterialTexture& target = m_textures[asset.request.slot];
+    if (m_textureUploadLevels.size() == target.mipLevels) { // 所有层级都已拷贝
+        VkImageSubresourceRange mipRange = {};
+        mipRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        mipRange.baseMipLevel = 0;
+        mipRange.levelCount = target.mipLevels;
+        mipRange.baseArrayLayer = 0;
+        mipRange.layerCount = 1;
+        // 屏障的源范围覆盖之前所有批次在传输队列上的写入
+        m_uploadContext.releaseImage(target.image, mipRange, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                     VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_SHADER_READ_BIT,
+                                     VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+    } else {
+        recordMipmapBlit(target, m_textureUploadLevels[0].width, m_textureUploadLevels[0].height);
+    }
+    target.view = createImageView(target.image, target.format, VK_IMAGE_ASPECT_COLOR_BIT, target.mipLevels);
+    m_textureUploadLevels.clear();
+}
+
+void LearnVKApp::printStreamStats(uint32_t frameCount) {
+    if (!m_config.stream) {
+        return;
+    }
+    std::cout << "stream: " << m_streamedBytes / 1024 << " KB uploaded in " << m_streamUploadFrames << " of "
+              << frameCount << " frames, max " << m_streamMaxFrameBytes / 1024 << " KB per frame (budget "
+              << m_config.streamBudgetMB << " MB)" << std::endl;
 }
 
 void LearnVKApp::drawFrame() {
@@ -1484,37 +2910,64 @@ void LearnVKApp::drawFrame() {
             [m_currentFrameIndex]}; // 为等待从交换链获取图片的信号量
     VkSemaphore signalSemaphores[] = {
         m_renderFinishSemaphore[m_currentFrameIndex]};
-    VkResult res = vkAcquireNextImageKHR(
-        m_device, m_swapChain, MAX_TIMEOUT, waitSemaphores[0], VK_NULL_HANDLE,
-        &imageIndex); //开始获取的同时 P(wait);当获取之后就会S(wait);
-    if (res == VK_ERROR_OUT_OF_DATE_KHR) {
-        recreateSwapChain();
-        return;
-    } else if (res != VK_SUCCESS && res != VK_SUBOPTIMAL_KHR) {
-        throw std::runtime_error("failed to acquire swap chain!");
+    VkResult res;
+    if (m_config.headless) {
+        imageIndex = m_currentFrameIndex; // 离屏图像与预渲染帧一一对应，栅栏已保证其不再被GPU使用
+    } else {
+        res = vkAcquireNextImageKHR(
+            m_device, m_swapChain, MAX_TIMEOUT, waitSemaphores[0], VK_NULL_HANDLE,
+            &imageIndex); //开始获取的同时 P(wait);当获取之后就会S(wait);
+        if (res == VK_ERROR_OUT_OF_DATE_KHR) {
+            recreateSwapChain();
+            return;
+        } else if (res != VK_SUCCESS && res != VK_SUBOPTIMAL_KHR) {
+            throw std::runtime_error("failed to acquire swap chain!");
+        }
     }
     vkResetFences(
         m_device, 1,
         &m_fences
             [m_currentFrameIndex]); // 后延fence的重置表示如果重建了swapChain已然可以进入这一帧
-    updateUniformBuffers(imageIndex);
-    vkResetCommandBuffer(m_commandBuffers[m_currentFrameIndex], 0);
-    recordCommandBuffers(m_commandBuffers[m_currentFrameIndex], imageIndex);
+    m_uniformRing.beginFrame(m_currentFrameIndex); // 栅栏已经等待，这一帧的分段可以直接覆盖
+    m_gpuProfiler.collect(m_currentFrameIndex);    // 同样在栅栏之后，读取这一帧上次提交的时间戳不会等待
+    if (m_config.stream) {
+        updateStreaming();
+    }
+    // 只改写当前帧的描述符集，其他帧的可能仍在被GPU使用，轮到它们时再改写
+    if (m_descriptorSetVersions[m_currentFrameIndex] != m_descriptorVersion) {
+        writeDescriptorSet(m_currentFrameIndex);
+        invalidateCommandBuffers();
+    }
+    uint32_t uboOffset = updateUniformBuffers();
+    VkCommandBuffer commandBuffer = m_commandBuffers[m_currentFrameIndex];
+    if (m_config.cacheCommands) { // 只有缓存失效或ubo偏移变化时才重新录制
+        size_t slot = imageIndex * MAX_FRAMES_IN_FLIGHT + m_currentFrameIndex;
+        commandBuffer = m_cachedCommandBuffers[slot];
+        if (!m_cachedCommandValid[slot] || m_cachedUboOffsets[slot] != uboOffset) {
+            vkResetCommandBuffer(commandBuffer, 0);
+            recordCommandBuffers(commandBuffer, imageIndex, uboOffset);
+            m_cachedUboOffsets[slot] = uboOffset;
+            m_cachedCommandValid[slot] = true;
+        }
+    } else {
+        vkResetCommandBuffer(commandBuffer, 0);
+        recordCommandBuffers(commandBuffer, imageIndex, uboOffset);
+    }
     // 对帧缓冲附着执行指令缓冲中的渲染指令
     VkSubmitInfo submitInfo = {};
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
     VkPipelineStageFlags waitStageFlags[] = {
         VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-    submitInfo.waitSemaphoreCount = 1;
+    submitInfo.waitSemaphoreCount = m_config.headless ? 0 : 1; // 离屏模式没有获取与呈现，不需要信号量
     submitInfo.pWaitSemaphores =
         waitSemaphores; // P(wait); 在获取到图片S(wait)就submit指令
     submitInfo.pWaitDstStageMask = waitStageFlags;
-    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.signalSemaphoreCount = m_config.headless ? 0 : 1;
     submitInfo.pSignalSemaphores =
         signalSemaphores; // S(signal); 代表完成渲染，可以呈现
     submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &m_commandBuffers[m_currentFrameIndex];
+    submitInfo.pCommandBuffers = &commandBuffer;
     VkQueue& queue = m_queueMap["graphicsFamily"];
     res = vkQueueSubmit(
         queue, 1, &submitInfo,
@@ -1522,6 +2975,10 @@ void LearnVKApp::drawFrame() {
     if (res != VK_SUCCESS) {
         throw std::runtime_error("failed to submit command buffer!");
     }
+    if (m_config.headless) {
+        m_currentFrameIndex = (m_currentFrameIndex + 1) % MAX_FRAMES_IN_FLIGHT;
+        return;
+    }
     // 返回渲染后的图像到交换链进行呈现操作
     VkPresentInfoKHR presentInfo = {};
     presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -1543,28 +3000,58 @@ void LearnVKApp::drawFrame() {
     m_currentFrameIndex = (m_currentFrameIndex + 1) % MAX_FRAMES_IN_FLIGHT;
 }
 
-void LearnVKApp::cleanupSwapChain() {
+void LearnVKApp::cleanupSwapChainTargets() {
     vkDestroyImageView(m_device, m_depthImageView, nullptr);
     vkDestroyImage(m_device, m_depthImage, nullptr);
-    vkFreeMemory(m_device, m_depthImageMemory, nullptr);
+    m_allocator.free(m_depthImageMemory);
 
     vkDestroyImageView(m_device, m_colorImageView, nullptr);
     vkDestroyImage(m_device, m_colorImage, nullptr);
-    vkFreeMemory(m_device, m_colorImageMemory, nullptr);
+    m_allocator.free(m_colorImageMemory);
 
     for (auto& frameBuffer : m_swapChainFrameBuffers) {
         vkDestroyFramebuffer(m_device, frameBuffer, nullptr);
     }
+    for (auto& imageView : m_swapChainImageViews) {
+        vkDestroyImageView(m_device, imageView, nullptr);
+    }
+}
+
+void LearnVKApp::cleanupSwapChain() {
+    cleanupSwapChainTargets();
     vkFreeCommandBuffers(m_device, m_commandPool,
                          static_cast<uint32_t>(m_commandBuffers.size()),
                          m_commandBuffers.data());
+    if (!m_cachedCommandBuffers.empty()) {
+        vkFreeCommandBuffers(m_device, m_commandPool,
+                             static_cast<uint32_t>(m_cachedCommandBuffers.size()),
+                             m_cachedCommandBuffers.data());
+        m_cachedCommandBuffers.clear();
+    }
     vkDestroyPipeline(m_device, m_graphicsPipeline, nullptr);
     vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
     vkDestroyRenderPass(m_device, m_renderPass, nullptr);
-    for (auto& imageView : m_swapChainImageViews) {
-        vkDestroyImageView(m_device, imageView, nullptr);
+    if (m_config.headless) {
+        for (size_t i = 0; i < m_swapChainImages.size(); i++) {
+            vkDestroyImage(m_device, m_swapChainImages[i], nullptr);
+            m_allocator.free(m_offscreenImageMemories[i]);
+        }
+    } else {
+        vkDestroySwapchainKHR(m_device, m_swapChain, nullptr);
     }
-    vkDestroySwapchainKHR(m_device, m_swapChain, nullptr);
+}
+
+void LearnVKApp::rebuildGraphicsPipeline() {
+    // 当前帧的栅栏已经等待并重置，只等待其他仍在执行的帧
+    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        if (i != m_currentFrameIndex) {
+            vkWaitForFences(m_device, 1, &m_fences[i], VK_TRUE, MAX_TIMEOUT);
+        }
+    }
+    vkDestroyPipeline(m_device, m_graphicsPipeline, nullptr);
+    vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
+    createGraphicsPipeline();
+    invalidateCommandBuffers();
 }
 
 void LearnVKApp::recreateSwapChain() {
@@ -1574,32 +3061,57 @@ void LearnVKApp::recreateSwapChain() {
         glfwGetFramebufferSize(m_window, &width, &height);
         glfwWaitEvents();
     }
-    // 清理
-    vkDeviceWaitIdle(m_device);
-    cleanupSwapChain();
-    // 重建
+    auto startTime = std::chrono::high_resolution_clock::now();
+    // 只等待已提交的帧完成，不必让整个设备空闲；指令缓冲每帧重新录制，不需要重新分配
+    vkWaitForFences(m_device, static_cast<uint32_t>(m_fences.size()), m_fences.data(), VK_TRUE, MAX_TIMEOUT);
+    cleanupSwapChainTargets();
+    // 通过oldSwapchain重建交换链，只重建与尺寸相关的图像、视图与帧缓冲
+    VkFormat oldFormat = m_swapChainImageFormat;
     createSwapChain();
     createImageViews();
-    createRenderPass();
-    createGraphicsPipeline();
+    // 渲染流程与管线只依赖附着格式和采样数(采样数在选择设备时已确定)，视口与裁剪是动态状态
+    bool rebuildPipeline = m_swapChainImageFormat != oldFormat;
+    if (rebuildPipeline) {
+        vkDestroyPipeline(m_device, m_graphicsPipeline, nullptr);
+        vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
+        vkDestroyRenderPass(m_device, m_renderPass, nullptr);
+        createRenderPass();
+        createGraphicsPipeline();
+    }
     createColorResources();
     createDepthResources();
     createFrameBuffers();
-    createCommandBuffers();
+    createCachedCommandBuffers(); // 帧缓冲已重建，交换链图像数量也可能改变
+    // 附件的布局转换只提交不等待：它在图形队列上先于下一帧提交，屏障保证下一帧使用附件之前转换已经完成
+    m_uploadContext.submit();
+    double resizeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+    std::cout << "swapchain: resized to " << m_swapChainImageExtent.width << "x" << m_swapChainImageExtent.height
+              << " in " << resizeMs << " ms" << (rebuildPipeline ? ", render pass and pipeline rebuilt" : "") << std::endl;
 }
 
 void LearnVKApp::clearBuffers() {
-    for (int i = 0; i < m_swapChainImages.size(); i++) {
-        vkDestroyBuffer(m_device, m_uboBuffers[i], nullptr);
-        vkFreeMemory(m_device, m_uboBufferMemories[i], nullptr);
-    }
+    m_uniformRing.destroy();
     vkDestroyBuffer(m_device, m_vertexBuffer, nullptr);
-    vkFreeMemory(m_device, m_vertexBufferMemory, nullptr);
+    m_allocator.free(m_vertexBufferMemory);
     vkDestroyBuffer(m_device, m_indexBuffer, nullptr);
-    vkFreeMemory(m_device, m_indexBufferMemory, nullptr);
+    m_allocator.free(m_indexBufferMemory);
+    vkDestroyBuffer(m_device, m_objectBuffer, nullptr);
+    m_allocator.free(m_objectBufferMemory);
+    vkDestroyBuffer(m_device, m_instanceBuffer, nullptr);
+    m_allocator.free(m_instanceBufferMemory);
+    vkDestroyBuffer(m_device, m_drawInstanceBuffer, nullptr);
+    m_allocator.free(m_drawInstanceMemory);
+    for (auto& draws : m_indirectDraws) { // 描述符集随描述符池一起释放
+        vkDestroyBuffer(m_device, draws.commands, nullptr);
+        m_allocator.free(draws.commandsMemory);
+        vkDestroyBuffer(m_device, draws.count, nullptr);
+        m_allocator.free(draws.countMemory);
+    }
 }
 
 void LearnVKApp::clear() { // 释放Vulkan的资源
+    m_assetStreamer.stop(); // 工作线程会调用loadModel并使用线程池，先于其他资源退出
+    m_streamQueue.clear();
     if (enableValidationLayers) {
         destroyDebugUtilsMessengerEXT(m_vkInstance, &m_callBack, nullptr);
     }
@@ -1609,22 +3121,44 @@ void LearnVKApp::clear() { // 释放Vulkan的资源
         vkDestroySemaphore(m_device, m_renderFinishSemaphore[i], nullptr);
         vkDestroyFence(m_device, m_fences[i], nullptr);
     }
+    vkDestroyPipeline(m_device, m_cullPipeline, nullptr); // 未创建时为空句柄，销毁空句柄是合法的
+    vkDestroyPipelineLayout(m_device, m_cullPipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(m_device, m_cullDescriptorSetLayout, nullptr);
     vkDestroyDescriptorSetLayout(m_device, m_descriptorSetLayout, nullptr);
     vkDestroyDescriptorPool(m_device, m_descriptorPool, nullptr);
 
     vkDestroySampler(m_device, m_textureSampler, nullptr);
-    vkDestroyImageView(m_device, m_textureImageView, nullptr);
-    vkDestroyImage(m_device, m_textureImage, nullptr);
-    vkFreeMemory(m_device, m_textureImageMemory, nullptr);
+    vkDestroyImageView(m_device, m_placeholderTexture.view, nullptr);
+    vkDestroyImage(m_device, m_placeholderTexture.image, nullptr);
+    m_allocator.free(m_placeholderTexture.memory);
+    for (auto& texture : m_textures) {
+        vkDestroyImageView(m_device, texture.view, nullptr);
+        vkDestroyImage(m_device, texture.image, nullptr);
+        m_allocator.free(texture.memory);
+    }
 
     clearBuffers();
 
     vkDestroyCommandPool(m_device, m_commandPool, nullptr);
-    vkDestroySurfaceKHR(m_vkInstance, m_surface, nullptr);
+    for (auto& pool : m_recordPools) { // 次级指令缓冲随池一起释放
+        vkDestroyCommandPool(m_device, pool, nullptr);
+    }
+    m_uploadContext.destroy();
+    m_gpuProfiler.destroy();
+    if (!m_pipelineCache.save()) { // 写入失败(如工作目录只读)时下次启动重新编译管线
+        std::cerr << "failed to write pipeline cache: " << PipelineCache::defaultPath() << std::endl;
+    }
+    m_pipelineCache.destroy();
+    m_allocator.destroy();
     vkDestroyDevice(m_device, nullptr);
+    if (!m_config.headless) {
+        vkDestroySurfaceKHR(m_vkInstance, m_surface, nullptr);
+    }
     vkDestroyInstance(m_vkInstance, nullptr);
-    glfwDestroyWindow(m_window);
-    glfwTerminate();
+    if (!m_config.headless) {
+        glfwDestroyWindow(m_window);
+        glfwTerminate();
+    }
 }
 
 VkExtent2D
@@ -1648,7 +3182,7 @@ LearnVKApp::chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities) {
 
 void LearnVKApp::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
                               VkMemoryPropertyFlags properties,
-                              VkBuffer& buffer, VkDeviceMemory& memory) {
+                              VkBuffer& buffer, MemoryAllocation& memory) {
     VkBufferCreateInfo createInfo = {};
     createInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
     createInfo.size = size;
@@ -1659,18 +3193,7 @@ void LearnVKApp::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
         throw std::runtime_error("failed to create buffer!");
     }
 
-    VkMemoryRequirements memReq = {};
-    vkGetBufferMemoryRequirements(m_device, buffer, &memReq);
-
-    VkMemoryAllocateInfo allocInfo = {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memReq.size;
-    allocInfo.memoryTypeIndex = findMemoryType(memReq.memoryTypeBits, properties);
-    res = vkAllocateMemory(m_device, &allocInfo, nullptr, &memory);
-    if (res != VK_SUCCESS) {
-        throw std::runtime_error("failed to allocate buffer memory!");
-    }
-    vkBindBufferMemory(m_device, buffer, memory, 0);
+    memory = m_allocator.allocateForBuffer(buffer, properties);
 }
 
 VkSampleCountFlagBits LearnVKApp::getMaxUsableSampleCount() {
@@ -1758,11 +3281,78 @@ static std::vector<char> readFile(const std::string& filename) {
     return buffer;
 }
 
-int main() {
-    LearnVKApp app;
-    try {
-        app.run();
-    } catch (const std::exception& e) { // Vulkan主循环中出现的异常在这里被捕获
-        std::cerr << e.what() << std::endl;
+AppConfig AppConfig::parseCommandLine(int argc, char** argv) {
+    AppConfig config;
+    auto nextValue = [&](int& i) -> uint32_t {
+        if (i + 1 >= argc) {
+            throw std::invalid_argument(std::string("missing value for ") + argv[i]);
+        }
+        return static_cast<uint32_t>(std::stoul(argv[++i]));
+    };
+    auto nextString = [&](int& i) -> std::string {
+        if (i + 1 >= argc) {
+            throw std::invalid_argument(std::string("missing value for ") + argv[i]);
+        }
+        return argv[++i];
+    };
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--headless") {
+            config.headless = true;
+        } else if (arg == "--width") {
+            config.width = nextValue(i);
+        } else if (arg == "--height") {
+            config.height = nextValue(i);
+        } else if (arg == "--frames") {
+            config.frameCount = nextValue(i);
+        } else if (arg == "--warmup") {
+            config.warmupFrames = nextValue(i);
+        } else if (arg == "--msaa") {
+            config.msaaSamples = nextValue(i);
+        } else if (arg == "--optimize-mesh") {
+            config.optimizeMesh = true;
+        } else if (arg == "--compact-vertex") {
+            config.compactVertex = true;
+        } else if (arg == "--parallel-record") {
+            config.parallelRecord = true;
+        } else if (arg == "--cache-commands") {
+            config.cacheCommands = true;
+        } else if (arg == "--gpu-driven") {
+            config.gpuDriven = true;
+        } else if (arg == "--gpu-profile") {
+            config.gpuProfile = true;
+        } else if (arg == "--gpu-profile-csv") {
+            config.gpuProfile = true;
+            config.gpuProfileCsv = nextString(i);
+        } else if (arg == "--startup-csv") {
+            config.startupCsv = nextString(i);
+        } else if (arg == "--stream") {
+            config.stream = true;
+        } else if (arg == "--stream-budget") {
+            config.streamBudgetMB = nextValue(i);
+        } else if (arg == "--instances") {
+            config.instanceCount = nextValue(i);
+        } else if (arg == "--model") {
+            config.model = nextString(i);
+        } else if (arg == "--texture") {
+            config.texture = nextString(i);
+        } else {
+            throw std::invalid_argument("unknown argument: " + arg);
+        }
+    }
+    if (config.width == 0 || config.height == 0) {
+        throw std::invalid_argument("resolution must not be zero!");
+    }
+    if (config.instanceCount == 0) {
+        throw std::invalid_argument("instance count must not be zero!");
+    }
+    if (config.streamBudgetMB == 0) {
+        throw std::invalid_argument("stream budget must not be zero!");
+    }
+    // VkSampleCountFlagBits的取值即采样数；单采样时解析附件不合法
+    if (config.msaaSamples != 0
+        && (config.msaaSamples < 2 || config.msaaSamples > 64 || (config.msaaSamples & (config.msaaSamples - 1)) != 0)) {
+        throw std::invalid_argument("msaa sample count must be a power of two between 2 and 64!");
     }
+    return config;
 }
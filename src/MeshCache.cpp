@@ -0,0 +1,143 @@
+﻿// MeshCache.cpp: 二进制网格缓存的读写
+//
+#include "MeshCache.h"
+#include <filesystem>
+#include <fstream>
+#include <cstring>
+#include <iostream>
+
+static bool querySourceStamp(const std::string& modelPath, uint64_t& size, int64_t& writeTime) {
+    std::error_code ec;
+    size = static_cast<uint64_t>(std::filesystem::file_size(modelPath, ec));
+    if (ec) {
+        return false;
+    }
+    auto time = std::filesystem::last_write_time(modelPath, ec);
+    if (ec) {
+        return false;
+    }
+    writeTime = static_cast<int64_t>(time.time_since_epoch().count());
+    return true;
+}
+
+static uint64_t alignOffset(uint64_t offset, uint64_t alignment) {
+    return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+std::string MeshCache::cachePath(const std::string& modelPath) {
+    return modelPath + ".lvkmesh";
+}
+
+bool MeshCache::open(const std::string& modelPath, uint32_t vertexStride, uint32_t flags) {
+    close();
+    uint64_t sourceSize = 0;
+    int64_t sourceWriteTime = 0;
+    bool hasSource = querySourceStamp(modelPath, sourceSize, sourceWriteTime);
+    if (!m_file.open(cachePath(modelPath))) {
+        return false;
+    }
+    if (m_file.size() < sizeof(MeshCacheHeader)) {
+        m_file.close();
+        return false;
+    }
+    auto header = reinterpret_cast<const MeshCacheHeader*>(m_file.data());
+    bool valid = header->magic == MESH_CACHE_MAGIC && header->version == MESH_CACHE_VERSION
+                 && header->vertexStride == vertexStride && (header->flags & ~MESH_CACHE_CONTENT_FLAGS) == flags;
+    // 只分发了缓存而没有源文件时直接使用缓存
+    if (valid && hasSource) {
+        valid = header->sourceSize == sourceSize && header->sourceWriteTime == sourceWriteTime;
+    }
+    if (valid) {
+        uint64_t vertexEnd = header->vertexOffset + static_cast<uint64_t>(header->vertexStride) * header->vertexCount;
+        uint64_t indexEnd = header->indexOffset + sizeof(uint32_t) * static_cast<uint64_t>(header->indexCount);
+        uint64_t submeshEnd = header->submeshOffset + sizeof(Submesh) * static_cast<uint64_t>(header->submeshCount);
+        uint64_t materialEnd = header->materialOffset + header->materialSize;
+        valid = vertexEnd <= m_file.size() && indexEnd <= m_file.size()
+                && submeshEnd <= m_file.size() && materialEnd <= m_file.size();
+    }
+    if (!valid) {
+        m_file.close();
+        return false;
+    }
+    m_header = header;
+    return true;
+}
+
+std::vector<std::string> MeshCache::materialTextures() const {
+    std::vector<std::string> textures;
+    textures.reserve(m_header->materialCount);
+    const char* name = reinterpret_cast<const char*>(m_file.data() + m_header->materialOffset);
+    const char* end = name + m_header->materialSize;
+    for (uint32_t i = 0; i < m_header->materialCount && name < end; i++) {
+        size_t length = strnlen(name, end - name);
+        textures.emplace_back(name, length);
+        name += length + 1;
+    }
+    return textures;
+}
+
+bool MeshCache::write(const std::string& modelPath, uint32_t vertexStride, uint32_t flags,
+                      const void* vertices, uint32_t vertexCount,
+                      const uint32_t* indices, uint32_t indexCount,
+                      const std::vector<Submesh>& submeshes, const std::vector<std::string>& materialTextures,
+                      const MeshBounds& bounds) {
+    MeshCacheHeader header = {};
+    header.magic = MESH_CACHE_MAGIC;
+    header.version = MESH_CACHE_VERSION;
+    header.vertexStride = vertexStride;
+    header.vertexCount = vertexCount;
+    header.indexCount = indexCount;
+    header.flags = flags;
+    if (!querySourceStamp(modelPath, header.sourceSize, header.sourceWriteTime)) {
+        return false;
+    }
+    for (int i = 0; i < 3; i++) {
+        header.boundsMin[i] = bounds.min[i];
+        header.boundsMax[i] = bounds.max[i];
+    }
+    // 数据流按16字节对齐，映射后可以直接按结构体访问
+    header.vertexOffset = alignOffset(sizeof(MeshCacheHeader), 16);
+    uint64_t vertexSize = static_cast<uint64_t>(vertexStride) * vertexCount;
+    header.indexOffset = alignOffset(header.vertexOffset + vertexSize, 16);
+    uint64_t indexSize = sizeof(uint32_t) * static_cast<uint64_t>(indexCount);
+    header.submeshCount = static_cast<uint32_t>(submeshes.size());
+    header.submeshOffset = alignOffset(header.indexOffset + indexSize, 16);
+    std::string materialNames;
+    for (const auto& texture : materialTextures) {
+        materialNames.append(texture).push_back('\0');
+    }
+    header.materialCount = static_cast<uint32_t>(materialTextures.size());
+    header.materialOffset = header.submeshOffset + sizeof(Submesh) * submeshes.size();
+    header.materialSize = materialNames.size();
+
+    std::string path = cachePath(modelPath);
+    std::string tempPath = path + ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            return false;
+        }
+        const char padding[16] = {};
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(padding, header.vertexOffset - sizeof(header));
+        file.write(static_cast<const char*>(vertices), vertexSize);
+        file.write(padding, header.indexOffset - header.vertexOffset - vertexSize);
+        file.write(reinterpret_cast<const char*>(indices), indexSize);
+        file.write(padding, header.submeshOffset - header.indexOffset - indexSize);
+        file.write(reinterpret_cast<const char*>(submeshes.data()), sizeof(Submesh) * submeshes.size());
+        file.write(materialNames.data(), materialNames.size());
+        file.close();
+        if (!file.good()) {
+            std::error_code ec;
+            std::filesystem::remove(tempPath, ec);
+            return false;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(tempPath, path, ec);
+    if (ec) {
+        std::filesystem::remove(tempPath, ec);
+        return false;
+    }
+    return true;
+}
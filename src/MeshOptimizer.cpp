@@ -0,0 +1,241 @@
+﻿// MeshOptimizer.cpp: 网格优化的实现
+//
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <glm/geometric.hpp>
+
+// FIFO顶点缓存模拟，返回本次访问是否未命中
+class FifoCache {
+public:
+    FifoCache(size_t vertexCount, uint32_t cacheSize) :
+        m_timestamps(vertexCount, 0), m_cacheSize(cacheSize), m_time(cacheSize + 1) {}
+
+    bool access(uint32_t vertex) {
+        if (m_time - m_timestamps[vertex] > m_cacheSize) {
+            m_timestamps[vertex] = m_time++;
+            return true;
+        }
+        return false;
+    }
+
+    void reset() {
+        m_time += m_cacheSize + 1;
+    }
+
+private:
+    std::vector<uint32_t> m_timestamps;
+    uint32_t m_cacheSize;
+    uint32_t m_time;
+};
+
+VertexCacheStats MeshOptimizer::analyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount,
+                                                   uint32_t cacheSize) {
+    FifoCache cache(vertexCount, cacheSize);
+    size_t misses = 0;
+    for (uint32_t index : indices) {
+        misses += cache.access(index);
+    }
+    VertexCacheStats stats = {};
+    if (!indices.empty()) {
+        stats.acmr = static_cast<float>(misses) / (indices.size() / 3);
+        stats.atvr = static_cast<float>(misses) / vertexCount;
+    }
+    return stats;
+}
+
+void MeshOptimizer::optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize) {
+    size_t triangleCount = indices.size() / 3;
+    // 顶点到相邻三角形的邻接表，以前缀和的形式存放
+    std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+    for (uint32_t index : indices) {
+        adjacencyOffsets[index + 1]++;
+    }
+    for (size_t v = 0; v < vertexCount; v++) {
+        adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+    }
+    std::vector<uint32_t> adjacency(indices.size());
+    std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); i++) {
+        adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+    }
+    std::vector<uint32_t> liveTriangles(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++) {
+        liveTriangles[v] = adjacencyOffsets[v + 1] - adjacencyOffsets[v];
+    }
+
+    std::vector<uint32_t> cacheTime(vertexCount, 0);
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<uint32_t> deadEnd; // 最近输出过的顶点，用于在邻域耗尽时就近跳转
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+    uint32_t time = cacheSize + 1;
+    size_t cursor = 0;
+    int64_t fanning = vertexCount > 0 ? 0 : -1;
+
+    while (fanning >= 0) {
+        uint32_t vertex = static_cast<uint32_t>(fanning);
+        candidates.clear();
+        // 输出当前顶点周围所有尚未输出的三角形
+        for (uint32_t a = adjacencyOffsets[vertex]; a < adjacencyOffsets[vertex + 1]; a++) {
+            uint32_t triangle = adjacency[a];
+            if (emitted[triangle]) {
+                continue;
+            }
+            for (uint32_t k = 0; k < 3; k++) {
+                uint32_t v = indices[triangle * 3 + k];
+                result.push_back(v);
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                liveTriangles[v]--;
+                if (time - cacheTime[v] > cacheSize) {
+                    cacheTime[v] = time++;
+                }
+            }
+            emitted[triangle] = true;
+        }
+
+        // 在候选顶点中选择仍在缓存中且扇出后不会挤出自身的最老顶点
+        fanning = -1;
+        int32_t bestPriority = -1;
+        for (uint32_t v : candidates) {
+            if (liveTriangles[v] == 0) {
+                continue;
+            }
+            int32_t priority = 0;
+            if (time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize) {
+                priority = static_cast<int32_t>(time - cacheTime[v]);
+            }
+            if (priority > bestPriority) {
+                bestPriority = priority;
+                fanning = v;
+            }
+        }
+        if (fanning >= 0) {
+            continue;
+        }
+        // 邻域耗尽，先回溯最近输出的顶点，再按顺序扫描剩余顶点
+        while (!deadEnd.empty()) {
+            uint32_t v = deadEnd.back();
+            deadEnd.pop_back();
+            if (liveTriangles[v] > 0) {
+                fanning = v;
+                break;
+            }
+        }
+        while (fanning < 0 && cursor < vertexCount) {
+            if (liveTriangles[cursor] > 0) {
+                fanning = static_cast<int64_t>(cursor);
+            }
+            cursor++;
+        }
+    }
+    indices.swap(result);
+}
+
+void MeshOptimizer::optimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices,
+                                     float threshold, uint32_t cacheSize) {
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0) {
+        return;
+    }
+    // 硬边界：三个顶点全部未命中说明Tipsify在此处跳转，簇之间相互独立
+    std::vector<size_t> hardClusters;
+    FifoCache cache(vertices.size(), cacheSize);
+    for (size_t t = 0; t < triangleCount; t++) {
+        uint32_t misses = cache.access(indices[t * 3 + 0]) + cache.access(indices[t * 3 + 1])
+                          + cache.access(indices[t * 3 + 2]);
+        if (t == 0 || misses == 3) {
+            hardClusters.push_back(t);
+        }
+    }
+    hardClusters.push_back(triangleCount);
+
+    // 软边界：在硬簇内部，累计ACMR低于阈值时即可切开，得到更小的簇
+    std::vector<size_t> clusters;
+    for (size_t h = 0; h + 1 < hardClusters.size(); h++) {
+        size_t begin = hardClusters[h], end = hardClusters[h + 1];
+        cache.reset();
+        size_t clusterMisses = 0;
+        for (size_t t = begin; t < end; t++) {
+            for (uint32_t k = 0; k < 3; k++) {
+                clusterMisses += cache.access(indices[t * 3 + k]);
+            }
+        }
+        float clusterThreshold = threshold * clusterMisses / (end - begin);
+        cache.reset();
+        size_t start = begin, misses = 0;
+        clusters.push_back(begin);
+        for (size_t t = begin; t < end; t++) {
+            for (uint32_t k = 0; k < 3; k++) {
+                misses += cache.access(indices[t * 3 + k]);
+            }
+            if (t + 1 < end && misses <= clusterThreshold * (t + 1 - start)) {
+                clusters.push_back(t + 1);
+                start = t + 1;
+                misses = 0;
+                cache.reset();
+            }
+        }
+    }
+    clusters.push_back(triangleCount);
+
+    // 以面积加权的质心与法线衡量簇朝外的程度，朝外的簇先画，能遮挡更多位于内侧的三角形
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    size_t clusterCount = clusters.size() - 1;
+    std::vector<glm::vec3> clusterCentroids(clusterCount, glm::vec3(0.0f));
+    std::vector<glm::vec3> clusterNormals(clusterCount, glm::vec3(0.0f));
+    std::vector<float> clusterAreas(clusterCount, 0.0f);
+    for (size_t c = 0; c < clusterCount; c++) {
+        for (size_t t = clusters[c]; t < clusters[c + 1]; t++) {
+            const glm::vec3& p0 = vertices[indices[t * 3 + 0]].position;
+            const glm::vec3& p1 = vertices[indices[t * 3 + 1]].position;
+            const glm::vec3& p2 = vertices[indices[t * 3 + 2]].position;
+            glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+            float area = glm::length(normal);
+            clusterCentroids[c] += (p0 + p1 + p2) * (area / 3.0f);
+            clusterNormals[c] += normal;
+            clusterAreas[c] += area;
+        }
+        meshCentroid += clusterCentroids[c];
+        meshArea += clusterAreas[c];
+    }
+    if (meshArea > 0.0f) {
+        meshCentroid /= meshArea;
+    }
+    std::vector<float> sortKeys(clusterCount, 0.0f);
+    for (size_t c = 0; c < clusterCount; c++) {
+        float normalLength = glm::length(clusterNormals[c]);
+        if (clusterAreas[c] > 0.0f && normalLength > 0.0f) {
+            glm::vec3 centroid = clusterCentroids[c] / clusterAreas[c];
+            sortKeys[c] = glm::dot(centroid - meshCentroid, clusterNormals[c] / normalLength);
+        }
+    }
+    std::vector<uint32_t> order(clusterCount);
+    for (size_t c = 0; c < clusterCount; c++) {
+        order[c] = static_cast<uint32_t>(c);
+    }
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return sortKeys[a] > sortKeys[b]; });
+
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+    for (uint32_t c : order) {
+        result.insert(result.end(), indices.begin() + clusters[c] * 3, indices.begin() + clusters[c + 1] * 3);
+    }
+    indices.swap(result);
+}
+
+void MeshOptimizer::optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
+    std::vector<uint32_t> remap(vertices.size(), UINT32_MAX);
+    std::vector<Vertex> result;
+    result.reserve(vertices.size());
+    for (uint32_t& index : indices) {
+        if (remap[index] == UINT32_MAX) {
+            remap[index] = static_cast<uint32_t>(result.size());
+            result.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+    vertices.swap(result);
+}
@@ -0,0 +1,240 @@
+﻿// MipGenerator.cpp: CPU mip链生成的实现
+//
+
+#include "MipGenerator.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define MIP_SIMD_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MIP_SIMD_SSE2
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define MIP_SIMD_NEON
+#endif
+
+// 每个并行任务处理的目标行数
+const static uint32_t ROWS_PER_TASK = 16;
+
+static float srgbToLinear(float c) {
+    return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+static float linearToSrgb(float c) {
+    c = std::clamp(c, 0.0f, 1.0f);
+    return c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+}
+
+// sRGB与16位线性值之间的转换表，16位精度下编码回8位的误差不超过1
+struct SrgbTables {
+    uint16_t decode[256];
+    uint8_t encode[65536];
+    SrgbTables() {
+        for (int i = 0; i < 256; i++) {
+            decode[i] = static_cast<uint16_t>(srgbToLinear(i / 255.0f) * 65535.0f + 0.5f);
+        }
+        for (int i = 0; i < 65536; i++) {
+            encode[i] = static_cast<uint8_t>(linearToSrgb(i / 65535.0f) * 255.0f + 0.5f);
+        }
+    }
+};
+
+static const SrgbTables& srgbTables() {
+    static const SrgbTables tables;
+    return tables;
+}
+
+// 一行目标像素的2x2平均：row0与row1为相邻的两行源像素，每个目标像素对应两个源像素，结果为(和+2)>>2
+static void filterRowScalar(const uint16_t* row0, const uint16_t* row1, uint16_t* dst, uint32_t begin, uint32_t end) {
+    for (uint32_t x = begin; x < end; x++) {
+        for (int c = 0; c < 4; c++) {
+            uint32_t sum = row0[x * 8 + c] + row0[x * 8 + 4 + c] + row1[x * 8 + c] + row1[x * 8 + 4 + c];
+            dst[x * 4 + c] = static_cast<uint16_t>((sum + 2) >> 2);
+        }
+    }
+}
+
+static void filterRow(const uint16_t* row0, const uint16_t* row1, uint16_t* dst, uint32_t dstWidth) {
+    uint32_t x = 0;
+#if defined(MIP_SIMD_AVX2)
+    const __m256i rounding = _mm256_set1_epi32(2);
+    for (; x + 2 <= dstWidth; x += 2) { // 每次两个目标像素，对应每行4个源像素
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row0 + x * 8));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row1 + x * 8));
+        __m256i low = _mm256_add_epi32(_mm256_cvtepu16_epi32(_mm256_castsi256_si128(a)),
+                                       _mm256_cvtepu16_epi32(_mm256_castsi256_si128(b)));
+        __m256i high = _mm256_add_epi32(_mm256_cvtepu16_epi32(_mm256_extracti128_si256(a, 1)),
+                                        _mm256_cvtepu16_epi32(_mm256_extracti128_si256(b, 1)));
+        // low的两个128位半部为第一个目标像素的左右两列，high为第二个
+        __m256i sum = _mm256_add_epi32(_mm256_permute2x128_si256(low, high, 0x20),
+                                       _mm256_permute2x128_si256(low, high, 0x31));
+        sum = _mm256_srli_epi32(_mm256_add_epi32(sum, rounding), 2);
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(sum, sum), 0x08);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 4), _mm256_castsi256_si128(packed));
+    }
+#elif defined(MIP_SIMD_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i rounding = _mm_set1_epi32(2);
+    const __m128i bias = _mm_set1_epi32(32768);
+    const __m128i biasPacked = _mm_set1_epi16(static_cast<short>(0x8000));
+    for (; x + 2 <= dstWidth; x += 2) {
+        __m128i sums[2];
+        for (int i = 0; i < 2; i++) {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + (x + i) * 8));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + (x + i) * 8));
+            __m128i sum = _mm_add_epi32(_mm_add_epi32(_mm_unpacklo_epi16(a, zero), _mm_unpackhi_epi16(a, zero)),
+                                        _mm_add_epi32(_mm_unpacklo_epi16(b, zero), _mm_unpackhi_epi16(b, zero)));
+            sums[i] = _mm_srli_epi32(_mm_add_epi32(sum, rounding), 2);
+        }
+        // SSE2没有无符号的32位到16位饱和打包，偏移到有符号范围后打包再恢复
+        __m128i packed = _mm_packs_epi32(_mm_sub_epi32(sums[0], bias), _mm_sub_epi32(sums[1], bias));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 4), _mm_xor_si128(packed, biasPacked));
+    }
+#elif defined(MIP_SIMD_NEON)
+    for (; x < dstWidth; x++) {
+        uint16x8_t a = vld1q_u16(row0 + x * 8);
+        uint16x8_t b = vld1q_u16(row1 + x * 8);
+        uint32x4_t sum = vaddq_u32(vaddl_u16(vget_low_u16(a), vget_high_u16(a)),
+                                   vaddl_u16(vget_low_u16(b), vget_high_u16(b)));
+        vst1_u16(dst + x * 4, vmovn_u32(vrshrq_n_u32(sum, 2)));
+    }
+#endif
+    filterRowScalar(row0, row1, dst, x, dstWidth);
+}
+
+// 层级之间的对齐填充清零，使输出只由输入决定
+static void clearPadding(uint32_t width, uint32_t height, const std::vector<uint64_t>& offsets, uint8_t* output) {
+    for (size_t level = 0; level < offsets.size(); level++) {
+        uint64_t end = offsets[level] + static_cast<uint64_t>(width) * height * 4;
+        uint64_t alignedEnd = (end + 15) & ~15ull;
+        memset(output + end, 0, static_cast<size_t>(alignedEnd - end));
+        width = std::max(1u, width / 2);
+        height = std::max(1u, height / 2);
+    }
+}
+
+MipGenerator::MipGenerator(ThreadPool& threadPool) : m_threadPool(threadPool) {
+}
+
+uint32_t MipGenerator::mipLevelCount(uint32_t width, uint32_t height) {
+    return static_cast<uint32_t>(std::floor(std::log2(std::max(width, height)))) + 1;
+}
+
+uint64_t MipGenerator::levelOffsets(uint32_t width, uint32_t height, std::vector<uint64_t>& offsets) {
+    uint32_t mipLevels = mipLevelCount(width, height);
+    offsets.resize(mipLevels);
+    uint64_t offset = 0;
+    for (uint32_t i = 0; i < mipLevels; i++) {
+        offsets[i] = offset;
+        offset += (static_cast<uint64_t>(width) * height * 4 + 15) & ~15ull;
+        width = std::max(1u, width / 2);
+        height = std::max(1u, height / 2);
+    }
+    return offset;
+}
+
+const char* MipGenerator::simdPath() {
+#if defined(MIP_SIMD_AVX2)
+    return "avx2";
+#elif defined(MIP_SIMD_SSE2)
+    return "sse2";
+#elif defined(MIP_SIMD_NEON)
+    return "neon";
+#else
+    return "scalar";
+#endif
+}
+
+void MipGenerator::generate(const uint8_t* rgba, uint32_t width, uint32_t height, bool srgb, uint8_t* output) {
+    const SrgbTables& tables = srgbTables();
+    std::vector<uint64_t> offsets;
+    levelOffsets(width, height, offsets);
+    if (rgba != output) {
+        memcpy(output, rgba, static_cast<size_t>(width) * height * 4);
+    }
+    clearPadding(width, height, offsets, output);
+    auto forEachRowBlock = [&](uint32_t rows, const std::function<void(uint32_t, uint32_t)>& body) {
+        m_threadPool.parallelFor((rows + ROWS_PER_TASK - 1) / ROWS_PER_TASK, [&](size_t task) {
+            uint32_t begin = static_cast<uint32_t>(task) * ROWS_PER_TASK;
+            body(begin, std::min(begin + ROWS_PER_TASK, rows));
+        });
+    };
+
+    // 第0级解码为16位线性值，非颜色通道按v*257扩展
+    std::vector<uint16_t> current(static_cast<size_t>(width) * height * 4);
+    forEachRowBlock(height, [&](uint32_t begin, uint32_t end) {
+        for (size_t i = size_t(begin) * width * 4; i < size_t(end) * width * 4; i++) {
+            current[i] = srgb && (i & 3) != 3 ? tables.decode[rgba[i]] : static_cast<uint16_t>(rgba[i] * 257);
+        }
+    });
+    std::vector<uint16_t> next;
+    for (size_t level = 1; level < offsets.size(); level++) {
+        uint32_t dstWidth = std::max(1u, width / 2);
+        uint32_t dstHeight = std::max(1u, height / 2);
+        next.resize(static_cast<size_t>(dstWidth) * dstHeight * 4);
+        uint8_t* out = output + offsets[level];
+        forEachRowBlock(dstHeight, [&](uint32_t begin, uint32_t end) {
+            std::vector<uint16_t> padded;
+            for (uint32_t y = begin; y < end; y++) {
+                const uint16_t* row0 = current.data() + size_t(std::min(y * 2, height - 1)) * width * 4;
+                const uint16_t* row1 = current.data() + size_t(std::min(y * 2 + 1, height - 1)) * width * 4;
+                uint16_t* dst = next.data() + size_t(y) * dstWidth * 4;
+                if (width == 1) { // 只有一列时横向与自身平均
+                    padded.assign({row0[0], row0[1], row0[2], row0[3], row0[0], row0[1], row0[2], row0[3],
+                                   row1[0], row1[1], row1[2], row1[3], row1[0], row1[1], row1[2], row1[3]});
+                    filterRowScalar(padded.data(), padded.data() + 8, dst, 0, 1);
+                } else {
+                    filterRow(row0, row1, dst, dstWidth);
+                }
+                for (size_t i = size_t(y) * dstWidth * 4; i < size_t(y + 1) * dstWidth * 4; i++) {
+                    out[i] = srgb && (i & 3) != 3 ? tables.encode[next[i]] : static_cast<uint8_t>((next[i] + 128) / 257);
+                }
+            }
+        });
+        current.swap(next);
+        width = dstWidth;
+        height = dstHeight;
+    }
+}
+
+void MipGenerator::generateReference(const uint8_t* rgba, uint32_t width, uint32_t height, bool srgb,
+                                     uint8_t* output) {
+    std::vector<uint64_t> offsets;
+    levelOffsets(width, height, offsets);
+    if (rgba != output) {
+        memcpy(output, rgba, static_cast<size_t>(width) * height * 4);
+    }
+    clearPadding(width, height, offsets, output);
+    std::vector<float> current(static_cast<size_t>(width) * height * 4);
+    for (size_t i = 0; i < current.size(); i++) {
+        current[i] = srgb && (i & 3) != 3 ? srgbToLinear(rgba[i] / 255.0f) : rgba[i] / 255.0f;
+    }
+    for (size_t level = 1; level < offsets.size(); level++) {
+        uint32_t dstWidth = std::max(1u, width / 2);
+        uint32_t dstHeight = std::max(1u, height / 2);
+        std::vector<float> next(static_cast<size_t>(dstWidth) * dstHeight * 4);
+        for (uint32_t y = 0; y < dstHeight; y++) {
+            uint32_t y0 = std::min(y * 2, height - 1), y1 = std::min(y * 2 + 1, height - 1);
+            for (uint32_t x = 0; x < dstWidth; x++) {
+                uint32_t x0 = std::min(x * 2, width - 1), x1 = std::min(x * 2 + 1, width - 1);
+                for (int c = 0; c < 4; c++) {
+                    next[(size_t(y) * dstWidth + x) * 4 + c] =
+                        0.25f * (current[(size_t(y0) * width + x0) * 4 + c] + current[(size_t(y0) * width + x1) * 4 + c]
+                                 + current[(size_t(y1) * width + x0) * 4 + c] + current[(size_t(y1) * width + x1) * 4 + c]);
+                }
+            }
+        }
+        uint8_t* out = output + offsets[level];
+        for (size_t i = 0; i < next.size(); i++) {
+            float value = srgb && (i & 3) != 3 ? linearToSrgb(next[i]) : std::clamp(next[i], 0.0f, 1.0f);
+            out[i] = static_cast<uint8_t>(value * 255.0f + 0.5f);
+        }
+        current.swap(next);
+        width = dstWidth;
+        height = dstHeight;
+    }
+}
@@ -0,0 +1,365 @@
+﻿// ObjParser.cpp: 并行obj解析的实现
+//
+#include "ObjParser.h"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+// 块内遇到的o/g与usemtl，记录发生时块内已有的三角形数量，合并时换算为全局位置
+struct ObjParser::ChunkEvent {
+    enum Type { GROUP,
+                MATERIAL };
+    Type type;
+    size_t triangleOffset;
+    std::string name;
+};
+
+struct ObjParser::Chunk {
+    const char* begin;
+    const char* end;
+    // 第一遍统计的数量
+    size_t vertexCount = 0;
+    size_t texcoordCount = 0;
+    size_t normalCount = 0;
+    size_t triangleCount = 0;
+    size_t lineCount = 0;
+    std::vector<ChunkEvent> events;
+    std::vector<std::string> materialLibs;
+    // 前缀和得到的全局起始位置
+    size_t vertexBase = 0;
+    size_t texcoordBase = 0;
+    size_t normalBase = 0;
+    size_t triangleBase = 0;
+    size_t lineBase = 0; // 块的第一行在文件中的行号(从0开始)，用于报错
+    int startMaterial = -1;
+};
+
+const static size_t MIN_CHUNK_SIZE = 1 << 20;
+
+static bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static const char* skipSpace(const char* p, const char* end) {
+    while (p < end && isSpace(*p)) {
+        p++;
+    }
+    return p;
+}
+
+static const char* skipToken(const char* p, const char* end) {
+    while (p < end && !isSpace(*p)) {
+        p++;
+    }
+    return p;
+}
+
+static const char* findLineEnd(const char* p, const char* end) {
+    const void* newLine = memchr(p, '\n', end - p);
+    return newLine ? static_cast<const char*>(newLine) : end;
+}
+
+// 去掉首尾空白后的剩余部分，用于读取名字
+static std::string readName(const char* p, const char* end) {
+    p = skipSpace(p, end);
+    while (end > p && isSpace(end[-1])) {
+        end--;
+    }
+    return std::string(p, end);
+}
+
+static const char* parseFloat(const char* p, const char* end, float& value) {
+    p = skipSpace(p, end);
+    if (p < end && *p == '+') { // from_chars不接受显式的正号
+        p++;
+    }
+    auto result = std::from_chars(p, end, value);
+    if (result.ec != std::errc()) {
+        throw std::runtime_error("failed to parse obj: invalid number");
+    }
+    return result.ptr;
+}
+
+static const char* parseInt(const char* p, const char* end, int& value) {
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+    if (p == end || *p < '0' || *p > '9') {
+        throw std::runtime_error("failed to parse obj: invalid face index");
+    }
+    int result = 0;
+    while (p < end && *p >= '0' && *p <= '9') {
+        result = result * 10 + (*p - '0');
+        p++;
+    }
+    value = negative ? -result : result;
+    return p;
+}
+
+// obj索引从1开始，负数表示相对当前已读取的元素数量
+static int resolveIndex(int index, size_t currentCount) {
+    if (index > 0) {
+        return index - 1;
+    }
+    if (index < 0) {
+        return static_cast<int>(currentCount) + index;
+    }
+    throw std::runtime_error("failed to parse obj: face index 0");
+}
+
+static size_t countFaceVertices(const char* p, const char* end) {
+    size_t count = 0;
+    p = skipSpace(p, end);
+    while (p < end) {
+        count++;
+        p = skipSpace(skipToken(p, end), end);
+    }
+    return count;
+}
+
+// 判断行首的关键字，返回关键字之后的位置，不匹配时返回nullptr
+static const char* matchKeyword(const char* p, const char* end, const char* keyword) {
+    while (*keyword) {
+        if (p == end || *p != *keyword) {
+            return nullptr;
+        }
+        p++;
+        keyword++;
+    }
+    return (p == end || isSpace(*p)) ? p : nullptr;
+}
+
+void ObjParser::splitChunks(const MappedFile& file, std::vector<Chunk>& chunks) const {
+    const char* data = reinterpret_cast<const char*>(file.data());
+    const char* end = data + file.size();
+    size_t chunkSize = std::max(MIN_CHUNK_SIZE, file.size() / (m_threadPool.threadCount() * 4 + 1));
+    const char* begin = data;
+    while (begin < end) {
+        const char* chunkEnd = begin + std::min(chunkSize, static_cast<size_t>(end - begin));
+        chunkEnd = chunkEnd < end ? findLineEnd(chunkEnd, end) : end;
+        if (chunkEnd < end) {
+            chunkEnd++; // 块的边界落在换行符之后
+        }
+        Chunk chunk;
+        chunk.begin = begin;
+        chunk.end = chunkEnd;
+        chunks.push_back(std::move(chunk));
+        begin = chunkEnd;
+    }
+}
+
+void ObjParser::loadMaterials(const std::string& path, const std::vector<std::string>& materialLibs) {
+    std::filesystem::path baseDir = std::filesystem::path(path).parent_path();
+    for (const auto& lib : materialLibs) {
+        std::ifstream mtlFile(baseDir / lib);
+        if (!mtlFile.is_open()) { // 与tinyobj一致，缺少mtl只给出警告
+            std::cerr << "failed to open material library: " << lib << std::endl;
+            continue;
+        }
+        std::string warn, err;
+        tinyobj::LoadMtl(&m_materialMap, &m_materials, &mtlFile, &warn, &err);
+        if (!err.empty()) {
+            std::cerr << err << std::endl;
+        }
+    }
+}
+
+void ObjParser::parse(const std::string& path) {
+    MappedFile file;
+    if (!file.open(path)) {
+        throw std::runtime_error("failed to open obj file: " + path);
+    }
+    m_fileSize = file.size();
+    m_attrib = tinyobj::attrib_t();
+    m_indices.clear();
+    m_materialIds.clear();
+    m_materials.clear();
+    m_materialMap.clear();
+    m_shapes.clear();
+
+    std::vector<Chunk> chunks;
+    splitChunks(file, chunks);
+
+    // 第一遍：并行统计各块的顶点、纹理坐标、法线与三角形数量
+    m_threadPool.parallelFor(chunks.size(), [&](size_t c) {
+        Chunk& chunk = chunks[c];
+        const char* line = chunk.begin;
+        while (line < chunk.end) {
+            const char* lineEnd = findLineEnd(line, chunk.end);
+            const char* p = skipSpace(line, lineEnd);
+            const char* rest;
+            if ((rest = matchKeyword(p, lineEnd, "v"))) {
+                chunk.vertexCount++;
+            } else if ((rest = matchKeyword(p, lineEnd, "vt"))) {
+                chunk.texcoordCount++;
+            } else if ((rest = matchKeyword(p, lineEnd, "vn"))) {
+                chunk.normalCount++;
+            } else if ((rest = matchKeyword(p, lineEnd, "f"))) {
+                size_t faceVertexCount = countFaceVertices(rest, lineEnd);
+                if (faceVertexCount >= 3) {
+                    chunk.triangleCount += faceVertexCount - 2;
+                }
+            } else if ((rest = matchKeyword(p, lineEnd, "o")) || (rest = matchKeyword(p, lineEnd, "g"))) {
+                chunk.events.push_back({ChunkEvent::GROUP, chunk.triangleCount, readName(rest, lineEnd)});
+            } else if ((rest = matchKeyword(p, lineEnd, "usemtl"))) {
+                chunk.events.push_back({ChunkEvent::MATERIAL, chunk.triangleCount, readName(rest, lineEnd)});
+            } else if ((rest = matchKeyword(p, lineEnd, "mtllib"))) {
+                chunk.materialLibs.push_back(readName(rest, lineEnd));
+            }
+            chunk.lineCount++;
+            line = lineEnd + 1;
+        }
+    });
+
+    // 串行计算前缀和，并确定每个块开始时生效的材质
+    std::vector<std::string> materialLibs;
+    for (const auto& chunk : chunks) {
+        materialLibs.insert(materialLibs.end(), chunk.materialLibs.begin(), chunk.materialLibs.end());
+    }
+    loadMaterials(path, materialLibs);
+    size_t vertexCount = 0, texcoordCount = 0, normalCount = 0, triangleCount = 0, lineCount = 0;
+    int currentMaterial = -1;
+    ObjShape currentShape = {"", 0, 0};
+    for (auto& chunk : chunks) {
+        chunk.vertexBase = vertexCount;
+        chunk.texcoordBase = texcoordCount;
+        chunk.normalBase = normalCount;
+        chunk.triangleBase = triangleCount;
+        chunk.lineBase = lineCount;
+        chunk.startMaterial = currentMaterial;
+        for (const auto& event : chunk.events) {
+            if (event.type == ChunkEvent::MATERIAL) {
+                auto it = m_materialMap.find(event.name);
+                currentMaterial = it == m_materialMap.end() ? -1 : it->second;
+            } else {
+                size_t indexOffset = (chunk.triangleBase + event.triangleOffset) * 3;
+                currentShape.indexCount = indexOffset - currentShape.indexOffset;
+                if (currentShape.indexCount > 0) { // 没有面的组不产生shape
+                    m_shapes.push_back(currentShape);
+                }
+                currentShape = {event.name, indexOffset, 0};
+            }
+        }
+        vertexCount += chunk.vertexCount;
+        texcoordCount += chunk.texcoordCount;
+        normalCount += chunk.normalCount;
+        triangleCount += chunk.triangleCount;
+        lineCount += chunk.lineCount;
+    }
+    currentShape.indexCount = triangleCount * 3 - currentShape.indexOffset;
+    if (currentShape.indexCount > 0) {
+        m_shapes.push_back(currentShape);
+    }
+    m_attrib.vertices.resize(vertexCount * 3);
+    m_attrib.texcoords.resize(texcoordCount * 2);
+    m_attrib.normals.resize(normalCount * 3);
+    m_indices.resize(triangleCount * 3);
+    m_materialIds.resize(triangleCount);
+
+    // 第二遍：并行解析数值，写入各块在最终数组中的位置
+    m_threadPool.parallelFor(chunks.size(), [&](size_t c) {
+        const Chunk& chunk = chunks[c];
+        size_t vertexIndex = chunk.vertexBase;
+        size_t texcoordIndex = chunk.texcoordBase;
+        size_t normalIndex = chunk.normalBase;
+        tinyobj::index_t* outIndex = m_indices.data() + chunk.triangleBase * 3;
+        float* outVertex = m_attrib.vertices.data() + chunk.vertexBase * 3;
+        float* outTexcoord = m_attrib.texcoords.data() + chunk.texcoordBase * 2;
+        float* outNormal = m_attrib.normals.data() + chunk.normalBase * 3;
+        size_t lineNumber = chunk.lineBase;
+        const char* line = chunk.begin;
+        while (line < chunk.end) {
+            const char* lineEnd = findLineEnd(line, chunk.end);
+            const char* p = skipSpace(line, lineEnd);
+            const char* rest;
+            if ((rest = matchKeyword(p, lineEnd, "v"))) {
+                rest = parseFloat(rest, lineEnd, *outVertex++);
+                rest = parseFloat(rest, lineEnd, *outVertex++);
+                parseFloat(rest, lineEnd, *outVertex++); // 忽略可选的w与顶点颜色
+                vertexIndex++;
+            } else if ((rest = matchKeyword(p, lineEnd, "vt"))) {
+                rest = parseFloat(rest, lineEnd, *outTexcoord++);
+                parseFloat(rest, lineEnd, *outTexcoord++);
+                texcoordIndex++;
+            } else if ((rest = matchKeyword(p, lineEnd, "vn"))) {
+                rest = parseFloat(rest, lineEnd, *outNormal++);
+                rest = parseFloat(rest, lineEnd, *outNormal++);
+                parseFloat(rest, lineEnd, *outNormal++);
+                normalIndex++;
+            } else if ((rest = matchKeyword(p, lineEnd, "f")) && countFaceVertices(rest, lineEnd) >= 3) {
+                tinyobj::index_t first = {}, previous = {};
+                size_t faceVertex = 0;
+                rest = skipSpace(rest, lineEnd);
+                while (rest < lineEnd) {
+                    // 支持v、v/vt、v//vn与v/vt/vn四种形式
+                    tinyobj::index_t index = {-1, -1, -1};
+                    bool negative = false; // 出现了的索引解析为负数，-1只用来表示缺省
+                    int value;
+                    rest = parseInt(rest, lineEnd, value);
+                    index.vertex_index = resolveIndex(value, vertexIndex);
+                    if (rest < lineEnd && *rest == '/') {
+                        rest++;
+                        if (rest < lineEnd && *rest != '/') {
+                            rest = parseInt(rest, lineEnd, value);
+                            index.texcoord_index = resolveIndex(value, texcoordIndex);
+                            negative = negative || index.texcoord_index < 0;
+                        }
+                        if (rest < lineEnd && *rest == '/') {
+                            rest = parseInt(rest + 1, lineEnd, value);
+                            index.normal_index = resolveIndex(value, normalIndex);
+                            negative = negative || index.normal_index < 0;
+                        }
+                    }
+                    if (negative || index.vertex_index < 0 || static_cast<size_t>(index.vertex_index) >= vertexCount
+                        || index.texcoord_index >= static_cast<int>(texcoordCount)
+                        || index.normal_index >= static_cast<int>(normalCount)) {
+                        throw std::runtime_error("failed to parse obj: face index out of range at line "
+                                                 + std::to_string(lineNumber + 1));
+                    }
+                    if (faceVertex == 0) {
+                        first = index;
+                    } else if (faceVertex >= 2) { // 以第一个顶点为中心做扇形三角化
+                        *outIndex++ = first;
+                        *outIndex++ = previous;
+                        *outIndex++ = index;
+                    }
+                    previous = index;
+                    faceVertex++;
+                    rest = skipSpace(rest, lineEnd);
+                }
+            }
+            lineNumber++;
+            line = lineEnd + 1;
+        }
+
+        // 按usemtl出现的位置填充每个三角形的材质
+        int* materialIds = m_materialIds.data() + chunk.triangleBase;
+        int material = chunk.startMaterial;
+        size_t triangle = 0;
+        for (const auto& event : chunk.events) {
+            if (event.type != ChunkEvent::MATERIAL) {
+                continue;
+            }
+            std::fill(materialIds + triangle, materialIds + event.triangleOffset, material);
+            triangle = event.triangleOffset;
+            auto it = m_materialMap.find(event.name);
+            material = it == m_materialMap.end() ? -1 : it->second;
+        }
+        std::fill(materialIds + triangle, materialIds + chunk.triangleCount, material);
+    });
+}
+
+std::vector<IndexRange> ObjParser::indexRanges() const {
+    std::vector<IndexRange> ranges;
+    ranges.reserve(m_shapes.size());
+    for (const auto& shape : m_shapes) {
+        ranges.push_back({m_indices.data() + shape.indexOffset, shape.indexCount});
+    }
+    return ranges;
+}
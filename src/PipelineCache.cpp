@@ -0,0 +1,112 @@
+﻿// PipelineCache.cpp: 磁盘管线缓存的读写
+//
+#include "PipelineCache.h"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+// VkPipelineCacheHeaderVersionOne的布局：headerSize、headerVersion、vendorID、deviceID各4字节，之后是16字节的UUID
+const static size_t PIPELINE_CACHE_HEADER_SIZE = 16 + VK_UUID_SIZE;
+
+static uint32_t readUint32(const char* data) {
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+std::string PipelineCache::defaultPath() {
+    return std::filesystem::current_path().generic_string() + "/LearnVK.pipelinecache";
+}
+
+bool PipelineCache::isCompatible(const std::vector<char>& data) const {
+    if (data.size() < PIPELINE_CACHE_HEADER_SIZE) {
+        return false;
+    }
+    uint32_t headerSize = readUint32(data.data());
+    uint32_t headerVersion = readUint32(data.data() + 4);
+    uint32_t vendorID = readUint32(data.data() + 8);
+    uint32_t deviceID = readUint32(data.data() + 12);
+    return headerSize >= PIPELINE_CACHE_HEADER_SIZE && headerSize <= data.size()
+           && headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+           && vendorID == m_properties.vendorID && deviceID == m_properties.deviceID
+           && memcmp(data.data() + 16, m_properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+void PipelineCache::init(VkPhysicalDevice physicalDevice, VkDevice device, const std::string& path) {
+    m_device = device;
+    m_path = path;
+    vkGetPhysicalDeviceProperties(physicalDevice, &m_properties);
+
+    std::vector<char> data;
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (file.is_open()) {
+        data.resize(static_cast<size_t>(file.tellg()));
+        file.seekg(0);
+        file.read(data.data(), data.size());
+        if (!file.good()) {
+            data.clear();
+        }
+    }
+    m_warm = isCompatible(data);
+    if (!m_warm && !data.empty()) {
+        std::cout << "pipeline cache: " << path << " was created by another device or driver, discarded" << std::endl;
+    }
+
+    VkPipelineCacheCreateInfo createInfo = {};
+    createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    createInfo.initialDataSize = m_warm ? data.size() : 0;
+    createInfo.pInitialData = m_warm ? data.data() : nullptr;
+    VkResult res = vkCreatePipelineCache(m_device, &createInfo, nullptr, &m_cache);
+    if (res != VK_SUCCESS && m_warm) { // 驱动仍可能拒绝数据，此时退回空缓存
+        m_warm = false;
+        createInfo.initialDataSize = 0;
+        createInfo.pInitialData = nullptr;
+        res = vkCreatePipelineCache(m_device, &createInfo, nullptr, &m_cache);
+    }
+    if (res != VK_SUCCESS) {
+        throw std::runtime_error("failed to create pipeline cache!");
+    }
+}
+
+bool PipelineCache::save() {
+    size_t size = 0;
+    if (vkGetPipelineCacheData(m_device, m_cache, &size, nullptr) != VK_SUCCESS || size == 0) {
+        return false;
+    }
+    std::vector<char> data(size);
+    if (vkGetPipelineCacheData(m_device, m_cache, &size, data.data()) != VK_SUCCESS) {
+        return false;
+    }
+    data.resize(size);
+
+    std::string tempPath = m_path + ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            return false;
+        }
+        file.write(data.data(), data.size());
+        file.close();
+        if (!file.good()) {
+            std::error_code ec;
+            std::filesystem::remove(tempPath, ec);
+            return false;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(tempPath, m_path, ec);
+    if (ec) {
+        std::filesystem::remove(tempPath, ec);
+        return false;
+    }
+    return true;
+}
+
+void PipelineCache::destroy() {
+    if (m_cache != VK_NULL_HANDLE) {
+        vkDestroyPipelineCache(m_device, m_cache, nullptr);
+        m_cache = VK_NULL_HANDLE;
+    }
+}
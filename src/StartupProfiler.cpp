@@ -0,0 +1,59 @@
+﻿// StartupProfiler.cpp: 启动阶段耗时统计的实现
+//
+#include "StartupProfiler.h"
+#include <algorithm>
+#include <fstream>
+
+StartupProfiler::StartupProfiler() : m_origin(Clock::now()), m_mainThread(std::this_thread::get_id()) {
+}
+
+void StartupProfiler::record(const std::string& name, Clock::time_point start, Clock::time_point end) {
+    StartupPhase phase;
+    phase.name = name;
+    phase.mainThread = std::this_thread::get_id() == m_mainThread;
+    phase.startMs = std::chrono::duration<double, std::milli>(start - m_origin).count();
+    phase.endMs = std::chrono::duration<double, std::milli>(end - m_origin).count();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_phases.push_back(phase);
+}
+
+void StartupProfiler::mark(const std::string& name) {
+    Clock::time_point now = Clock::now();
+    record(name, now, now);
+}
+
+double StartupProfiler::elapsedMs() const {
+    return std::chrono::duration<double, std::milli>(Clock::now() - m_origin).count();
+}
+
+std::vector<StartupPhase> StartupProfiler::phases() const {
+    std::vector<StartupPhase> result;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        result = m_phases;
+    }
+    std::stable_sort(result.begin(), result.end(), [](const StartupPhase& a, const StartupPhase& b) {
+        return a.startMs < b.startMs;
+    });
+    return result;
+}
+
+void StartupProfiler::print(std::ostream& out) const {
+    for (const StartupPhase& phase : phases()) {
+        out << "startup: " << (phase.mainThread ? "[main]   " : "[worker] ") << phase.name << " " << phase.startMs
+            << " -> " << phase.endMs << " ms (" << phase.endMs - phase.startMs << " ms)" << std::endl;
+    }
+}
+
+bool StartupProfiler::exportCsv(const std::string& path) const {
+    std::ofstream file(path);
+    if (!file.is_open()) {
+        return false;
+    }
+    file << "phase,thread,start_ms,end_ms,duration_ms\n";
+    for (const StartupPhase& phase : phases()) {
+        file << phase.name << ',' << (phase.mainThread ? "main" : "worker") << ',' << phase.startMs << ','
+             << phase.endMs << ',' << phase.endMs - phase.startMs << '\n';
+    }
+    return file.good();
+}
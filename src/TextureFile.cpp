@@ -0,0 +1,151 @@
+﻿// TextureFile.cpp: 烘焙纹理文件的读写
+//
+#include "TextureFile.h"
+#include "vulkan/vulkan_core.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+
+static bool querySourceStamp(const std::string& texturePath, uint64_t& size, int64_t& writeTime) {
+    std::error_code ec;
+    size = static_cast<uint64_t>(std::filesystem::file_size(texturePath, ec));
+    if (ec) {
+        return false;
+    }
+    auto time = std::filesystem::last_write_time(texturePath, ec);
+    if (ec) {
+        return false;
+    }
+    writeTime = static_cast<int64_t>(time.time_since_epoch().count());
+    return true;
+}
+
+static uint64_t alignOffset(uint64_t offset, uint64_t alignment) {
+    return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+// 按格式与尺寸计算一个层级紧密排列时的字节数，不是TextureCooker会写出的格式时返回0
+static uint64_t expectedLevelSize(uint32_t format, uint32_t width, uint32_t height) {
+    uint64_t blocks = static_cast<uint64_t>((width + 3) / 4) * ((height + 3) / 4);
+    switch (static_cast<VkFormat>(format)) {
+    case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+    case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+        return blocks * 8;
+    case VK_FORMAT_BC3_UNORM_BLOCK:
+    case VK_FORMAT_BC3_SRGB_BLOCK:
+    case VK_FORMAT_BC7_UNORM_BLOCK:
+    case VK_FORMAT_BC7_SRGB_BLOCK:
+        return blocks * 16;
+    case VK_FORMAT_R8G8B8A8_UNORM:
+    case VK_FORMAT_R8G8B8A8_SRGB:
+        return static_cast<uint64_t>(width) * height * 4;
+    default:
+        return 0;
+    }
+}
+
+static uint32_t maxMipLevels(uint32_t width, uint32_t height) {
+    uint32_t levels = 1;
+    for (uint32_t size = std::max(width, height); size > 1; size /= 2) {
+        levels++;
+    }
+    return levels;
+}
+
+std::string TextureFile::cookedPath(const std::string& texturePath) {
+    return texturePath + ".lvktex";
+}
+
+bool TextureFile::open(const std::string& texturePath) {
+    close();
+    uint64_t sourceSize = 0;
+    int64_t sourceWriteTime = 0;
+    bool hasSource = querySourceStamp(texturePath, sourceSize, sourceWriteTime);
+    if (!m_file.open(cookedPath(texturePath))) {
+        return false;
+    }
+    auto header = reinterpret_cast<const TextureFileHeader*>(m_file.data());
+    bool valid = m_file.size() >= sizeof(TextureFileHeader) && header->magic == TEXTURE_FILE_MAGIC
+                 && header->version == TEXTURE_FILE_VERSION && header->width > 0 && header->height > 0
+                 && header->mipLevels > 0 && header->mipLevels <= maxMipLevels(header->width, header->height)
+                 && m_file.size() >= sizeof(TextureFileHeader) + sizeof(TextureFileLevel) * header->mipLevels;
+    // 只分发了烘焙文件而没有源图片时直接使用
+    if (valid && hasSource) {
+        valid = header->sourceSize == sourceSize && header->sourceWriteTime == sourceWriteTime;
+    }
+    // 上传时按层级的尺寸与格式计算拷贝区域和行的大小，尺寸链或数据大小不符的文件视为损坏，交给调用者重新烘焙或解码
+    auto levels = reinterpret_cast<const TextureFileLevel*>(m_file.data() + sizeof(TextureFileHeader));
+    uint32_t width = valid ? header->width : 0, height = valid ? header->height : 0;
+    uint64_t levelsEnd = sizeof(TextureFileHeader) + sizeof(TextureFileLevel) * static_cast<uint64_t>(valid ? header->mipLevels : 0);
+    for (uint32_t i = 0; valid && i < header->mipLevels; i++) {
+        uint64_t expectedSize = expectedLevelSize(header->format, width, height);
+        valid = expectedSize != 0 && levels[i].width == width && levels[i].height == height
+                && levels[i].size == expectedSize && levels[i].size <= m_file.size()
+                && levels[i].offset <= m_file.size() - levels[i].size
+                && (i == 0 ? levels[i].offset >= levelsEnd
+                           : levels[i].offset == alignOffset(levels[i - 1].offset + levels[i - 1].size, 16));
+        width = std::max(1u, width / 2);
+        height = std::max(1u, height / 2);
+    }
+    if (!valid) {
+        m_file.close();
+        return false;
+    }
+    m_header = header;
+    m_levels = levels;
+    return true;
+}
+
+bool TextureFile::write(const std::string& texturePath, uint32_t format, const std::vector<TextureLevelData>& levels) {
+    TextureFileHeader header = {};
+    header.magic = TEXTURE_FILE_MAGIC;
+    header.version = TEXTURE_FILE_VERSION;
+    header.format = format;
+    header.width = levels[0].width;
+    header.height = levels[0].height;
+    header.mipLevels = static_cast<uint32_t>(levels.size());
+    if (!querySourceStamp(texturePath, header.sourceSize, header.sourceWriteTime)) {
+        return false;
+    }
+    // 每一级按16字节对齐，满足块压缩格式拷贝时bufferOffset的对齐要求
+    std::vector<TextureFileLevel> levelInfos(levels.size());
+    uint64_t offset = sizeof(TextureFileHeader) + sizeof(TextureFileLevel) * levels.size();
+    for (size_t i = 0; i < levels.size(); i++) {
+        offset = alignOffset(offset, 16);
+        levelInfos[i] = {offset, levels[i].data.size(), levels[i].width, levels[i].height};
+        offset += levels[i].data.size();
+    }
+
+    std::string path = cookedPath(texturePath);
+    std::string tempPath = path + ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            return false;
+        }
+        const char padding[16] = {};
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(levelInfos.data()), sizeof(TextureFileLevel) * levelInfos.size());
+        uint64_t position = sizeof(TextureFileHeader) + sizeof(TextureFileLevel) * levels.size();
+        for (size_t i = 0; i < levels.size(); i++) {
+            file.write(padding, levelInfos[i].offset - position);
+            file.write(reinterpret_cast<const char*>(levels[i].data.data()), levels[i].data.size());
+            position = levelInfos[i].offset + levelInfos[i].size;
+        }
+        file.close();
+        if (!file.good()) {
+            std::error_code ec;
+            std::filesystem::remove(tempPath, ec);
+            return false;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(tempPath, path, ec);
+    if (ec) {
+        std::filesystem::remove(tempPath, ec);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,220 @@
+﻿// TextureLoader.cpp: 并行纹理解码的实现
+//
+
+#include "TextureLoader.h"
+#include "MipGenerator.h"
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+// 解码到暂存内存时的输出目标，每个线程同时只解码一张图片
+struct DecodeTarget {
+    uint8_t* data;   // 预留的暂存空间，为空时所有分配都使用堆
+    size_t size;     // RGBA8第0级的大小
+    size_t capacity; // 预留空间的大小
+    bool inUse;
+};
+static thread_local DecodeTarget s_decodeTarget = {nullptr, 0, 0, false};
+
+// stb_image的内存分配钩子：大小与输出图像一致的分配(jpeg解码器会多分配一个字节)直接使用预留的暂存空间，
+// 解码结果因此写进映射的暂存内存；其余的中间缓冲仍使用堆
+static void* decodeMalloc(size_t size) {
+    DecodeTarget& target = s_decodeTarget;
+    if (target.data != nullptr && !target.inUse && size >= target.size && size <= target.size + 1
+        && size <= target.capacity) {
+        target.inUse = true;
+        return target.data;
+    }
+    return malloc(size);
+}
+
+static void decodeFree(void* data) {
+    if (data != nullptr && data == s_decodeTarget.data) {
+        s_decodeTarget.inUse = false;
+        return;
+    }
+    free(data);
+}
+
+static void* decodeRealloc(void* data, size_t size) {
+    DecodeTarget& target = s_decodeTarget;
+    if (data == nullptr || data != target.data) {
+        return realloc(data, size);
+    }
+    if (size <= target.capacity) {
+        return data;
+    }
+    void* moved = malloc(size); // 放不下时移到堆上，之后由调用者回退为拷贝
+    if (moved != nullptr) {
+        memcpy(moved, data, target.capacity);
+        target.inUse = false;
+    }
+    return moved;
+}
+
+#define STB_IMAGE_IMPLEMENTATION // 实现只在这一个编译单元中展开，分配钩子只对这里生效
+#define STBI_MALLOC(size) decodeMalloc(size)
+#define STBI_REALLOC(data, size) decodeRealloc(data, size)
+#define STBI_FREE(data) decodeFree(data)
+#include <vendor/stb_image.h>
+
+TextureLoader::TextureLoader(ThreadPool& threadPool, UploadContext& uploadContext)
+    : m_threadPool(threadPool), m_uploadContext(uploadContext) {
+}
+
+DecodedImage TextureLoader::decodeImage(const std::string& path) {
+    auto startTime = std::chrono::high_resolution_clock::now();
+    int width, height, channels;
+    stbi_uc* pixels = stbi_load(path.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+    if (!pixels) {
+        throw std::runtime_error("failed to load textures! searching:" + path);
+    }
+    DecodedImage image;
+    image.path = path;
+    image.width = static_cast<uint32_t>(width);
+    image.height = static_cast<uint32_t>(height);
+    image.pixels = std::shared_ptr<uint8_t>(pixels, [](uint8_t* data) { stbi_image_free(data); });
+    image.decodeMs = std::chrono::duration<double, std::milli>(
+                         std::chrono::high_resolution_clock::now() - startTime)
+                         .count();
+    return image;
+}
+
+void TextureLoader::decodeImageTo(const std::string& path, uint32_t width, uint32_t height, void* output,
+                                  size_t capacity) {
+    size_t size = size_t(width) * height * 4;
+    s_decodeTarget = {static_cast<uint8_t*>(output), size, capacity, false};
+    int decodedWidth, decodedHeight, channels;
+    stbi_uc* pixels = stbi_load(path.c_str(), &decodedWidth, &decodedHeight, &channels, STBI_rgb_alpha);
+    s_decodeTarget = {nullptr, 0, 0, false};
+    if (!pixels) {
+        throw std::runtime_error("failed to load textures! searching:" + path);
+    }
+    if (pixels == output) {
+        return;
+    }
+    // 预留空间被解码器的中间缓冲占用过，结果留在了堆上，退回为一次拷贝
+    bool sizeMatches = static_cast<uint32_t>(decodedWidth) == width && static_cast<uint32_t>(decodedHeight) == height;
+    if (sizeMatches) {
+        memcpy(output, pixels, size);
+    }
+    stbi_image_free(pixels);
+    if (!sizeMatches) { // 读取尺寸之后文件被修改
+        throw std::runtime_error("texture size changed while loading: " + path);
+    }
+}
+
+std::vector<DecodedImage> TextureLoader::decode(const std::vector<std::string>& paths) {
+    std::vector<DecodedImage> images(paths.size());
+    m_threadPool.parallelFor(paths.size(), [&](size_t i) { images[i] = decodeImage(paths[i]); });
+    return images;
+}
+
+std::vector<TextureInfo> TextureLoader::load(std::vector<DecodedImage>& images,
+                                             const std::function<void(const TextureInfo&)>& record, bool generateMips) {
+    std::vector<TextureInfo> textures(images.size());
+    for (size_t i = 0; i < images.size(); i++) {
+        if (!images[i].pixels) {
+            throw std::runtime_error("texture is not decoded: " + images[i].path);
+        }
+        textures[i].path = images[i].path;
+        textures[i].width = images[i].width;
+        textures[i].height = images[i].height;
+        textures[i].decodeMs = images[i].decodeMs;
+    }
+    upload(textures, [&](size_t i, TextureInfo& texture, VkDeviceSize) {
+        memcpy(texture.staging.mapped, images[i].pixels.get(), size_t(texture.width) * texture.height * 4);
+        images[i].pixels.reset();
+    }, record, generateMips);
+    return textures;
+}
+
+std::vector<TextureInfo> TextureLoader::load(const std::vector<std::string>& paths,
+                                             const std::function<void(const TextureInfo&)>& record, bool generateMips) {
+    // 只读取文件头得到尺寸，据此预留暂存空间
+    std::vector<TextureInfo> textures(paths.size());
+    m_threadPool.parallelFor(paths.size(), [&](size_t i) {
+        int width, height, channels;
+        if (!stbi_info(paths[i].c_str(), &width, &height, &channels)) {
+            throw std::runtime_error("failed to load textures! searching:" + paths[i]);
+        }
+        textures[i].path = paths[i];
+        textures[i].width = static_cast<uint32_t>(width);
+        textures[i].height = static_cast<uint32_t>(height);
+    });
+    upload(textures, [&](size_t, TextureInfo& texture, VkDeviceSize capacity) {
+        auto startTime = std::chrono::high_resolution_clock::now();
+        decodeImageTo(texture.path, texture.width, texture.height, texture.staging.mapped, capacity);
+        texture.decodeMs = std::chrono::duration<double, std::milli>(
+                               std::chrono::high_resolution_clock::now() - startTime)
+                               .count();
+    }, record, generateMips);
+    return textures;
+}
+
+void TextureLoader::upload(std::vector<TextureInfo>& textures, const StagingFill& fill,
+                           const std::function<void(const TextureInfo&)>& record, bool generateMips) {
+    std::vector<VkDeviceSize> stagingSizes(textures.size());
+    for (size_t i = 0; i < textures.size(); i++) {
+        textures[i].mipLevels = generateMips ? MipGenerator::mipLevelCount(textures[i].width, textures[i].height) : 1;
+        textures[i].mipMs = 0.0;
+        std::vector<uint64_t> offsets;
+        // 不生成mip链时多留一个字节给jpeg解码器的额外分配，生成时第0级之后的空间足够
+        stagingSizes[i] = generateMips ? MipGenerator::levelOffsets(textures[i].width, textures[i].height, offsets)
+                                       : VkDeviceSize(textures[i].width) * textures[i].height * 4 + 1;
+    }
+
+    // 预留空间之前提交已录制的内容，保证分组内预留的空间不会随一次被迫的提交而提前回收
+    m_uploadContext.submit();
+    const VkDeviceSize groupBudget = m_uploadContext.ringSize() / 2;
+    struct Group {
+        size_t begin;
+        size_t end;
+        UploadTicket ticket;
+        std::chrono::high_resolution_clock::time_point submitTime;
+    };
+    std::vector<Group> groups;
+    size_t begin = 0;
+    while (begin < textures.size()) {
+        size_t end = begin;
+        VkDeviceSize groupSize = 0;
+        do { // 超过预算的单张纹理独占一组，由UploadContext使用临时缓冲
+            groupSize += stagingSizes[end];
+            end++;
+        } while (end < textures.size() && groupSize + stagingSizes[end] <= groupBudget);
+
+        for (size_t i = begin; i < end; i++) {
+            textures[i].staging = m_uploadContext.reserve(stagingSizes[i]);
+        }
+        m_threadPool.parallelFor(end - begin, [&](size_t j) {
+            fill(begin + j, textures[begin + j], stagingSizes[begin + j]);
+        });
+        if (generateMips) { // 生成器自身按行并行，逐张纹理执行
+            MipGenerator mipGenerator(m_threadPool);
+            for (size_t i = begin; i < end; i++) {
+                auto startTime = std::chrono::high_resolution_clock::now();
+                uint8_t* mapped = static_cast<uint8_t*>(textures[i].staging.mapped);
+                mipGenerator.generate(mapped, textures[i].width, textures[i].height, true, mapped);
+                textures[i].mipMs = std::chrono::duration<double, std::milli>(
+                                        std::chrono::high_resolution_clock::now() - startTime)
+                                        .count();
+            }
+        }
+        for (size_t i = begin; i < end; i++) {
+            record(textures[i]);
+        }
+        groups.push_back({begin, end, m_uploadContext.submit(), std::chrono::high_resolution_clock::now()});
+        begin = end;
+    }
+
+    for (auto& group : groups) {
+        m_uploadContext.wait(group.ticket);
+        double uploadMs = std::chrono::duration<double, std::milli>(
+                              std::chrono::high_resolution_clock::now() - group.submitTime)
+                              .count();
+        for (size_t i = group.begin; i < group.end; i++) {
+            textures[i].uploadMs = uploadMs;
+        }
+    }
+}
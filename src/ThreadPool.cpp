@@ -0,0 +1,109 @@
+﻿// ThreadPool.cpp: 线程池实现
+//
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+
+ThreadPool::ThreadPool(uint32_t threadCount) {
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (uint32_t i = 0; i < threadCount; i++) {
+        m_workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_condition.notify_all();
+    for (auto& worker : m_workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::workerLoop() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock, [this]() { return m_stop || !m_tasks.empty(); });
+            if (m_stop && m_tasks.empty()) {
+                return;
+            }
+            task = std::move(m_tasks.front());
+            m_tasks.pop();
+        }
+        task();
+    }
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& body) {
+    if (count == 0) {
+        return;
+    }
+    if (count == 1) {
+        body(0);
+        return;
+    }
+    // 通过原子计数领取任务，负载不均衡时先完成的线程会继续领取
+    // 外层任务本身运行在工作线程上时(如启动时后台解析模型)，排队的协助任务可能迟迟得不到线程，
+    // 因此调用线程做完所有工作后不等待未开始的协助任务，只等待已经开始的，未开始的之后直接退出
+    struct State {
+        std::atomic<size_t> next{0};
+        size_t count = 0;
+        const std::function<void(size_t)>* body = nullptr;
+        std::exception_ptr error;
+        std::mutex mutex;
+        std::condition_variable idle;
+        size_t active = 0;
+        bool closed = false;
+    };
+    auto state = std::make_shared<State>();
+    state->count = count;
+    state->body = &body;
+    auto run = [](State& s) {
+        for (size_t i = s.next.fetch_add(1); i < s.count; i = s.next.fetch_add(1)) {
+            try {
+                (*s.body)(i);
+            } catch (...) { // 记录第一个异常并让其余线程停止领取
+                std::lock_guard<std::mutex> lock(s.mutex);
+                if (!s.error) {
+                    s.error = std::current_exception();
+                }
+                s.next = s.count;
+            }
+        }
+    };
+    size_t helperCount = std::min(count - 1, m_workers.size());
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (size_t i = 0; i < helperCount; i++) {
+            m_tasks.emplace([state, run]() {
+                {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    if (state->closed) {
+                        return;
+                    }
+                    state->active++;
+                }
+                run(*state);
+                std::lock_guard<std::mutex> lock(state->mutex);
+                if (--state->active == 0) {
+                    state->idle.notify_all();
+                }
+            });
+        }
+    }
+    m_condition.notify_all();
+    run(*state);
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->closed = true; // body引用调用者的栈，关闭后开始的协助任务不再访问它
+    state->idle.wait(lock, [&]() { return state->active == 0; });
+    if (state->error) {
+        std::rethrow_exception(state->error);
+    }
+}
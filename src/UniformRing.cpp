@@ -0,0 +1,53 @@
+﻿// UniformRing.cpp: 每帧uniform环形缓冲的实现
+//
+
+#include "UniformRing.h"
+#include <stdexcept>
+
+void UniformRing::init(VkDevice device, DeviceMemoryAllocator& allocator, VkDeviceSize alignment, uint32_t frameCount,
+                       VkDeviceSize frameSize) {
+    m_device = device;
+    m_allocator = &allocator;
+    m_alignment = alignment > 0 ? alignment : 1;
+    m_frameSize = (frameSize + m_alignment - 1) / m_alignment * m_alignment; // 保证每一帧的起点满足对齐
+    if (m_frameSize * frameCount > UINT32_MAX) {
+        throw std::runtime_error("uniform ring is too large for dynamic offsets!");
+    }
+
+    VkBufferCreateInfo bufferInfo = {};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = m_frameSize * frameCount;
+    bufferInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    if (vkCreateBuffer(m_device, &bufferInfo, nullptr, &m_buffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create uniform ring buffer!");
+    }
+    m_memory = m_allocator->allocateForBuffer(
+        m_buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    m_frameBegin = 0;
+    m_head = 0;
+}
+
+void UniformRing::destroy() {
+    if (m_buffer == VK_NULL_HANDLE) {
+        return;
+    }
+    vkDestroyBuffer(m_device, m_buffer, nullptr);
+    m_allocator->free(m_memory);
+    m_buffer = VK_NULL_HANDLE;
+}
+
+void UniformRing::beginFrame(uint32_t frameIndex) {
+    m_frameBegin = m_frameSize * frameIndex;
+    m_head = m_frameBegin;
+}
+
+uint32_t UniformRing::allocate(VkDeviceSize size, void** mapped) {
+    VkDeviceSize offset = m_head;
+    if (offset + size > m_frameBegin + m_frameSize) {
+        throw std::runtime_error("uniform ring frame overflow!");
+    }
+    m_head = (offset + size + m_alignment - 1) / m_alignment * m_alignment;
+    *mapped = static_cast<uint8_t*>(m_memory.mapped) + offset;
+    return static_cast<uint32_t>(offset);
+}
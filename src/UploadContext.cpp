@@ -0,0 +1,385 @@
+﻿// UploadContext.cpp: 批量上传管理的实现
+//
+#include "UploadContext.h"
+#include <cstring>
+#include <stdexcept>
+
+const static uint32_t MAX_UPLOAD_BATCHES = 8;
+
+static VkBuffer createStagingBuffer(VkDevice device, DeviceMemoryAllocator& allocator, VkDeviceSize size,
+                                    MemoryAllocation& memory) {
+    VkBufferCreateInfo createInfo = {};
+    createInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    createInfo.size = size;
+    createInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    VkBuffer buffer;
+    if (vkCreateBuffer(device, &createInfo, nullptr, &buffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create staging buffer!");
+    }
+    memory = allocator.allocateForBuffer(buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    return buffer;
+}
+
+static VkCommandPool createUploadCommandPool(VkDevice device, uint32_t queueFamily) {
+    VkCommandPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.queueFamilyIndex = queueFamily;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    VkCommandPool commandPool;
+    if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create upload command pool!");
+    }
+    return commandPool;
+}
+
+static VkCommandBuffer allocateUploadCommandBuffer(VkDevice device, VkCommandPool commandPool) {
+    VkCommandBufferAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = commandPool;
+    allocInfo.commandBufferCount = 1;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    VkCommandBuffer commandBuffer;
+    if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate upload command buffer!");
+    }
+    return commandBuffer;
+}
+
+void UploadContext::init(VkDevice device, DeviceMemoryAllocator& allocator,
+                         uint32_t transferFamily, VkQueue transferQueue, uint32_t graphicsFamily, VkQueue graphicsQueue,
+                         VkExtent3D imageGranularity, VkDeviceSize ringSize) {
+    m_device = device;
+    m_allocator = &allocator;
+    m_transferFamily = transferFamily;
+    m_graphicsFamily = graphicsFamily;
+    m_imageGranularity = imageGranularity;
+    m_transferQueue = transferQueue;
+    m_graphicsQueue = graphicsQueue;
+    m_ringSize = ringSize;
+
+    m_transferCommandPool = createUploadCommandPool(m_device, m_transferFamily);
+    m_graphicsCommandPool = hasDedicatedTransferQueue() ? createUploadCommandPool(m_device, m_graphicsFamily)
+                                                        : m_transferCommandPool;
+
+    // 批次数量固定，指针在整个生命周期内保持有效
+    m_batches.resize(MAX_UPLOAD_BATCHES);
+    VkFenceCreateInfo fenceInfo = {};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    VkSemaphoreCreateInfo semaphoreInfo = {};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    for (auto& batch : m_batches) {
+        batch.transferCommandBuffer = allocateUploadCommandBuffer(m_device, m_transferCommandPool);
+        batch.graphicsCommandBuffer = batch.transferCommandBuffer;
+        batch.transferFinished = VK_NULL_HANDLE;
+        if (hasDedicatedTransferQueue()) {
+            batch.graphicsCommandBuffer = allocateUploadCommandBuffer(m_device, m_graphicsCommandPool);
+            if (vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &batch.transferFinished) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create upload semaphore!");
+            }
+        }
+        if (vkCreateFence(m_device, &fenceInfo, nullptr, &batch.fence) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create upload fence!");
+        }
+        m_freeBatches.push_back(&batch);
+    }
+
+    m_ringBuffer = createStagingBuffer(m_device, allocator, m_ringSize, m_ringMemory);
+}
+
+void UploadContext::destroy() {
+    if (m_recording) {
+        submit();
+    }
+    wait(m_lastTicket);
+    for (auto& batch : m_batches) {
+        vkDestroyFence(m_device, batch.fence, nullptr);
+        if (batch.transferFinished != VK_NULL_HANDLE) {
+            vkDestroySemaphore(m_device, batch.transferFinished, nullptr);
+        }
+    }
+    m_batches.clear();
+    m_freeBatches.clear();
+    if (hasDedicatedTransferQueue()) {
+        vkDestroyCommandPool(m_device, m_graphicsCommandPool, nullptr);
+    }
+    vkDestroyCommandPool(m_device, m_transferCommandPool, nullptr);
+    vkDestroyBuffer(m_device, m_ringBuffer, nullptr);
+    m_allocator->free(m_ringMemory);
+}
+
+UploadContext::Batch* UploadContext::acquireBatch() {
+    retire(false);
+    if (m_freeBatches.empty()) {
+        retire(true);
+    }
+    Batch* batch = m_freeBatches.back();
+    m_freeBatches.pop_back();
+    return batch;
+}
+
+// 按提交顺序回收已完成的批次，block为true时至少等待最早的一个批次
+void UploadContext::retire(bool block) {
+    while (!m_inFlight.empty()) {
+        Batch* batch = m_inFlight.front();
+        if (block) {
+            vkWaitForFences(m_device, 1, &batch->fence, VK_TRUE, UINT64_MAX);
+            block = false;
+        } else if (vkGetFenceStatus(m_device, batch->fence) != VK_SUCCESS) {
+            break;
+        }
+        vkResetFences(m_device, 1, &batch->fence);
+        for (auto& temp : batch->tempBuffers) {
+            vkDestroyBuffer(m_device, temp.first, nullptr);
+            m_allocator->free(temp.second);
+        }
+        batch->tempBuffers.clear();
+        m_ringTail = batch->ringEnd;
+        m_completedTicket = batch->ticket;
+        m_inFlight.pop_front();
+        m_freeBatches.push_back(batch);
+    }
+}
+
+void UploadContext::beginBatch() {
+    m_recording = acquireBatch();
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(m_recording->transferCommandBuffer, &beginInfo);
+    if (hasDedicatedTransferQueue()) {
+        vkBeginCommandBuffer(m_recording->graphicsCommandBuffer, &beginInfo);
+    }
+    m_recording->transferQuery = GpuProfiler::INVALID_QUERY;
+    m_recording->graphicsQuery = GpuProfiler::INVALID_QUERY;
+    if (m_profiler) {
+        m_recording->transferQuery =
+            m_profiler->beginOneShot(m_recording->transferCommandBuffer, m_transferFamily, m_transferScope);
+        if (hasDedicatedTransferQueue()) {
+            m_recording->graphicsQuery =
+                m_profiler->beginOneShot(m_recording->graphicsCommandBuffer, m_graphicsFamily, m_graphicsScope);
+        }
+    }
+}
+
+void UploadContext::setProfiler(GpuProfiler* profiler) {
+    m_profiler = profiler;
+    if (profiler) { // 没有独立传输队列时两个指令缓冲是同一个，只统计一个区间
+        m_transferScope = profiler->scope(hasDedicatedTransferQueue() ? "upload transfer" : "upload");
+        m_graphicsScope = hasDedicatedTransferQueue() ? profiler->scope("upload graphics") : GpuProfiler::INVALID_QUERY;
+    }
+}
+
+VkCommandBuffer UploadContext::transferCommandBuffer() {
+    if (!m_recording) {
+        beginBatch();
+    }
+    return m_recording->transferCommandBuffer;
+}
+
+VkCommandBuffer UploadContext::graphicsCommandBuffer() {
+    if (!m_recording) {
+        beginBatch();
+    }
+    return m_recording->graphicsCommandBuffer;
+}
+
+void UploadContext::releaseBuffer(VkBuffer buffer, VkAccessFlags dstAccess, VkPipelineStageFlags dstStage) {
+    VkBufferMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = dstAccess;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = buffer;
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+    if (!hasDedicatedTransferQueue()) {
+        vkCmdPipelineBarrier(transferCommandBuffer(), VK_PIPELINE_STAGE_TRANSFER_BIT, dstStage, 0,
+                             0, nullptr, 1, &barrier, 0, nullptr);
+        return;
+    }
+    // 释放屏障的dst与获取屏障的src在各自队列上没有意义，按规范置0
+    barrier.srcQueueFamilyIndex = m_transferFamily;
+    barrier.dstQueueFamilyIndex = m_graphicsFamily;
+    barrier.dstAccessMask = 0;
+    vkCmdPipelineBarrier(transferCommandBuffer(), VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+                         0, nullptr, 1, &barrier, 0, nullptr);
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = dstAccess;
+    vkCmdPipelineBarrier(graphicsCommandBuffer(), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dstStage, 0,
+                         0, nullptr, 1, &barrier, 0, nullptr);
+}
+
+void UploadContext::releaseImage(VkImage image, const VkImageSubresourceRange& range, VkImageLayout oldLayout,
+                                 VkImageLayout newLayout, VkAccessFlags dstAccess, VkPipelineStageFlags dstStage) {
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = dstAccess;
+    barrier.oldLayout = oldLayout;
+    barrier.newLayout = newLayout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange = range;
+    if (!hasDedicatedTransferQueue()) {
+        vkCmdPipelineBarrier(transferCommandBuffer(), VK_PIPELINE_STAGE_TRANSFER_BIT, dstStage, 0,
+                             0, nullptr, 0, nullptr, 1, &barrier);
+        return;
+    }
+    // 释放与获取两个屏障的布局必须一致，布局转换只执行一次
+    barrier.srcQueueFamilyIndex = m_transferFamily;
+    barrier.dstQueueFamilyIndex = m_graphicsFamily;
+    barrier.dstAccessMask = 0;
+    vkCmdPipelineBarrier(transferCommandBuffer(), VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+                         0, nullptr, 0, nullptr, 1, &barrier);
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = dstAccess;
+    vkCmdPipelineBarrier(graphicsCommandBuffer(), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dstStage, 0,
+                         0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+StagingRegion UploadContext::stage(const void* data, VkDeviceSize size, VkDeviceSize alignment) {
+    StagingRegion region = reserve(size, alignment);
+    memcpy(region.mapped, data, static_cast<size_t>(size));
+    return region;
+}
+
+StagingRegion UploadContext::reserve(VkDeviceSize size, VkDeviceSize alignment) {
+    if (size > m_ringSize) { // 放不进环形缓冲，使用随批次释放的临时缓冲
+        MemoryAllocation memory;
+        VkBuffer buffer = createStagingBuffer(m_device, *m_allocator, size, memory);
+        transferCommandBuffer();
+        m_recording->tempBuffers.push_back({buffer, memory});
+        return {buffer, 0, memory.mapped};
+    }
+    StagingRegion region;
+    while (!allocateFromRing(size, alignment, region)) {
+        // 空间不足：等待最早的批次；全部空间都被当前批次占用时先提交它
+        if (!m_inFlight.empty()) {
+            retire(true);
+        } else if (m_recording && m_ringHead != m_ringTail) {
+            wait(submit());
+        } else { // 环形缓冲为空，从下一圈的起点开始
+            m_ringHead = m_ringTail = (m_ringHead + m_ringSize - 1) / m_ringSize * m_ringSize;
+        }
+    }
+    return region;
+}
+
+bool UploadContext::tryReserve(VkDeviceSize size, StagingRegion& region, VkDeviceSize alignment) {
+    retire(false);
+    if (!m_recording && m_freeBatches.empty()) { // 开始新批次需要等待空闲的批次
+        return false;
+    }
+    if (size > m_ringSize) { // 临时缓冲不需要等待
+        region = reserve(size, alignment);
+        return true;
+    }
+    if (allocateFromRing(size, alignment, region)) {
+        return true;
+    }
+    if (m_ringHead != m_ringTail) { // 剩余的空间仍被未完成或正在录制的批次占用
+        return false;
+    }
+    m_ringHead = m_ringTail = (m_ringHead + m_ringSize - 1) / m_ringSize * m_ringSize;
+    return allocateFromRing(size, alignment, region);
+}
+
+// 在环形缓冲的写入位置分配对齐的空间，不跨越末尾，剩余空间不足时返回false
+bool UploadContext::allocateFromRing(VkDeviceSize size, VkDeviceSize alignment, StagingRegion& region) {
+    uint64_t offset = (m_ringHead + alignment - 1) / alignment * alignment;
+    if (offset / m_ringSize != (offset + size - 1) / m_ringSize) { // 不跨越环形缓冲的末尾
+        offset = (offset / m_ringSize + 1) * m_ringSize;
+    }
+    if (offset + size - m_ringTail > m_ringSize) {
+        return false;
+    }
+    m_ringHead = offset + size;
+    transferCommandBuffer();
+    region = {m_ringBuffer, offset % m_ringSize, static_cast<uint8_t*>(m_ringMemory.mapped) + offset % m_ringSize};
+    return true;
+}
+
+void UploadContext::uploadBuffer(const void* data, VkDeviceSize size, VkBuffer dstBuffer, VkAccessFlags dstAccess,
+                                 VkPipelineStageFlags dstStage) {
+    copyToBuffer(data, size, dstBuffer, 0);
+    releaseBuffer(dstBuffer, dstAccess, dstStage);
+}
+
+void UploadContext::copyToBuffer(const void* data, VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset) {
+    StagingRegion region = stage(data, size);
+    VkBufferCopy bufferCopyRegion = {};
+    bufferCopyRegion.size = size;
+    bufferCopyRegion.srcOffset = region.offset;
+    bufferCopyRegion.dstOffset = dstOffset;
+    vkCmdCopyBuffer(transferCommandBuffer(), region.buffer, dstBuffer, 1, &bufferCopyRegion);
+}
+
+bool UploadContext::tryCopyToBuffer(const void* data, VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset) {
+    StagingRegion region;
+    if (!tryReserve(size, region)) {
+        return false;
+    }
+    memcpy(region.mapped, data, static_cast<size_t>(size));
+    VkBufferCopy bufferCopyRegion = {};
+    bufferCopyRegion.size = size;
+    bufferCopyRegion.srcOffset = region.offset;
+    bufferCopyRegion.dstOffset = dstOffset;
+    vkCmdCopyBuffer(transferCommandBuffer(), region.buffer, dstBuffer, 1, &bufferCopyRegion);
+    return true;
+}
+
+UploadTicket UploadContext::submit() {
+    if (!m_recording) {
+        return m_lastTicket;
+    }
+    VkSubmitInfo submitInfo = {};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    if (m_profiler) {
+        m_profiler->endOneShot(m_recording->transferCommandBuffer, m_recording->transferQuery);
+        m_profiler->endOneShot(m_recording->graphicsCommandBuffer, m_recording->graphicsQuery);
+    }
+    if (hasDedicatedTransferQueue()) { // 传输队列完成后通过信号量让图形队列获取资源，栅栏放在后一次提交上
+        vkEndCommandBuffer(m_recording->transferCommandBuffer);
+        submitInfo.pCommandBuffers = &m_recording->transferCommandBuffer;
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores = &m_recording->transferFinished;
+        if (vkQueueSubmit(m_transferQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+            throw std::runtime_error("failed to submit upload commands!");
+        }
+        VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+        submitInfo.signalSemaphoreCount = 0;
+        submitInfo.pSignalSemaphores = nullptr;
+        submitInfo.waitSemaphoreCount = 1;
+        submitInfo.pWaitSemaphores = &m_recording->transferFinished;
+        submitInfo.pWaitDstStageMask = &waitStage;
+    }
+    vkEndCommandBuffer(m_recording->graphicsCommandBuffer);
+    submitInfo.pCommandBuffers = &m_recording->graphicsCommandBuffer;
+    if (vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, m_recording->fence) != VK_SUCCESS) {
+        throw std::runtime_error("failed to submit upload commands!");
+    }
+    m_recording->ticket = ++m_lastTicket;
+    m_recording->ringEnd = m_ringHead;
+    m_inFlight.push_back(m_recording);
+    m_recording = nullptr;
+    return m_lastTicket;
+}
+
+bool UploadContext::isComplete(UploadTicket ticket) {
+    retire(false);
+    return ticket <= m_completedTicket;
+}
+
+void UploadContext::wait(UploadTicket ticket) {
+    while (ticket > m_completedTicket && !m_inFlight.empty()) {
+        retire(true);
+    }
+}
+
+void UploadContext::flush() {
+    wait(submit());
+}
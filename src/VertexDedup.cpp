@@ -0,0 +1,157 @@
+﻿// VertexDedup.cpp: 顶点去重的实现
+//
+#include "VertexDedup.h"
+#include <cstring>
+
+// 开放寻址、线性探测的哈希表，容量在构造时一次性确定为2的幂，不会扩容
+template <typename Key, typename Hasher>
+class FlatHashTable {
+public:
+    explicit FlatHashTable(size_t expectedCount) {
+        size_t capacity = 16;
+        while (capacity < expectedCount * 2) { // 负载因子不超过0.5
+            capacity <<= 1;
+        }
+        m_mask = capacity - 1;
+        m_keys.resize(capacity);
+        m_values.assign(capacity, EMPTY);
+    }
+
+    // 查找key，不存在时插入value；返回表中的值以及是否为新插入
+    std::pair<uint32_t, bool> findOrInsert(const Key& key, uint32_t value) {
+        size_t slot = Hasher::hash(key) & m_mask;
+        while (m_values[slot] != EMPTY) {
+            if (Hasher::equal(m_keys[slot], key)) {
+                return {m_values[slot], false};
+            }
+            slot = (slot + 1) & m_mask;
+        }
+        m_keys[slot] = key;
+        m_values[slot] = value;
+        return {value, true};
+    }
+
+private:
+    static constexpr uint32_t EMPTY = UINT32_MAX;
+    std::vector<Key> m_keys;
+    std::vector<uint32_t> m_values;
+    size_t m_mask;
+};
+
+static uint64_t mix64(uint64_t x) { // splitmix64的终结函数，使低位也充分混合
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return x;
+}
+
+struct IndexTripleHasher {
+    static size_t hash(const tinyobj::index_t& key) {
+        uint64_t packed = static_cast<uint32_t>(key.vertex_index)
+                          | (static_cast<uint64_t>(static_cast<uint32_t>(key.texcoord_index)) << 32);
+        return static_cast<size_t>(mix64(packed ^ mix64(static_cast<uint32_t>(key.normal_index))));
+    }
+    static bool equal(const tinyobj::index_t& a, const tinyobj::index_t& b) {
+        return a.vertex_index == b.vertex_index && a.texcoord_index == b.texcoord_index && a.normal_index == b.normal_index;
+    }
+};
+
+// 不同的索引三元组可能引用数值相同的属性，按数值再合并一次才能与原先按Vertex哈希的结果一致
+struct VertexValueHasher {
+    static uint32_t floatBits(float value) {
+        if (value == 0.0f) { // 与operator==保持一致，+0与-0视为相同
+            return 0;
+        }
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+    static size_t hash(const Vertex& vertex) {
+        uint64_t h = floatBits(vertex.position.x) | (static_cast<uint64_t>(floatBits(vertex.position.y)) << 32);
+        h = mix64(h) ^ (floatBits(vertex.position.z) | (static_cast<uint64_t>(floatBits(vertex.texCoord.x)) << 32));
+        h = mix64(h) ^ floatBits(vertex.texCoord.y);
+        return static_cast<size_t>(mix64(h));
+    }
+    static bool equal(const Vertex& a, const Vertex& b) {
+        return a == b;
+    }
+};
+
+static Vertex makeVertex(const tinyobj::attrib_t& attr, const tinyobj::index_t& index) {
+    Vertex vertex;
+    vertex.position = {
+        attr.vertices[3 * index.vertex_index + 0],
+        attr.vertices[3 * index.vertex_index + 1],
+        attr.vertices[3 * index.vertex_index + 2],
+    };
+    if (index.texcoord_index >= 0) {
+        vertex.texCoord = {attr.texcoords[2 * index.texcoord_index + 0],
+                           1.0f - attr.texcoords[2 * index.texcoord_index + 1]};
+    } else {
+        vertex.texCoord = {0.0f, 0.0f};
+    }
+    return vertex;
+}
+
+void VertexDeduplicator::build(const tinyobj::attrib_t& attr, const std::vector<IndexRange>& shapes,
+                               std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
+    size_t shapeCount = shapes.size();
+    std::vector<size_t> indexOffsets(shapeCount);
+    size_t totalIndexCount = indices.size();
+    for (size_t s = 0; s < shapeCount; s++) {
+        indexOffsets[s] = totalIndexCount;
+        totalIndexCount += shapes[s].count;
+    }
+    indices.resize(totalIndexCount);
+
+    // 第一步：各shape并行地对索引三元组去重，按首次出现的顺序记录局部唯一键，局部序号先写入最终的索引数组
+    std::vector<std::vector<tinyobj::index_t>> localKeys(shapeCount);
+    m_threadPool.parallelFor(shapeCount, [&](size_t s) {
+        const IndexRange& range = shapes[s];
+        FlatHashTable<tinyobj::index_t, IndexTripleHasher> table(range.count);
+        std::vector<tinyobj::index_t>& keys = localKeys[s];
+        uint32_t* localIndices = indices.data() + indexOffsets[s];
+        for (size_t i = 0; i < range.count; i++) {
+            auto result = table.findOrInsert(range.indices[i], static_cast<uint32_t>(keys.size()));
+            if (result.second) {
+                keys.push_back(range.indices[i]);
+            }
+            localIndices[i] = result.first;
+        }
+    });
+
+    // 第二步：按shape顺序合并，只有局部唯一键才需要构造顶点并按数值查重，保证顶点顺序与逐索引处理时相同
+    size_t uniqueKeyCount = 0;
+    for (const auto& keys : localKeys) {
+        uniqueKeyCount += keys.size();
+    }
+    FlatHashTable<Vertex, VertexValueHasher> valueTable(uniqueKeyCount + vertices.size());
+    for (uint32_t i = 0; i < vertices.size(); i++) {
+        valueTable.findOrInsert(vertices[i], i);
+    }
+    vertices.reserve(vertices.size() + uniqueKeyCount);
+    std::vector<std::vector<uint32_t>> remaps(shapeCount);
+    for (size_t s = 0; s < shapeCount; s++) {
+        remaps[s].resize(localKeys[s].size());
+        for (size_t k = 0; k < localKeys[s].size(); k++) {
+            Vertex vertex = makeVertex(attr, localKeys[s][k]);
+            auto result = valueTable.findOrInsert(vertex, static_cast<uint32_t>(vertices.size()));
+            if (result.second) {
+                vertices.push_back(vertex);
+            }
+            remaps[s][k] = result.first;
+        }
+        localKeys[s] = std::vector<tinyobj::index_t>(); // 尽早释放
+    }
+
+    // 第三步：并行地将局部序号映射为最终的顶点序号
+    m_threadPool.parallelFor(shapeCount, [&](size_t s) {
+        uint32_t* shapeIndices = indices.data() + indexOffsets[s];
+        const std::vector<uint32_t>& remap = remaps[s];
+        for (size_t i = 0; i < shapes[s].count; i++) {
+            shapeIndices[i] = remap[shapeIndices[i]];
+        }
+    });
+}
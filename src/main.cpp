@@ -0,0 +1,14 @@
+﻿// main.cpp: 定义应用程序的入口点。
+//
+#include "LearnVKApp.h"
+
+int main(int argc, char** argv) {
+    try {
+        LearnVKApp app(AppConfig::parseCommandLine(argc, argv));
+        app.run();
+    } catch (const std::exception& e) { // Vulkan主循环中出现的异常在这里被捕获
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE; // 离屏批处理任务依赖返回值判断是否成功
+    }
+    return EXIT_SUCCESS;
+}
@@ -1,14 +1,17 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
+#extension GL_EXT_nonuniform_qualifier : enable
 
-layout(location = 0) in vec3 fragColor;
 layout(location = 1) in vec2 fragTexCoord;
-layout(binding = 1) uniform sampler2D textureSampler;
+layout(location = 3) flat in uint fragMaterialIndex;
+// 所有材质的纹理，长度在分配描述符集时指定
+layout(binding = 4) uniform sampler2D textureSamplers[];
 
 layout(location = 0) out vec4 outColor;
 
 void main() 
 {
-	vec3 color = texture(textureSampler, fragTexCoord).rgb;
+	// 材质序号来自物体数据，对一次绘制(包括间接绘制中的每一条)不变，属于动态一致的索引
+	vec3 color = texture(textureSamplers[fragMaterialIndex], fragTexCoord).rgb;
 	outColor = vec4(color, 1.0);
 }
\ No newline at end of file
@@ -4,14 +4,35 @@ layout(binding = 0) uniform UniformBufferObject{
 	mat4 model;
 	mat4 view;
 	mat4 proj;
+	vec4 frustumPlanes[6];
 } ubo;
 
+// 与LearnVKApp.h中的ObjectData、InstanceData、DrawInstance一致
+struct ObjectData{
+	vec4 boundsMin;
+	vec4 boundsMax;
+	uint indexOffset;
+	uint indexCount;
+	uint materialIndex;
+	uint padding;
+};
+layout(std430, binding = 1) readonly buffer Objects{
+	ObjectData objects[];
+};
+layout(std430, binding = 2) readonly buffer Instances{
+	mat4 instances[];
+};
+// 绘制时的firstInstance指向当前帧分段中这次实例化绘制的起始位置，每项为(实例序号, 子网格序号)
+layout(std430, binding = 3) readonly buffer DrawInstances{
+	uvec2 drawInstances[];
+};
+
+// 紧凑顶点格式下positions为[0,1]的量化值，模型矩阵中包含了还原到包围盒的变换
 layout(location = 0) in vec3 positions;
-layout(location = 1) in vec3 colors;
 layout(location = 2) in vec2 texCoord;
 
-layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec2 fragTexCoord;
+layout(location = 3) flat out uint fragMaterialIndex;
 
 out gl_PerVertex{
 	vec4 gl_Position;
@@ -19,7 +40,9 @@ out gl_PerVertex{
 
 void main()
 {
-	gl_Position = ubo.proj * ubo.view * ubo.model * vec4(positions, 1.0);
-	fragColor = colors;
+	uvec2 drawInstance = drawInstances[gl_InstanceIndex];
+	ObjectData object = objects[drawInstance.y];
+	gl_Position = ubo.proj * ubo.view * instances[drawInstance.x] * ubo.model * vec4(positions, 1.0);
 	fragTexCoord = texCoord;
+	fragMaterialIndex = object.materialIndex;
 }
\ No newline at end of file
@@ -0,0 +1,169 @@
+﻿// TextureCooker.cpp: 离线纹理烘焙工具
+// 在CPU上生成完整的mip链并进行块压缩，写入与源图片同目录的.lvktex文件，运行时整体上传而无需再生成mipmap
+//
+// 用法: TextureCooker [--format auto|bc1|bc3|bc7|rgba8] [--linear] <图片>...
+//   auto根据是否存在非不透明像素选择BC1或BC3；--linear用于法线等非颜色数据，按线性空间过滤并使用UNORM格式
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "BlockCompressor.h"
+#include "MipGenerator.h"
+#include "TextureFile.h"
+#include "ThreadPool.h"
+#include "vulkan/vulkan_core.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <vendor/stb_image.h>
+
+enum class CookFormat {
+    AUTO,
+    BC1,
+    BC3,
+    BC7,
+    RGBA8,
+};
+
+struct CookOptions {
+    CookFormat format = CookFormat::AUTO;
+    bool linear = false;
+    std::vector<std::string> inputs;
+};
+
+static CookOptions parseCommandLine(int argc, char** argv) {
+    CookOptions options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--format") {
+            if (i + 1 >= argc) {
+                throw std::invalid_argument("missing value for --format");
+            }
+            std::string value = argv[++i];
+            if (value == "auto") {
+                options.format = CookFormat::AUTO;
+            } else if (value == "bc1") {
+                options.format = CookFormat::BC1;
+            } else if (value == "bc3") {
+                options.format = CookFormat::BC3;
+            } else if (value == "bc7") {
+                options.format = CookFormat::BC7;
+            } else if (value == "rgba8") {
+                options.format = CookFormat::RGBA8;
+            } else {
+                throw std::invalid_argument("unknown format: " + value);
+            }
+        } else if (arg == "--linear") {
+            options.linear = true;
+        } else if (arg.size() > 2 && arg.compare(0, 2, "--") == 0) {
+            throw std::invalid_argument("unknown argument: " + arg);
+        } else {
+            options.inputs.push_back(arg);
+        }
+    }
+    if (options.inputs.empty()) {
+        throw std::invalid_argument("usage: TextureCooker [--format auto|bc1|bc3|bc7|rgba8] [--linear] <image>...");
+    }
+    return options;
+}
+
+static VkFormat vulkanFormat(CookFormat format, bool linear) {
+    switch (format) {
+    case CookFormat::BC1:
+        return linear ? VK_FORMAT_BC1_RGB_UNORM_BLOCK : VK_FORMAT_BC1_RGB_SRGB_BLOCK;
+    case CookFormat::BC3:
+        return linear ? VK_FORMAT_BC3_UNORM_BLOCK : VK_FORMAT_BC3_SRGB_BLOCK;
+    case CookFormat::BC7:
+        return linear ? VK_FORMAT_BC7_UNORM_BLOCK : VK_FORMAT_BC7_SRGB_BLOCK;
+    default:
+        return linear ? VK_FORMAT_R8G8B8A8_UNORM : VK_FORMAT_R8G8B8A8_SRGB;
+    }
+}
+
+static const char* formatName(CookFormat format) {
+    static const char* NAMES[] = {"auto", "bc1", "bc3", "bc7", "rgba8"};
+    return NAMES[static_cast<int>(format)];
+}
+
+static TextureLevelData compress(const TextureLevelData& src, BlockFormat format, ThreadPool& threadPool) {
+    TextureLevelData dst;
+    dst.width = src.width;
+    dst.height = src.height;
+    dst.data.resize(BlockCompressor::compressedSize(format, src.width, src.height));
+    size_t rowBytes = static_cast<size_t>((src.width + 3) / 4) * BlockCompressor::blockBytes(format);
+    threadPool.parallelFor((src.height + 3) / 4, [&](size_t blockY) {
+        BlockCompressor::compressBlockRow(format, src.data.data(), src.width, src.height,
+                                          static_cast<uint32_t>(blockY), dst.data.data() + blockY * rowBytes);
+    });
+    return dst;
+}
+
+static void cook(const std::string& path, const CookOptions& options, ThreadPool& threadPool) {
+    auto startTime = std::chrono::high_resolution_clock::now();
+    int width, height, channels;
+    stbi_uc* pixels = stbi_load(path.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+    if (!pixels) {
+        throw std::runtime_error("failed to load image: " + path);
+    }
+    CookFormat format = options.format;
+    if (format == CookFormat::AUTO) {
+        bool opaque = true;
+        for (size_t i = 3; i < static_cast<size_t>(width) * height * 4 && opaque; i += 4) {
+            opaque = pixels[i] == 255;
+        }
+        format = opaque ? CookFormat::BC1 : CookFormat::BC3;
+    }
+
+    // 与运行时回退路径使用同一个生成器，颜色在线性空间中过滤
+    std::vector<uint64_t> offsets;
+    std::vector<uint8_t> chain(MipGenerator::levelOffsets(width, height, offsets));
+    MipGenerator(threadPool).generate(pixels, width, height, !options.linear, chain.data());
+    stbi_image_free(pixels);
+    uint32_t mipLevels = static_cast<uint32_t>(offsets.size());
+    std::vector<TextureLevelData> mips(mipLevels);
+    uint32_t mipWidth = static_cast<uint32_t>(width), mipHeight = static_cast<uint32_t>(height);
+    for (uint32_t i = 0; i < mipLevels; i++) {
+        mips[i].width = mipWidth;
+        mips[i].height = mipHeight;
+        const uint8_t* level = chain.data() + offsets[i];
+        mips[i].data.assign(level, level + static_cast<size_t>(mipWidth) * mipHeight * 4);
+        mipWidth = std::max(1u, mipWidth / 2);
+        mipHeight = std::max(1u, mipHeight / 2);
+    }
+    if (format != CookFormat::RGBA8) {
+        BlockFormat blockFormat = format == CookFormat::BC1 ? BlockFormat::BC1
+                                  : format == CookFormat::BC3 ? BlockFormat::BC3
+                                                              : BlockFormat::BC7;
+        for (auto& mip : mips) {
+            mip = compress(mip, blockFormat, threadPool);
+        }
+    }
+    if (!TextureFile::write(path, vulkanFormat(format, options.linear), mips)) {
+        throw std::runtime_error("failed to write " + TextureFile::cookedPath(path));
+    }
+
+    uint64_t outputSize = 0;
+    for (const auto& mip : mips) {
+        outputSize += mip.data.size();
+    }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+    std::cout << path << ": " << width << "x" << height << " " << formatName(format) << (options.linear ? " linear" : " srgb")
+              << ", " << mipLevels << " mips, " << static_cast<uint64_t>(width) * height * 4 / 1024 << " KB -> "
+              << outputSize / 1024 << " KB in " << ms << " ms" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    try {
+        CookOptions options = parseCommandLine(argc, argv);
+        ThreadPool threadPool;
+        for (const auto& input : options.inputs) {
+            cook(input, options, threadPool);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}